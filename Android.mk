@@ -15,6 +15,14 @@ UDRV := src/udrv
 HALIMPL := halimpl/bcm2079x
 D_CFLAGS := -DANDROID -DBUILDCFG=1
 
+# Set NFC_HAL_SHARED_GKI := true to run the bcm2079x HAL on the GKI instance of
+# libnfc-nci, so that received NCI packets are handed to NFC_TASK without a copy.
+# The HAL module is then built without the halimpl/bcm2079x/gki sources and
+# linked against libnfc-nci.
+ifeq ($(NFC_HAL_SHARED_GKI),true)
+D_CFLAGS += -DNFC_HAL_SHARED_GKI
+endif
+
 
 ######################################
 # Build shared library system/lib/libnfc-nci.so for stack code.
@@ -43,7 +51,7 @@ LOCAL_SRC_FILES := \
     $(call all-c-files-under, $(NFC)/int $(NFC)/llcp $(NFC)/nci $(NFC)/ndef $(NFC)/nfc $(NFC)/tags) \
     $(call all-c-files-under, src/adaptation) \
     $(call all-cpp-files-under, src/adaptation) \
-    $(call all-c-files-under, src/gki) \
+    $(call all-c-files-under, src/gki/common src/gki/ulinux) \
     $(HALIMPL)/adaptation/android_logmsg.cpp \
     src/nfca_version.c
 include $(BUILD_SHARED_LIBRARY)
@@ -59,8 +67,13 @@ LOCAL_MODULE_RELATIVE_PATH := hw
 LOCAL_SRC_FILES := $(call all-c-files-under, $(HALIMPL)) \
     $(call all-cpp-files-under, $(HALIMPL)) \
     src/adaptation/CrcChecksum.cpp \
+    src/adaptation/TaskSched.cpp \
     src//nfca_version.c
 LOCAL_SHARED_LIBRARIES := liblog libcutils libhardware_legacy libstlport
+ifeq ($(NFC_HAL_SHARED_GKI),true)
+LOCAL_SRC_FILES := $(filter-out $(HALIMPL)/gki/%, $(LOCAL_SRC_FILES))
+LOCAL_SHARED_LIBRARIES += libnfc-nci
+endif
 LOCAL_MODULE_TAGS := optional
 LOCAL_C_INCLUDES := external/stlport/stlport bionic/ bionic/libstdc++/include \
     $(LOCAL_PATH)/$(HALIMPL)/include \
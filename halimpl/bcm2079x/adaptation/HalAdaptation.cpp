@@ -35,6 +35,7 @@
 #include <cutils/properties.h>
 #include "buildcfg.h"
 #include "android_logmsg.h"
+#include "TaskSched.h"
 extern void delete_hal_non_volatile_store (bool forceDelete);
 extern void verify_hal_non_volatile_store ();
 extern void resetConfig ();
@@ -218,6 +219,11 @@ int HaiInitializeLibrary (const bcm2079x_dev_t* device)
     HAL_NfcInitialize ();
     HAL_NfcSetTraceLevel (logLevel); // Initialize HAL's logging level
 
+    // HAL_NfcInitialize() sets up GKI and starts NFC_HAL_TASK, which picks up
+    // its settings live; USERIAL_HAL_TASK applies them when it is created.
+    taskSchedConfigure (NFC_HAL_TASK, NAME_NFC_HAL_TASK_SCHED_POLICY, NAME_NFC_HAL_TASK_SCHED_PRIORITY, NAME_NFC_HAL_TASK_CPU_AFFINITY);
+    taskSchedConfigure (USERIAL_HAL_TASK, NAME_USERIAL_TASK_SCHED_POLICY, NAME_USERIAL_TASK_SCHED_PRIORITY, NAME_USERIAL_TASK_CPU_AFFINITY);
+
     retval = 0;
     ALOGD ("%s: exit %d", __FUNCTION__, retval);
     return retval;
@@ -232,7 +238,10 @@ int HaiTerminateLibrary ()
     HAL_NfcTerminate ();
     gAndroidHalCallback = NULL;
     gAndroidHalDataCallback = NULL;
+#ifndef NFC_HAL_SHARED_GKI
+    /* a shared GKI is shut down by the NFC stack */
     GKI_shutdown ();
+#endif
     resetConfig ();
     retval = 0;
     ALOGD ("%s: exit %d", __FUNCTION__, retval);
@@ -35,7 +35,7 @@ extern "C"
 //directory of HAL's non-volatile storage
 static const char* default_location = "/data/nfc";
 static const char* filename_prefix = "/halStorage.bin";
-static const std::string get_storage_location ();
+const std::string get_storage_location ();
 void delete_hal_non_volatile_store (bool forceDelete);
 void verify_hal_non_volatile_store ();
 
@@ -0,0 +1,377 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#include "OverrideLog.h"
+#define LOG_TAG "NfcNciHal"
+#include "PatchCache.h"
+#include "CrcChecksum.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <string>
+
+
+/* bump when tPATCH_CACHE_RECORD changes */
+#define PATCH_CACHE_VERSION     1
+#define PATCH_CACHE_MAX_PATH    256
+
+static const char* filename_prefix = "/halPatchCache.bin";
+extern const std::string get_storage_location ();
+
+typedef struct
+{
+    UINT32  version;                        /* PATCH_CACHE_VERSION */
+
+    /* patch file */
+    char    path [PATCH_CACHE_MAX_PATH];
+    UINT64  size;
+    UINT64  inode;
+    UINT64  mtime;
+    UINT64  ctime;
+    UINT32  hash;                           /* FNV-1a of the content */
+
+    /* what the controller reported while running that patch */
+    UINT32  hw_id;
+    UINT16  project_id;
+    UINT16  ver_major;
+    UINT16  ver_minor;
+    UINT16  lpm_size;
+    UINT16  fpm_size;
+    UINT8   flags;
+    UINT8   nvm_type;
+    UINT8   chip_ver [NFC_HAL_PRM_MAX_CHIP_VER_LEN];
+} tPATCH_CACHE_RECORD;
+
+
+/*******************************************************************************
+**
+** Function         get_cache_filename
+**
+** Description      Get the absolute file name of the patch cache record.
+**
+** Returns          File name, empty if too long.
+**
+*******************************************************************************/
+static std::string get_cache_filename ()
+{
+    std::string fn = get_storage_location ();
+
+    fn.append (filename_prefix);
+    if (fn.length () > 200)
+    {
+        ALOGE ("%s: filename too long", __FUNCTION__);
+        return std::string ();
+    }
+    return fn;
+}
+
+
+/*******************************************************************************
+**
+** Function         hash_patch
+**
+** Description      Compute a 32-bit FNV-1a hash of the patch file content.
+**
+** Returns          Hash value.
+**
+*******************************************************************************/
+static UINT32 hash_patch (const void* p_data, size_t len)
+{
+    const UINT8* p = (const UINT8*) p_data;
+    UINT32 hash = 2166136261u;
+
+    while (len--)
+    {
+        hash ^= *p++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+
+/*******************************************************************************
+**
+** Function         hash_patch_file
+**
+** Description      Hash the content of a patch file of known size.
+**
+** Returns          True if the file could be read.
+**
+*******************************************************************************/
+static bool hash_patch_file (const char* p_fn, size_t len, UINT32* p_hash)
+{
+    void* p;
+    int fd = open (p_fn, O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0)
+        return false;
+
+    p = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    *p_hash = hash_patch (p, len);
+    munmap (p, len);
+    return true;
+}
+
+
+/*******************************************************************************
+**
+** Function         read_record
+**
+** Description      Read the patch cache record and check its integrity.
+**
+** Returns          True if a valid record was read.
+**
+*******************************************************************************/
+static bool read_record (tPATCH_CACHE_RECORD* p_rec)
+{
+    std::string fn = get_cache_filename ();
+    unsigned short checksum = 0;
+    ssize_t actualReadCrc, actualReadData;
+    int fileStream;
+
+    if (fn.empty ())
+        return false;
+
+    if ((fileStream = open (fn.c_str (), O_RDONLY)) < 0)
+        return false;
+
+    actualReadCrc = read (fileStream, &checksum, sizeof(checksum));
+    actualReadData = read (fileStream, p_rec, sizeof(*p_rec));
+    close (fileStream);
+
+    if (  (actualReadCrc != sizeof(checksum))
+        ||(actualReadData != sizeof(*p_rec))
+        ||(checksum != crcChecksumCompute ((const unsigned char*) p_rec, sizeof(*p_rec)))
+        ||(p_rec->version != PATCH_CACHE_VERSION)  )
+    {
+        ALOGE ("%s: discard invalid record %s", __FUNCTION__, fn.c_str ());
+        return false;
+    }
+    return true;
+}
+
+
+/*******************************************************************************
+**
+** Function         write_record
+**
+** Description      Write the patch cache record. It is written to a temporary
+**                  file first, so a crash never leaves a torn record behind.
+**
+** Returns          None
+**
+*******************************************************************************/
+static void write_record (tPATCH_CACHE_RECORD* p_rec)
+{
+    std::string fn = get_cache_filename ();
+    std::string tmp = fn + ".tmp";
+    unsigned short checksum;
+    ssize_t actualWrittenCrc, actualWrittenData;
+    int fileStream;
+
+    if (fn.empty ())
+        return;
+
+    p_rec->version = PATCH_CACHE_VERSION;
+    checksum = crcChecksumCompute ((const unsigned char*) p_rec, sizeof(*p_rec));
+
+    fileStream = open (tmp.c_str (), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fileStream < 0)
+    {
+        ALOGE ("%s: fail to open, error = %d", __FUNCTION__, errno);
+        return;
+    }
+
+    actualWrittenCrc = write (fileStream, &checksum, sizeof(checksum));
+    actualWrittenData = write (fileStream, p_rec, sizeof(*p_rec));
+    close (fileStream);
+
+    if (  (actualWrittenCrc != sizeof(checksum))
+        ||(actualWrittenData != sizeof(*p_rec))
+        ||(rename (tmp.c_str (), fn.c_str ()) != 0)  )
+    {
+        ALOGE ("%s: fail to write, error = %d", __FUNCTION__, errno);
+        remove (tmp.c_str ());
+    }
+}
+
+
+/*******************************************************************************
+**
+** Function         set_controller_info
+**
+** Description      Copy what the controller reported into the record.
+**
+** Returns          None
+**
+*******************************************************************************/
+static void set_controller_info (tPATCH_CACHE_RECORD* p_rec, UINT32 hwId, const tNFC_HAL_NVM* pNvm)
+{
+    p_rec->hw_id      = hwId;
+    p_rec->project_id = pNvm->project_id;
+    p_rec->ver_major  = pNvm->ver_major;
+    p_rec->ver_minor  = pNvm->ver_minor;
+    p_rec->lpm_size   = pNvm->lpm_size;
+    p_rec->fpm_size   = pNvm->fpm_size;
+    p_rec->flags      = pNvm->flags;
+    p_rec->nvm_type   = pNvm->nvm_type;
+    memcpy (p_rec->chip_ver, pNvm->chip_ver, sizeof(p_rec->chip_ver));
+}
+
+
+/*******************************************************************************
+**
+** Function         set_file_info
+**
+** Description      Copy the identity of the patch file into the record.
+**
+** Returns          None
+**
+*******************************************************************************/
+static void set_file_info (tPATCH_CACHE_RECORD* p_rec, const struct stat* p_st)
+{
+    p_rec->size  = p_st->st_size;
+    p_rec->inode = p_st->st_ino;
+    p_rec->mtime = p_st->st_mtime;
+    p_rec->ctime = p_st->st_ctime;
+}
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheIsCurrent
+**
+** Description:     Check if the controller already runs the given patch file.
+**
+** Returns:         True if the patch download can be skipped.
+**
+*******************************************************************************/
+bool patchCacheIsCurrent (const char* pPatchFn, UINT32 hwId, const tNFC_HAL_NVM* pNvm)
+{
+    tPATCH_CACHE_RECORD rec, cur;
+    struct stat st;
+    UINT32 hash = 0;
+
+    if (!read_record (&rec))
+        return false;
+
+    if (strncmp (rec.path, pPatchFn, sizeof(rec.path)) != 0)
+    {
+        ALOGD ("%s: patch file changed from %s", __FUNCTION__, rec.path);
+        return false;
+    }
+
+    /* safe fallback: the controller must report exactly what it did last time */
+    memset (&cur, 0, sizeof(cur));
+    set_controller_info (&cur, hwId, pNvm);
+    if (  (cur.hw_id != rec.hw_id)
+        ||(cur.project_id != rec.project_id)
+        ||(cur.ver_major != rec.ver_major)
+        ||(cur.ver_minor != rec.ver_minor)
+        ||(cur.lpm_size != rec.lpm_size)
+        ||(cur.fpm_size != rec.fpm_size)
+        ||(cur.flags != rec.flags)
+        ||(cur.nvm_type != rec.nvm_type)
+        ||(memcmp (cur.chip_ver, rec.chip_ver, sizeof(cur.chip_ver)) != 0)  )
+    {
+        ALOGD ("%s: controller reports patch %u.%u (flags=0x%x), recorded %u.%u (flags=0x%x)", __FUNCTION__,
+               cur.ver_major, cur.ver_minor, cur.flags, rec.ver_major, rec.ver_minor, rec.flags);
+        patchCacheDelete ();
+        return false;
+    }
+
+    if ((stat (pPatchFn, &st) != 0) || ((UINT64) st.st_size != rec.size))
+    {
+        ALOGD ("%s: patch file %s changed size", __FUNCTION__, pPatchFn);
+        return false;
+    }
+
+    set_file_info (&cur, &st);
+    if ((cur.inode == rec.inode) && (cur.mtime == rec.mtime) && (cur.ctime == rec.ctime))
+        return true;
+
+    /* the file was touched or copied; its content decides */
+    if (!hash_patch_file (pPatchFn, st.st_size, &hash) || (hash != rec.hash))
+    {
+        ALOGD ("%s: patch file %s changed content", __FUNCTION__, pPatchFn);
+        return false;
+    }
+
+    set_file_info (&rec, &st);
+    write_record (&rec);
+    return true;
+}
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheSave
+**
+** Description:     Record that the controller runs the given patch file.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void patchCacheSave (const char* pPatchFn, const void* pPatch, size_t patchLen, UINT32 hwId, const tNFC_HAL_NVM* pNvm)
+{
+    tPATCH_CACHE_RECORD rec;
+    struct stat st;
+
+    if (  (strlen (pPatchFn) >= sizeof(rec.path))
+        ||(stat (pPatchFn, &st) != 0)
+        ||((size_t) st.st_size != patchLen)  )
+    {
+        ALOGE ("%s: cannot record %s", __FUNCTION__, pPatchFn);
+        patchCacheDelete ();
+        return;
+    }
+
+    memset (&rec, 0, sizeof(rec));
+    strncpy (rec.path, pPatchFn, sizeof(rec.path) - 1);
+    set_file_info (&rec, &st);
+    rec.hash = hash_patch (pPatch, patchLen);
+    set_controller_info (&rec, hwId, pNvm);
+
+    ALOGD ("%s: %s is patch %u.%u on hw 0x%lx", __FUNCTION__, pPatchFn, rec.ver_major, rec.ver_minor, hwId);
+    write_record (&rec);
+}
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheDelete
+**
+** Description:     Forget the recorded patch.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void patchCacheDelete ()
+{
+    std::string fn = get_cache_filename ();
+
+    if (!fn.empty ())
+        remove (fn.c_str ());
+}
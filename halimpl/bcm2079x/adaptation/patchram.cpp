@@ -24,8 +24,14 @@ extern "C"
     #include "nfc_hal_post_reset.h"
 }
 #include <string>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <cutils/properties.h>
 #include "spdhelper.h"
+#include "PatchCache.h"
 #include "StartupConfig.h"
 
 #define LOG_TAG "NfcNciHal"
@@ -37,8 +43,10 @@ extern "C"
 #define MAX_BUFFER      (512)
 static char sPrePatchFn[MAX_BUFFER+1];
 static char sPatchFn[MAX_BUFFER+1];
-static void * sPrmBuf = NULL;
-static void * sI2cFixPrmBuf = NULL;
+static void * sPrmBuf = NULL;           /* read-only mapping of sPatchFn */
+static size_t sPrmBufLen = 0;
+static void * sI2cFixPrmBuf = NULL;     /* read-only mapping of sPrePatchFn */
+static size_t sI2cFixPrmBufLen = 0;
 
 #define CONFIG_MAX_LEN 256
 static UINT8 sConfig [CONFIG_MAX_LEN];
@@ -107,21 +115,76 @@ tNFC_POST_RESET_CB nfc_post_reset_cb =
 
 /*******************************************************************************
 **
-** Function         getFileLength
+** Function         mapPatchFile
 **
-** Description      return the size of a file
+** Description      Map a patch file read-only, so that PRM sends the segments
+**                  straight from the page cache instead of a heap copy
 **
-** Returns          file size in number of bytes
+** Returns          pointer to the mapped file and its size in *pLen,
+**                  NULL if the file cannot be mapped
 **
 *******************************************************************************/
-static long getFileLength(FILE* fp)
+static void* mapPatchFile(const char* pFilename, size_t* pLen)
 {
-    long sz;
-    fseek(fp, 0L, SEEK_END);
-    sz = ftell(fp);
-    fseek(fp, 0L, SEEK_SET);
+    struct stat st;
+    void* p;
+    int fd;
 
-    return (sz > 0) ? sz : 0;
+    if ((fd = open(pFilename, O_RDONLY | O_CLOEXEC)) == -1)
+    {
+        ALOGE("%s Unable to open %s; errno=%d", __FUNCTION__, pFilename, errno);
+        return NULL;
+    }
+
+    if ((fstat(fd, &st) == -1) || (st.st_size <= 0))
+    {
+        ALOGE("%s Unable to get size of %s; errno=%d", __FUNCTION__, pFilename, errno);
+        close(fd);
+        return NULL;
+    }
+
+    /* the mapping stays valid after the descriptor is closed */
+    p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+    {
+        ALOGE("%s Unable to map %s (%ld bytes); errno=%d", __FUNCTION__, pFilename, (long) st.st_size, errno);
+        return NULL;
+    }
+
+    /* the patch is read once from start to end */
+    madvise(p, st.st_size, MADV_SEQUENTIAL);
+
+    *pLen = st.st_size;
+    return p;
+}
+
+/*******************************************************************************
+**
+** Function         releasePatchFiles
+**
+** Description      Unmap the patch files once PRM no longer uses them
+**
+** Returns          None
+**
+*******************************************************************************/
+static void releasePatchFiles()
+{
+    if (sI2cFixPrmBuf != NULL)
+    {
+        /* PRM keeps the I2C fix pointer across downloads */
+        HAL_NfcPrmSetI2cPatch(NULL, 0, 0);
+        munmap(sI2cFixPrmBuf, sI2cFixPrmBufLen);
+        sI2cFixPrmBuf = NULL;
+        sI2cFixPrmBufLen = 0;
+    }
+
+    if (sPrmBuf != NULL)
+    {
+        munmap(sPrmBuf, sPrmBufLen);
+        sPrmBuf = NULL;
+        sPrmBufLen = 0;
+    }
 }
 
 /*******************************************************************************
@@ -206,10 +269,15 @@ static void continueAfterSetSnoozeMode(tHAL_NFC_STATUS status)
 static void postDownloadPatchram(tHAL_NFC_STATUS status)
 {
     ALOGD("%s: status=%i", __FUNCTION__, status);
+
+    /* Download is over (or never started); drop the patch file mappings */
+    releasePatchFiles();
+
     GetStrValue (NAME_SNOOZE_MODE_CFG, (char*)&gSnoozeModeCfg, sizeof(gSnoozeModeCfg));
     if (status != HAL_NFC_STATUS_OK)
     {
         ALOGE("%s: Patch download failed", __FUNCTION__);
+        patchCacheDelete();
         if (status == HAL_NFC_STATUS_REFUSED)
         {
             SpdHelper::setPatchAsBad();
@@ -272,6 +340,11 @@ void prmCallback(UINT8 event)
         break;
 
     case NFC_HAL_PRM_COMPLETE_EVT:
+        /* Record the patch only when the version check found it already in */
+        /* NVM; after a download the version in nvm_cb is stale, and the    */
+        /* next start records it instead                                    */
+        if (nfc_hal_cb.prm.spd_up_to_date && (sPrmBuf != NULL))
+            patchCacheSave(sPatchFn, sPrmBuf, sPrmBufLen, nfc_hal_cb.dev_cb.brcm_hw_id, &nfc_hal_cb.nvm_cb);
         postDownloadPatchram(HAL_NFC_STATUS_OK);
         break;
 
@@ -415,75 +488,61 @@ static void StartPatchDownload(UINT32 chipid)
     findPatchramFile(FW_PATCH, sPatchFn, sizeof(sPatchFn));
     findPatchramFile(FW_PRE_PATCH, sPrePatchFn, sizeof(sPatchFn));
 
+    /* In case an earlier download was abandoned without completing */
+    releasePatchFiles();
+
+    /* If the controller already runs this patch file, skip PRM entirely */
+    unsigned long useCache = 1;
+    GetNumValue(NAME_FW_PATCH_CACHE, &useCache, sizeof(useCache));
+    if (  (sPatchFn[0] != '\0') && (useCache != 0)
+        &&(!(nfc_hal_cb.nvm_cb.flags & NFC_HAL_NVM_FLAGS_NO_NVM))
+        &&(patchCacheIsCurrent(sPatchFn, chipid, &nfc_hal_cb.nvm_cb))  )
+    {
+        ALOGD("%s: patch %u.%u from %s already in NVM; skipping patch download", __FUNCTION__,
+              nfc_hal_cb.nvm_cb.ver_major, nfc_hal_cb.nvm_cb.ver_minor, sPatchFn);
+        postDownloadPatchram(HAL_NFC_STATUS_OK);
+        return;
+    }
+
     {
-        FILE *fd;
         /* If an I2C fix patch file was specified, then tell the stack about it */
         if (sPrePatchFn[0] != '\0')
         {
-            if ((fd = fopen(sPrePatchFn, "rb")) != NULL)
+            if ((sI2cFixPrmBuf = mapPatchFile(sPrePatchFn, &sI2cFixPrmBufLen)) != NULL)
             {
-                UINT32 lenPrmBuffer = getFileLength(fd);
-
-                if ((sI2cFixPrmBuf = malloc(lenPrmBuffer)) != NULL)
-                {
-                    size_t actualLen = fread(sI2cFixPrmBuf, 1, lenPrmBuffer, fd);
-                    if (actualLen == lenPrmBuffer)
-                    {
-                        ALOGD("%s Setting I2C fix to %s (size: %lu)", __FUNCTION__, sPrePatchFn, lenPrmBuffer);
-                        HAL_NfcPrmSetI2cPatch((UINT8*)sI2cFixPrmBuf, (UINT16)lenPrmBuffer, 0);
-                    }
-                    else
-                        ALOGE("%s fail reading i2c fix; actual len=%u; expected len=%lu", __FUNCTION__, actualLen, lenPrmBuffer);
-                }
-                else
-                {
-                    ALOGE("%s Unable to get buffer to i2c fix (%lu bytes)", __FUNCTION__, lenPrmBuffer);
-                }
-
-                fclose(fd);
+                ALOGD("%s Setting I2C fix to %s (size: %zu)", __FUNCTION__, sPrePatchFn, sI2cFixPrmBufLen);
+                HAL_NfcPrmSetI2cPatch((UINT8*)sI2cFixPrmBuf, (UINT16)sI2cFixPrmBufLen, 0);
             }
             else
             {
-                ALOGE("%s Unable to open i2c fix patchfile %s", __FUNCTION__, sPrePatchFn);
+                ALOGE("%s Unable to map i2c fix patchfile %s", __FUNCTION__, sPrePatchFn);
             }
         }
     }
 
     {
-        FILE *fd;
-
         /* If a patch file was specified, then download it now */
         if (sPatchFn[0] != '\0')
         {
             UINT32 bDownloadStarted = false;
 
-            /* open patchfile, read it into a buffer */
-            if ((fd = fopen(sPatchFn, "rb")) != NULL)
+            /* map patchfile; PRM reads the segments from the mapping */
+            if ((sPrmBuf = mapPatchFile(sPatchFn, &sPrmBufLen)) != NULL)
             {
-                UINT32 lenPrmBuffer = getFileLength(fd);
-                ALOGD("%s Downloading patchfile %s (size: %lu) format=%u", __FUNCTION__, sPatchFn, lenPrmBuffer, NFC_HAL_PRM_FORMAT_NCD);
-                if ((sPrmBuf = malloc(lenPrmBuffer)) != NULL)
+                ALOGD("%s Downloading patchfile %s (size: %zu) format=%u", __FUNCTION__, sPatchFn, sPrmBufLen, NFC_HAL_PRM_FORMAT_NCD);
+                if (!SpdHelper::isPatchBad((UINT8*)sPrmBuf, sPrmBufLen))
                 {
-                    size_t actualLen = fread(sPrmBuf, 1, lenPrmBuffer, fd);
-                    if (actualLen == lenPrmBuffer)
-                    {
-                        if (!SpdHelper::isPatchBad((UINT8*)sPrmBuf, lenPrmBuffer))
-                        {
-                            /* Download patch using static memeory mode */
-                            HAL_NfcPrmDownloadStart(NFC_HAL_PRM_FORMAT_NCD, 0, (UINT8*)sPrmBuf, lenPrmBuffer, 0, prmCallback);
-                            bDownloadStarted = true;
-                        }
-                    }
-                    else
-                        ALOGE("%s fail reading patchram", __FUNCTION__);
-                }
-                else
-                    ALOGE("%s Unable to buffer to hold patchram (%lu bytes)", __FUNCTION__, lenPrmBuffer);
+                    unsigned long window = 0;
+                    if (GetNumValue(NAME_SPD_PIPELINE_WINDOW, &window, sizeof(window)) && (window > 0))
+                        HAL_NfcPrmSetSpdWindow((UINT8)window);
 
-                fclose(fd);
+                    /* Download patch using static memeory mode */
+                    HAL_NfcPrmDownloadStart(NFC_HAL_PRM_FORMAT_NCD, 0, (UINT8*)sPrmBuf, sPrmBufLen, 0, prmCallback);
+                    bDownloadStarted = true;
+                }
             }
             else
-                ALOGE("%s Unable to open patchfile %s", __FUNCTION__, sPatchFn);
+                ALOGE("%s Unable to map patchfile %s", __FUNCTION__, sPatchFn);
 
             /* If the download never got started */
             if (!bDownloadStarted)
@@ -22,6 +22,7 @@
 #include "nfc_hal_api.h"
 #include "nfc_hal_int.h"
 #include "userial.h"
+#include "userial_transport.h"
 #include "nfc_target.h"
 
 #include <pthread.h>
@@ -32,6 +33,7 @@
 #include <gki_int.h>
 #include "hcidefs.h"
 #include <poll.h>
+#include <sys/uio.h>
 #include "upio.h"
 #include "bcm2079x.h"
 #include "config.h"
@@ -56,6 +58,7 @@ int uart_port  = 0;
 int isLowSpeedTransport = 0;
 int nfc_wake_delay = 0;
 int nfc_write_delay = 0;
+int nfc_write_guard_time = 0;
 int gPowerOnDelay = 300;
 static int gPrePowerOffDelay = 0;    // default value
 static int gPostPowerOffDelay = 0;     // default value
@@ -135,6 +138,16 @@ static UINT8 set_nfc_off_cmd[5] = {
 #define USERIAL_USE_IO_BT_WAKE FALSE
 #endif
 
+/* read the NFCC from NFC_HAL_TASK, woken through GKI_register_fd(), instead of from a
+ * separate read thread. Saves a thread hop and a context switch per received packet. */
+#ifndef USERIAL_DIRECT_READ
+#if (GKI_WAIT_EVENTFD == TRUE)
+#define USERIAL_DIRECT_READ TRUE
+#else
+#define USERIAL_DIRECT_READ FALSE
+#endif
+#endif
+
 /* this are the ioctl values used for bt_wake ioctl via UART driver. you may need to redefine at for
  * you platform! Logically they need to be unique and not colide with existing uart ioctl's.
  */
@@ -152,11 +165,35 @@ static UINT8 set_nfc_off_cmd[5] = {
  * It would be better to use some ring buffer from the USERIAL_Read() is reading
  * instead of putting it into GKI buffers.
  */
-#define READ_LIMIT (USERIAL_POOL_BUF_SIZE-BT_HDR_SIZE)
+/* Headroom left in front of each received frame, so that a buffer holding exactly one
+ * NCI packet can be passed up by the HAL without copying it */
+#ifndef USERIAL_RX_OFFSET
+#define USERIAL_RX_OFFSET   NFC_HAL_NCI_RECEIVE_OFFSET
+#endif
+#define READ_LIMIT (USERIAL_POOL_BUF_SIZE-BT_HDR_SIZE-USERIAL_RX_OFFSET)
 /*
  * minimum buffer size requirement to read a full sized packet from NFCC = 255 + 4 byte header
  */
 #define MIN_BUFSIZE 259
+
+/* on a serial port, read whatever is available into a ring and frame packets out of it
+ * instead of reading each packet's type, header and payload separately. UART_READAHEAD=0
+ * in the config file selects the byte-exact reads for transports that need them. */
+#ifndef USERIAL_RX_READAHEAD
+#define USERIAL_RX_READAHEAD TRUE
+#endif
+
+/* size of the readahead ring, a power of 2 of at least 2 full sized packets */
+#ifndef USERIAL_RX_RING_SIZE
+#define USERIAL_RX_RING_SIZE 2048
+#endif
+
+/* bits on the wire for each byte written to a serial port (8N1) */
+#define USERIAL_BITS_PER_BYTE 10
+/* delay (us) before the next write when the driver did not take a whole packet */
+#ifndef USERIAL_WRITE_RETRY_DELAY
+#define USERIAL_WRITE_RETRY_DELAY 5000
+#endif
 #define     POLL_TIMEOUT    1000
 /* priority of the reader thread */
 #define USERIAL_READ_TRHEAD_PRIO 90
@@ -173,7 +210,7 @@ typedef struct  {
     volatile unsigned long bt_wake_state;
     int             sock;
     tUSERIAL_CBACK      *ser_cb;
-    UINT16      baud;
+    UINT32      baud;
     UINT8       data_bits;
     UINT16      parity;
     UINT8       stop_bits;
@@ -186,10 +223,21 @@ typedef struct  {
 
 static tLINUX_CB linux_cb;  /* case of multipel port support use array : [MAX_SERIAL_PORT] */
 
+/* transport backends, in the order they are tried by USERIAL_Open */
+static const tUSERIAL_TRANSPORT * const userial_transports[] =
+{
+    &userial_socket_transport,
+    &userial_driver_transport
+};
+
+/* backend of the open port */
+static const tUSERIAL_TRANSPORT *p_userial_transport = &userial_driver_transport;
+
 void userial_close_thread(UINT32 params);
 
 static UINT8 device_name[BTE_APPL_MAX_USERIAL_DEV_NAME+1];
 static int   bSerialPortDevice = FALSE;
+static int   bRxReadahead = USERIAL_RX_READAHEAD;
 static int _timeout = POLL_TIMEOUT;
 static BOOLEAN is_close_thread_is_waiting = FALSE;
 
@@ -197,89 +245,207 @@ static int change_client_addr(int addr);
 
 int   perf_log_every_count = 0;
 typedef struct {
-    const char* label;
-    long    lapse;
-    long    bytes;
-    long    count;
-    long    overhead;
+    const char*         label;
+    tUSERIAL_PERF_HIST  hist;
 } tPERF_DATA;
 
+static tPERF_DATA   perf_data[USERIAL_PERF_NUM_HIST] =
+{
+    {"USERIAL_Poll",            {0}},
+    {"USERIAL_Read",            {0}},
+    {"USERIAL_Write",           {0}},
+    {"USERIAL_WriteDelay",      {0}},
+    {"USERIAL_Poll_to_Poll",    {0}}
+};
+static UINT64       _poll_t0 = 0;
+
 /*******************************************************************************
 **
-** Function         perf_reset
+** Function         perf_now
 **
-** Description      reset performance measurement data
+** Description      read the monotonic clock used to time transport operations
 **
-** Returns          none
+** Returns          current time in microseconds
 **
 *******************************************************************************/
-void perf_reset(tPERF_DATA* t)
+static UINT64 perf_now(void)
 {
-    t->count =
-    t->bytes =
-    t->lapse = 0;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((UINT64) now.tv_sec * 1000000 + now.tv_nsec / 1000);
 }
 
 /*******************************************************************************
 **
-** Function         perf_log
+** Function         perf_percentile
 **
-** Description      produce a log entry of cvurrent performance data
+** Description      find the bucket holding a given percentile of the samples
 **
-** Returns          none
+** Returns          upper bound of that bucket in microseconds, capped at the
+**                  largest sample
 **
 *******************************************************************************/
-void perf_log(tPERF_DATA* t)
+static UINT32 perf_percentile(const tUSERIAL_PERF_HIST* h, UINT8 percent)
 {
-    // round to nearest ms
-    // t->lapse += 500;
-    // t->lapse /= 1000;
-    if (t->lapse)
+    UINT64  rank, seen = 0;
+    int     xx;
+
+    if (h->count == 0)
+        return 0;
+
+    rank = ((UINT64) h->count * percent + 99) / 100;
+    for (xx = 0; xx < USERIAL_PERF_NUM_BUCKETS - 1; xx++)
     {
-        if (t->bytes)
-            ALOGD( "%s:%s, bytes=%ld, lapse=%ld (%d.%02d kbps) (bus data rate %d.%02d kbps) overhead %d(%d percent)\n",
-                    __func__,
-                    t->label, t->bytes, t->lapse,
-                    (int)(8 * t->bytes / t->lapse), (int)(800 * t->bytes / (t->lapse)) % 100,
-                    (int)(9 * (t->bytes + t->count * t->overhead) / t->lapse), (int)(900 * (t->bytes + t->count * t->overhead) / (t->lapse)) % 100,
-                    (int)(t->count * t->overhead), (int)(t->count * t->overhead * 100 / t->bytes)
-                    );
-        else
-            ALOGD( "%s:%s, lapse=%ld (average %ld)\n", __func__,
-                    t->label, t->lapse, (int)t->lapse / t->count
-                    );
+        seen += h->bucket[xx];
+        if (seen >= rank)
+            return ((1UL << xx) - 1 < h->max_us) ? (1UL << xx) - 1 : h->max_us;
     }
-    perf_reset(t);
+    return h->max_us;
 }
 
 /*******************************************************************************
 **
-** Function         perf_update
+** Function         perf_log
 **
-** Description      update perforamnce measurement data
+** Description      produce a log entry of current performance data
 **
 ** Returns          none
 **
 *******************************************************************************/
-void perf_update(tPERF_DATA* t, long lapse, long bytes)
+static void perf_log(tPERF_DATA* t)
 {
-    if (!perf_log_every_count)
+    tUSERIAL_PERF_HIST* h = &t->hist;
+
+    if (h->count == 0)
         return;
-    // round to nearest ms
-    lapse += 500;
-    lapse /= 1000;
-    t->count++;
-    t->bytes += bytes;
-    t->lapse += lapse;
-    if (t->count == perf_log_every_count)
-        perf_log(t);
+
+    if (h->bytes && h->total_us)
+        ALOGD( "%s:%s, count=%u, avg=%u us, p50<=%u us, p99<=%u us, max=%u us, bytes=%llu (%u kbps)\n",
+                __func__, t->label, h->count, (unsigned)(h->total_us / h->count),
+                perf_percentile(h, 50), perf_percentile(h, 99), h->max_us,
+                (unsigned long long)h->bytes, (unsigned)(h->bytes * 8000 / h->total_us));
+    else
+        ALOGD( "%s:%s, count=%u, avg=%u us, p50<=%u us, p99<=%u us, max=%u us\n",
+                __func__, t->label, h->count, (unsigned)(h->total_us / h->count),
+                perf_percentile(h, 50), perf_percentile(h, 99), h->max_us);
+}
+
+/*******************************************************************************
+**
+** Function         perf_update
+**
+** Description      add one timed operation to a latency histogram. Bucket n
+**                  counts the operations that took 2^(n-1) to 2^n - 1 us.
+**                  The histograms are dumped every perf_log_every_count
+**                  operations when REPORT_PERFORMANCE_MEASURE is set.
+**
+** Returns          none
+**
+*******************************************************************************/
+static void perf_update(UINT8 id, UINT64 lapse, long bytes)
+{
+    tUSERIAL_PERF_HIST* h = &perf_data[id].hist;
+    int     bucket = 0;
+
+    if (lapse > 0xFFFFFFFF)
+        lapse = 0xFFFFFFFF;
+    while (bucket < USERIAL_PERF_NUM_BUCKETS - 1 && (lapse >> bucket) != 0)
+        bucket++;
+
+    h->bucket[bucket]++;
+    h->count++;
+    h->total_us += lapse;
+    h->bytes += bytes;
+    if (lapse > h->max_us)
+        h->max_us = (UINT32) lapse;
+
+    if (perf_log_every_count && (h->count % perf_log_every_count) == 0)
+        perf_log(&perf_data[id]);
+}
+
+/*******************************************************************************
+**
+** Function           USERIAL_GetPerfHist
+**
+** Description        Take a copy of one of the transport latency histograms.
+**                    They count from the time the HAL was loaded or
+**                    USERIAL_ResetPerfHist was last called.
+**                    The counters are updated without locking, so a copy
+**                    taken while the transport is busy may be off by one.
+**
+** Output Parameter   p_hist: the histogram
+**
+** Returns            FALSE if id is not a USERIAL_PERF_* histogram
+**
+*******************************************************************************/
+UDRV_API BOOLEAN USERIAL_GetPerfHist(UINT8 id, tUSERIAL_PERF_HIST *p_hist)
+{
+    if (id >= USERIAL_PERF_NUM_HIST)
+        return FALSE;
+
+    memcpy(p_hist, &perf_data[id].hist, sizeof(tUSERIAL_PERF_HIST));
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function           USERIAL_GetPerfPercentile
+**
+** Description        Estimate a percentile of one of the latency histograms.
+**
+** Output Parameter   None
+**
+** Returns            upper bound of the bucket holding the percentile in
+**                    microseconds, 0 if there is no sample
+**
+*******************************************************************************/
+UDRV_API UINT32 USERIAL_GetPerfPercentile(UINT8 id, UINT8 percent)
+{
+    if (id >= USERIAL_PERF_NUM_HIST || percent > 100)
+        return 0;
+
+    return perf_percentile(&perf_data[id].hist, percent);
+}
+
+/*******************************************************************************
+**
+** Function           USERIAL_ResetPerfHist
+**
+** Description        Clear all the transport latency histograms.
+**
+** Output Parameter   None
+**
+** Returns            None
+**
+*******************************************************************************/
+UDRV_API void USERIAL_ResetPerfHist(void)
+{
+    int xx;
+
+    for (xx = 0; xx < USERIAL_PERF_NUM_HIST; xx++)
+        memset(&perf_data[xx].hist, 0, sizeof(tUSERIAL_PERF_HIST));
+    _poll_t0 = 0;
 }
 
-static tPERF_DATA   perf_poll = {"USERIAL_Poll", 0, 0, 0, 0};
-static tPERF_DATA   perf_read = {"USERIAL_Read", 0, 0, 0, 9};
-static tPERF_DATA   perf_write = {"USERIAL_Write", 0, 0, 0, 3};
-static tPERF_DATA   perf_poll_2_poll = {"USERIAL_Poll_to_Poll", 0, 0, 0, 0};
-static clock_t      _poll_t0 = 0;
+/*******************************************************************************
+**
+** Function           USERIAL_DumpPerfHist
+**
+** Description        Log a summary of all the transport latency histograms.
+**
+** Output Parameter   None
+**
+** Returns            None
+**
+*******************************************************************************/
+UDRV_API void USERIAL_DumpPerfHist(void)
+{
+    int xx;
+
+    for (xx = 0; xx < USERIAL_PERF_NUM_HIST; xx++)
+        perf_log(&perf_data[xx]);
+}
 
 static UINT32 userial_baud_tbl[] =
 {
@@ -352,35 +518,71 @@ static inline int isWake(int state)
 **
 ** Description        Record a delay for the next write operation
 **
-** Input Parameter    delay in milliseconds
+** Input Parameter    delay in microseconds, 0 for none
 **
 ** Comments           use this function to register a delay before next write,
 **                    This is used in three instances: power up delay, wake delay
 **                    and write delay
 **
 *******************************************************************************/
-static void setWriteDelay(int delay)
+static void setWriteDelay(UINT32 delay)
 {
-    if (delay <= 0) {
-        // Set a minimum delay of 5ms between back-to-back writes
-        delay = 5;
-    }
-
     clock_gettime(CLOCK_MONOTONIC, &linux_cb.write_time);
-    if (delay > 1000)
+    if (delay >= 1000000)
     {
-        linux_cb.write_time.tv_sec += delay / 1000;
-        delay %= 1000;
+        linux_cb.write_time.tv_sec += delay / 1000000;
+        delay %= 1000000;
     }
-    unsigned long write_delay = delay * 1000 * 1000;
-    linux_cb.write_time.tv_nsec += write_delay;
-    if (linux_cb.write_time.tv_nsec > 1000*1000*1000)
+    linux_cb.write_time.tv_nsec += delay * 1000;
+    if (linux_cb.write_time.tv_nsec >= 1000*1000*1000)
     {
         linux_cb.write_time.tv_nsec -= 1000*1000*1000;
         linux_cb.write_time.tv_sec++;
     }
 }
 
+/*******************************************************************************
+**
+** Function           setWritePacing
+**
+** Description        Register the delay needed after writing a packet
+**
+** Input Parameter    written: number of bytes the driver took
+**                    requested: number of bytes in the packet
+**
+** Comments           An I2C/SPI driver returns once the transfer is complete, so
+**                    the next write can follow at once. On a serial port the
+**                    write returns as soon as the tty has queued the bytes, so
+**                    the next write waits for them to be clocked out at the
+**                    current line speed. NFC_WRITE_DELAY (ms per 1000 bytes) and
+**                    NFC_WRITE_GUARD_TIME (ms) set a longer gap for controllers
+**                    that need one.
+**
+*******************************************************************************/
+static void setWritePacing(int written, int requested)
+{
+    UINT32 delay = 0;
+    UINT32 line_speed;
+
+    if (written < requested)
+        delay = USERIAL_WRITE_RETRY_DELAY;
+
+    /* only a real UART clocks the bytes out at the line speed */
+    if (bSerialPortDevice && !p_userial_transport->stream &&
+        (line_speed = USERIAL_GetLineSpeed(linux_cb.open_cfg.baud)) != 0)
+    {
+        UINT32 wire = (UINT32) ((unsigned long long) written * USERIAL_BITS_PER_BYTE * 1000000 / line_speed);
+        if (wire > delay)
+            delay = wire;
+    }
+    if (nfc_write_delay > 0 && (UINT32) (written * nfc_write_delay) > delay)
+        delay = written * nfc_write_delay;
+    if (nfc_write_guard_time > 0 && (UINT32) nfc_write_guard_time * 1000 > delay)
+        delay = nfc_write_guard_time * 1000;
+
+    setWriteDelay(delay);
+}
+
 /*******************************************************************************
 **
 ** Function           doWriteDelay
@@ -414,8 +616,11 @@ static void doWriteDelay()
 
     if (delay > 0 && delay < 1000)
     {
+        UINT64 t = perf_now();
+
         ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "doWriteDelay() delay %ld ms", delay);
         GKI_delay(delay);
+        perf_update(USERIAL_PERF_WRITE_DELAY, perf_now() - t, 0);
     }
 }
 
@@ -519,6 +724,19 @@ typedef unsigned char uchar;
 
 BUFFER_Q Userial_in_q;
 
+/* readahead ring; head and tail run freely and are masked on access */
+typedef struct
+{
+    uchar       data[USERIAL_RX_RING_SIZE];
+    UINT32      head;       /* next byte written by read() */
+    UINT32      tail;       /* first byte of the next packet */
+} tUSERIAL_RX_RING;
+
+static tUSERIAL_RX_RING userial_rx_ring;
+
+#define RX_RING_MASK        (USERIAL_RX_RING_SIZE - 1)
+#define RX_RING_BYTE(i)     userial_rx_ring.data[(userial_rx_ring.tail + (i)) & RX_RING_MASK]
+
 /*******************************************************************************
  **
  ** Function           USERIAL_GetLineSpeed
@@ -610,18 +828,24 @@ UDRV_API void    USERIAL_Init(void * p_cfg)
  ** Returns            number of bytes in the packet or error code
  **
  *******************************************************************************/
+static int userial_read_frame(int fd, uchar *pbuf, int len);
+static int userial_ring_frame(uchar *pbuf, int len);
+
 int my_read(int fd, uchar *pbuf, int len)
 {
     struct pollfd fds[2];
 
     int n = 0;
     int ret = 0;
-    int count = 0;
-    int offset = 0;
-    clock_t t1, t2;
+    UINT64 t1, t2;
 
     if (!isLowSpeedTransport && _timeout != POLL_TIMEOUT)
         ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "%s: enter, pbuf=%lx, len = %d\n", __func__, (unsigned long)pbuf, len);
+
+    /* packets already read ahead would not make the fd readable again */
+    if ((ret = userial_ring_frame(pbuf, len)) > 0)
+        return ret;
+
     memset(pbuf, 0, len);
     /* need to use select in order to avoid collistion between read and close on same fd */
     /* Initialize the input set */
@@ -632,12 +856,12 @@ int my_read(int fd, uchar *pbuf, int len)
     create_signal_fds(&fds[1]);
     fds[1].events = POLLIN | POLLERR | POLLRDNORM;
     fds[1].revents = 0;
-    t1 = clock();
+    t1 = perf_now();
     n = poll(fds, 2, _timeout);
-    t2 = clock();
-    perf_update(&perf_poll, t2 - t1, 0);
+    t2 = perf_now();
+    perf_update(USERIAL_PERF_POLL, t2 - t1, 0);
     if (_poll_t0)
-        perf_update(&perf_poll_2_poll, t2 - _poll_t0, 0);
+        perf_update(USERIAL_PERF_POLL_TO_POLL, t2 - _poll_t0, 0);
 
     _poll_t0 = t2;
     /* See if there was an error */
@@ -655,15 +879,157 @@ int my_read(int fd, uchar *pbuf, int len)
         reset_signal();
         return -1;
     }
+    ret = userial_read_frame(fd, pbuf, len);
+
+    if (!isLowSpeedTransport)
+        ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "%s: return %d(0x%x) bytes, errno=%d n=%d, timeout=%d\n", __func__,
+            ret, ret, errno, n, _timeout);
+    if (_timeout == POLL_TIMEOUT)
+        _timeout = -1;
+    return ret;
+}
+
+/*******************************************************************************
+ **
+ ** Function           userial_ring_frame
+ **
+ ** Description        Take the next complete packet out of the readahead ring.
+ **                    Bytes that cannot start a packet, or whose header
+ **                    declares more than the ring holds, are dropped; so are
+ **                    packets longer than pbuf.
+ **
+ ** Output Parameter   None
+ **
+ ** Returns            number of bytes in the packet, 0 if none is complete
+ **
+ *******************************************************************************/
+static int userial_ring_frame(uchar *pbuf, int len)
+{
+    tUSERIAL_RX_RING *p_ring = &userial_rx_ring;
+    UINT32 avail;
+    UINT32 hdr_len;
+    UINT32 pkt_len;
+    UINT32 first;
+
+    while ((avail = p_ring->head - p_ring->tail) > 0)
+    {
+        if (RX_RING_BYTE(0) == HCIT_TYPE_NFC)
+            hdr_len = 4;
+        else if (RX_RING_BYTE(0) == HCIT_TYPE_EVENT)
+            hdr_len = 3;
+        else
+        {
+            /* resynchronize on the next byte */
+            ALOGD( "%s: unknown HCIT type header %x, dropped\n", __func__, RX_RING_BYTE(0));
+            p_ring->tail++;
+            continue;
+        }
+
+        if (avail < hdr_len)
+            return 0;
+        pkt_len = hdr_len + RX_RING_BYTE(hdr_len - 1);
+        if (pkt_len > USERIAL_RX_RING_SIZE)
+        {
+            /* could never complete in the ring; resynchronize on the next byte */
+            ALOGE( "%s: %u byte packet does not fit the ring, dropped header %x\n", __func__, pkt_len, RX_RING_BYTE(0));
+            p_ring->tail++;
+            continue;
+        }
+        if (avail < pkt_len)
+            return 0;
+        if (pkt_len > (UINT32) len)
+        {
+            /* complete but too long for the caller; skip the whole packet */
+            ALOGE( "%s: %u byte packet exceeds buffer of %d, dropped\n", __func__, pkt_len, len);
+            p_ring->tail += pkt_len;
+            continue;
+        }
+
+        /* copy out in at most two runs, the second one after the ring wraps */
+        first = USERIAL_RX_RING_SIZE - (p_ring->tail & RX_RING_MASK);
+        if (first > pkt_len)
+            first = pkt_len;
+        memcpy(pbuf, &p_ring->data[p_ring->tail & RX_RING_MASK], first);
+        memcpy(pbuf + first, p_ring->data, pkt_len - first);
+        p_ring->tail += pkt_len;
+        return (int) pkt_len;
+    }
+    return 0;
+}
+
+/*******************************************************************************
+ **
+ ** Function           userial_read_ahead
+ **
+ ** Description        Readahead variant of userial_read_frame(): reads as much
+ **                    as the driver has (and the ring holds) in one read() and
+ **                    frames the next packet out of the ring. Blocks in read()
+ **                    only while a started packet is incomplete.
+ **
+ ** Output Parameter   None
+ **
+ ** Returns            number of bytes in the packet or error code
+ **
+ *******************************************************************************/
+static int userial_read_ahead(int fd, uchar *pbuf, int len)
+{
+    tUSERIAL_RX_RING *p_ring = &userial_rx_ring;
+    UINT32 pos;
+    UINT32 room;
+    int ret;
+    UINT64 t2;
+
+    while ((ret = userial_ring_frame(pbuf, len)) == 0)
+    {
+        /* contiguous free space from head up to the tail or the end of the ring */
+        pos  = p_ring->head & RX_RING_MASK;
+        room = USERIAL_RX_RING_SIZE - (p_ring->head - p_ring->tail);
+        if (room > USERIAL_RX_RING_SIZE - pos)
+            room = USERIAL_RX_RING_SIZE - pos;
+
+        t2 = perf_now();
+        ret = p_userial_transport->read(fd, &p_ring->data[pos], room);
+        if (ret <= 0)
+            break;
+        perf_update(USERIAL_PERF_READ, perf_now() - t2, ret);
+        p_ring->head += ret;
+    }
+    return ret;
+}
+
+/*******************************************************************************
+ **
+ ** Function           userial_read_frame
+ **
+ ** Description        This function reads a packet from a driver that has
+ **                    input ready. On a serial port the HCI header is parsed
+ **                    so that exactly one packet is read, either through the
+ **                    readahead ring or with byte-exact reads.
+ **
+ ** Output Parameter   None
+ **
+ ** Returns            number of bytes in the packet or error code
+ **
+ *******************************************************************************/
+static int userial_read_frame(int fd, uchar *pbuf, int len)
+{
+    int ret = 0;
+    int count = 0;
+    int offset = 0;
+    UINT64 t2;
+
+    if (bRxReadahead && bSerialPortDevice && !isLowSpeedTransport && len >= MIN_BUFSIZE)
+        return userial_read_ahead(fd, pbuf, len);
+
     if (!bSerialPortDevice || len < MIN_BUFSIZE)
         count = len;
     else
         count = 1;
     do {
-        t2 = clock();
-        ret = read(fd, pbuf+offset, (size_t)count);
+        t2 = perf_now();
+        ret = p_userial_transport->read(fd, pbuf+offset, count);
         if (ret > 0)
-            perf_update(&perf_read, clock()-t2, ret);
+            perf_update(USERIAL_PERF_READ, perf_now() - t2, ret);
 
         if (ret <= 0 || !bSerialPortDevice || len < MIN_BUFSIZE)
             break;
@@ -735,11 +1101,6 @@ int my_read(int fd, uchar *pbuf, int len)
     }
 #endif
 done:
-    if (!isLowSpeedTransport)
-        ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "%s: return %d(0x%x) bytes, errno=%d count=%d, n=%d, timeout=%d\n", __func__,
-            ret, ret, errno, count, n, _timeout);
-    if (_timeout == POLL_TIMEOUT)
-        _timeout = -1;
     return ret;
 }
 extern BOOLEAN gki_chk_buf_damage(void *p_buf);
@@ -776,10 +1137,10 @@ UINT32 userial_read_thread(UINT32 arg)
 
         if ((p_buf = (BT_HDR *) GKI_getpoolbuf( USERIAL_POOL_ID ) )!= NULL)
         {
-            p_buf->offset = 0;
+            p_buf->offset = USERIAL_RX_OFFSET;
             p_buf->layer_specific = 0;
 
-            current_packet = (UINT8 *) (p_buf + 1);
+            current_packet = (UINT8 *) (p_buf + 1) + USERIAL_RX_OFFSET;
             rx_length = my_read(linux_cb.sock, current_packet, READ_LIMIT);
 
         }
@@ -856,6 +1217,91 @@ UINT32 userial_read_thread(UINT32 arg)
     return 0;
 }
 
+#if (USERIAL_DIRECT_READ == TRUE)
+static int sDirectErrorCount = 0;
+static UINT64 _poll_idle_t0 = 0;    /* when the last check found no input, 0 if it found some */
+
+/*******************************************************************************
+ **
+ ** Function           userial_read_direct
+ **
+ ** Description        Read the next packet from the driver in the calling task,
+ **                    if one is waiting. Replaces userial_read_thread() when
+ **                    NFC_HAL_TASK is woken by the driver fd itself.
+ **
+ ** Output Parameter   None
+ **
+ ** Returns            GKI buffer holding the packet, or NULL if none
+ **
+ *******************************************************************************/
+static BT_HDR *userial_read_direct(void)
+{
+    struct pollfd fds;
+    BT_HDR *p_buf;
+    int rx_length;
+    int n;
+    UINT64 t2;
+
+    if (linux_cb.sock <= 0)
+        return NULL;
+
+    /* bytes left in the readahead ring are the start of the next packet(s) */
+    if (userial_rx_ring.head == userial_rx_ring.tail)
+    {
+        fds.fd = linux_cb.sock;
+        fds.events = POLLIN | POLLERR | POLLRDNORM;
+        fds.revents = 0;
+        n = poll(&fds, 1, 0);
+        t2 = perf_now();
+
+        /* the task waited for input in GKI_wait() since the last check found none */
+        if (n > 0)
+            perf_update(USERIAL_PERF_POLL, _poll_idle_t0 ? t2 - _poll_idle_t0 : 0, 0);
+        if (_poll_t0)
+            perf_update(USERIAL_PERF_POLL_TO_POLL, t2 - _poll_t0, 0);
+
+        _poll_t0 = t2;
+        _poll_idle_t0 = (n > 0) ? 0 : t2;
+        if (n <= 0)
+            return NULL;
+    }
+
+    if ((p_buf = (BT_HDR *) GKI_getpoolbuf( USERIAL_POOL_ID )) == NULL)
+    {
+        ALOGE( "%s: unable to get buffer from GKI poolid = %d\n", __func__, USERIAL_POOL_ID);
+        GKI_delay( NO_GKI_BUFFER_RECOVER_TIME );
+        return NULL;
+    }
+    p_buf->offset = USERIAL_RX_OFFSET;
+    p_buf->layer_specific = 0;
+
+    rx_length = userial_read_frame(linux_cb.sock, (UINT8 *) (p_buf + 1) + USERIAL_RX_OFFSET, READ_LIMIT);
+    if (rx_length > 0)
+    {
+        sDirectErrorCount = 0;
+        if (rx_length > sRxLength)
+            sRxLength = rx_length;
+        p_buf->len = (UINT16)rx_length;
+        return p_buf;
+    }
+
+    GKI_freebuf( p_buf );
+    if (rx_length == 0 && !isWake(-1))
+        return NULL;
+
+    /* the fd is level triggered, so stop polling a broken driver after reporting it */
+    if ((++sDirectErrorCount % MAX_ERROR) == 0)
+    {
+        ALOGE( "%s: read returned (%d) error count = %d, errno=%d return USERIAL_ERR_EVT\n",
+                __func__, rx_length, sDirectErrorCount, errno);
+        GKI_deregister_fd(NFC_HAL_TASK, linux_cb.sock);
+        if (linux_cb.ser_cb != NULL)
+            (*linux_cb.ser_cb)(linux_cb.port, USERIAL_ERR_EVT, NULL);
+    }
+    return NULL;
+}
+#endif
+
 /*******************************************************************************
  **
  ** Function           userial_to_tcio_baud
@@ -930,6 +1376,184 @@ void userial_io_init_bt_wake( int fd, unsigned long * p_wake_state )
 }
 #endif
 
+/*******************************************************************************
+**
+** Function           userial_driver_match
+**
+** Description        The driver backend handles any device no other backend
+**                    claims: the bcm2079x kernel driver or a UART.
+**
+** Returns            TRUE
+**
+*******************************************************************************/
+static BOOLEAN userial_driver_match(const char *p_dev)
+{
+    return TRUE;
+}
+
+/*******************************************************************************
+**
+** Function           userial_driver_open
+**
+** Description        Open the device node and the power control device, and
+**                    set up the line settings of a UART.
+**
+** Returns            file descriptor, -1 if failed
+**
+*******************************************************************************/
+static int userial_driver_open(const char *p_dev)
+{
+    struct termios termios;
+    int fd;
+
+    if ((fd = open(p_dev, O_RDWR | O_NOCTTY )) == -1)
+        return -1;
+
+    if (GetStrValue ( NAME_POWER_CONTROL_DRIVER, power_control_dev, sizeof ( power_control_dev ) ) &&
+        power_control_dev[0] != '\0')
+    {
+        if (strcmp(power_control_dev, userial_dev) == 0)
+            linux_cb.sock_power_control = fd;
+        else
+        {
+            if ((linux_cb.sock_power_control = open((char*)power_control_dev, O_RDWR | O_NOCTTY )) == -1)
+            {
+                ALOGI("%s unable to open %s",  __FUNCTION__, power_control_dev);
+            }
+        }
+    }
+    if ( bSerialPortDevice )
+    {
+        tcflush(fd, TCIOFLUSH);
+        tcgetattr(fd, &termios);
+
+        termios.c_cflag &= ~(CSIZE | PARENB);
+        termios.c_cflag = CLOCAL|CREAD|linux_cb.data_bits|linux_cb.stop_bits|linux_cb.parity;
+        if (!linux_cb.parity)
+            termios.c_cflag |= IGNPAR;
+        // termios.c_cflag &= ~CRTSCTS;
+        termios.c_oflag = 0;
+        termios.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+        termios.c_iflag &= ~(BRKINT | ICRNL | INLCR | ISTRIP | IXON | IGNBRK | PARMRK | INPCK);
+        termios.c_lflag = 0;
+        termios.c_iflag = 0;
+        cfsetospeed(&termios, linux_cb.baud);
+        cfsetispeed(&termios, linux_cb.baud);
+
+        termios.c_cc[VTIME] = 0;
+        termios.c_cc[VMIN] = 1;
+        tcsetattr(fd, TCSANOW, &termios);
+
+        tcflush(fd, TCIOFLUSH);
+    }
+    return fd;
+}
+
+/*******************************************************************************
+**
+** Function           userial_driver_read
+**
+** Description        Read from the device node
+**
+** Returns            number of bytes read, or -1
+**
+*******************************************************************************/
+static int userial_driver_read(int fd, UINT8 *p_data, int len)
+{
+    return read(fd, p_data, (size_t)len);
+}
+
+/*******************************************************************************
+**
+** Function           userial_driver_write
+**
+** Description        Write to the device node. A single packet is written with
+**                    write(), which every driver supports.
+**
+** Returns            number of bytes written, or -1
+**
+*******************************************************************************/
+static int userial_driver_write(int fd, const struct iovec *p_iov, int count)
+{
+    if (count == 1)
+        return write(fd, p_iov->iov_base, p_iov->iov_len);
+    return writev(fd, p_iov, count);
+}
+
+/*******************************************************************************
+**
+** Function           userial_driver_close
+**
+** Description        Close the device node and the power control device
+**
+** Returns            None
+**
+*******************************************************************************/
+static void userial_driver_close(int fd)
+{
+    int result;
+
+    result = close(fd);
+    if (result == -1)
+        ALOGE("%s: fail close linux_cb.sock; errno=%d", __FUNCTION__, errno);
+
+    if (linux_cb.sock_power_control > 0 && linux_cb.sock_power_control != fd)
+    result = close(linux_cb.sock_power_control);
+    if (result == -1)
+        ALOGE("%s: fail close linux_cb.sock_power_control; errno=%d", __FUNCTION__, errno);
+
+    linux_cb.sock_power_control = -1;
+}
+
+/*******************************************************************************
+**
+** Function           userial_driver_power
+**
+** Description        Power the NFCC up after the device is opened, or down
+**                    before it is closed
+**
+** Returns            None
+**
+*******************************************************************************/
+static void userial_driver_power(tUSERIAL_PORT port, BOOLEAN on)
+{
+    if (on)
+    {
+        if ( bSerialPortDevice )
+        {
+#if (USERIAL_USE_IO_BT_WAKE==TRUE)
+            userial_io_init_bt_wake( linux_cb.sock, &linux_cb.bt_wake_state );
+#endif
+            GKI_delay(gPowerOnDelay);
+        }
+        else
+        {
+            USERIAL_PowerupDevice(port);
+        }
+    }
+    else if (linux_cb.sock_power_control > 0)
+    {
+        ioctl(linux_cb.sock_power_control, BCMNFC_WAKE_CTL, sleep_state());
+        ALOGD("%s: Delay %dms before turning off the chip", __FUNCTION__, gPrePowerOffDelay);
+        GKI_delay(gPrePowerOffDelay);
+        ioctl(linux_cb.sock_power_control, BCMNFC_POWER_CTL, 0);
+        ALOGD("%s: Delay %dms after turning off the chip", __FUNCTION__, gPostPowerOffDelay);
+        GKI_delay(gPostPowerOffDelay);
+    }
+}
+
+const tUSERIAL_TRANSPORT userial_driver_transport =
+{
+    "driver",
+    userial_driver_match,
+    userial_driver_open,
+    userial_driver_read,
+    userial_driver_write,
+    userial_driver_close,
+    userial_driver_power,
+    FALSE
+};
+
 /*******************************************************************************
 **
 ** Function           USERIAL_Open
@@ -943,15 +1567,11 @@ void userial_io_init_bt_wake( int fd, unsigned long * p_wake_state )
 *******************************************************************************/
 UDRV_API void USERIAL_Open(tUSERIAL_PORT port, tUSERIAL_OPEN_CFG *p_cfg, tUSERIAL_CBACK *p_cback)
 {
-    UINT32 baud = 0;
-    UINT8 data_bits = 0;
-    UINT16 parity = 0;
-    UINT8 stop_bits = 0;
-    struct termios termios;
     const char ttyusb[] = "/dev/ttyUSB";
     const char devtty[] = "/dev/tty";
     unsigned long num = 0;
     int     ret = 0;
+    int     xx;
 
     ALOGI("USERIAL_Open(): enter");
 
@@ -980,10 +1600,15 @@ UDRV_API void USERIAL_Open(tUSERIAL_PORT port, tUSERIAL_OPEN_CFG *p_cfg, tUSERIA
         uart_port = num;
     if ( GetNumValue ( NAME_LOW_SPEED_TRANSPORT, &num, sizeof ( num ) ) )
         isLowSpeedTransport = num;
+    bRxReadahead = USERIAL_RX_READAHEAD;
+    if ( GetNumValue ( NAME_UART_READAHEAD, &num, sizeof ( num ) ) )
+        bRxReadahead = num;
     if ( GetNumValue ( NAME_NFC_WAKE_DELAY, &num, sizeof ( num ) ) )
         nfc_wake_delay = num;
     if ( GetNumValue ( NAME_NFC_WRITE_DELAY, &num, sizeof ( num ) ) )
         nfc_write_delay = num;
+    if ( GetNumValue ( NAME_NFC_WRITE_GUARD_TIME, &num, sizeof ( num ) ) )
+        nfc_write_guard_time = num;
     if ( GetNumValue ( NAME_PERF_MEASURE_FREQ, &num, sizeof ( num ) ) )
         perf_log_every_count = num;
     if ( GetNumValue ( NAME_POWER_ON_DELAY, &num, sizeof ( num ) ) )
@@ -994,15 +1619,23 @@ UDRV_API void USERIAL_Open(tUSERIAL_PORT port, tUSERIAL_OPEN_CFG *p_cfg, tUSERIA
         gPostPowerOffDelay = num;
     if ( GetNumValue ( NAME_POWER_OFF_MODE, &num, sizeof ( num ) ) )
         gPowerOffMode = num;
-    ALOGI("USERIAL_Open() device: %s port=%d, uart_port=%d WAKE_DELAY(%d) WRITE_DELAY(%d) POWER_ON_DELAY(%d) PRE_POWER_OFF_DELAY(%d) POST_POWER_OFF_DELAY(%d)",
-            (char*)userial_dev, port, uart_port, nfc_wake_delay, nfc_write_delay, gPowerOnDelay, gPrePowerOffDelay,
+    ALOGI("USERIAL_Open() device: %s port=%d, uart_port=%d WAKE_DELAY(%d) WRITE_DELAY(%d) WRITE_GUARD_TIME(%d) POWER_ON_DELAY(%d) PRE_POWER_OFF_DELAY(%d) POST_POWER_OFF_DELAY(%d)",
+            (char*)userial_dev, port, uart_port, nfc_wake_delay, nfc_write_delay, nfc_write_guard_time, gPowerOnDelay, gPrePowerOffDelay,
             gPostPowerOffDelay);
 
     strcpy((char*)device_name, (char*)userial_dev);
     sRxLength = 0;
     _poll_t0 = 0;
+    userial_rx_ring.head = userial_rx_ring.tail = 0;
+
+    for (xx = 0; !userial_transports[xx]->match(userial_dev); xx++)
+        ;
+    p_userial_transport = userial_transports[xx];
+    ALOGI("USERIAL_Open() using %s transport", p_userial_transport->name);
 
-    if ((strncmp(userial_dev, ttyusb, sizeof(ttyusb)-1) == 0) ||
+    if (p_userial_transport->stream)
+        bSerialPortDevice = TRUE;
+    else if ((strncmp(userial_dev, ttyusb, sizeof(ttyusb)-1) == 0) ||
         (strncmp(userial_dev, devtty, sizeof(devtty)-1) == 0) )
     {
         if (uart_port >= MAX_SERIAL_PORT)
@@ -1013,33 +1646,33 @@ UDRV_API void USERIAL_Open(tUSERIAL_PORT port, tUSERIAL_OPEN_CFG *p_cfg, tUSERIA
         bSerialPortDevice = TRUE;
         sprintf((char*)device_name, "%s%d", (char*)userial_dev, uart_port);
         ALOGI("USERIAL_Open() using device_name: %s ", (char*)device_name);
-        if (!userial_to_tcio_baud(p_cfg->baud, &baud))
+        if (!userial_to_tcio_baud(p_cfg->baud, &linux_cb.baud))
             goto done_open;
 
         if (p_cfg->fmt & USERIAL_DATABITS_8)
-            data_bits = CS8;
+            linux_cb.data_bits = CS8;
         else if (p_cfg->fmt & USERIAL_DATABITS_7)
-            data_bits = CS7;
+            linux_cb.data_bits = CS7;
         else if (p_cfg->fmt & USERIAL_DATABITS_6)
-            data_bits = CS6;
+            linux_cb.data_bits = CS6;
         else if (p_cfg->fmt & USERIAL_DATABITS_5)
-            data_bits = CS5;
+            linux_cb.data_bits = CS5;
         else
             goto done_open;
 
         if (p_cfg->fmt & USERIAL_PARITY_NONE)
-            parity = 0;
+            linux_cb.parity = 0;
         else if (p_cfg->fmt & USERIAL_PARITY_EVEN)
-            parity = PARENB;
+            linux_cb.parity = PARENB;
         else if (p_cfg->fmt & USERIAL_PARITY_ODD)
-            parity = (PARENB | PARODD);
+            linux_cb.parity = (PARENB | PARODD);
         else
             goto done_open;
 
         if (p_cfg->fmt & USERIAL_STOPBITS_1)
-            stop_bits = 0;
+            linux_cb.stop_bits = 0;
         else if (p_cfg->fmt & USERIAL_STOPBITS_2)
-            stop_bits = CSTOPB;
+            linux_cb.stop_bits = CSTOPB;
         else
             goto done_open;
     }
@@ -1048,65 +1681,26 @@ UDRV_API void USERIAL_Open(tUSERIAL_PORT port, tUSERIAL_OPEN_CFG *p_cfg, tUSERIA
 
     {
         ALOGD("%s Opening %s\n",  __FUNCTION__, device_name);
-        if ((linux_cb.sock = open((char*)device_name, O_RDWR | O_NOCTTY )) == -1)
+        if ((linux_cb.sock = p_userial_transport->open((char*)device_name)) == -1)
         {
             ALOGI("%s unable to open %s",  __FUNCTION__, device_name);
             GKI_send_event(NFC_HAL_TASK, NFC_HAL_TASK_EVT_TERMINATE);
             goto done_open;
         }
         ALOGD( "%s sock = %d\n", __FUNCTION__, linux_cb.sock);
-        if (GetStrValue ( NAME_POWER_CONTROL_DRIVER, power_control_dev, sizeof ( power_control_dev ) ) &&
-            power_control_dev[0] != '\0')
-        {
-            if (strcmp(power_control_dev, userial_dev) == 0)
-                linux_cb.sock_power_control = linux_cb.sock;
-            else
-            {
-                if ((linux_cb.sock_power_control = open((char*)power_control_dev, O_RDWR | O_NOCTTY )) == -1)
-                {
-                    ALOGI("%s unable to open %s",  __FUNCTION__, power_control_dev);
-                }
-            }
-        }
-        if ( bSerialPortDevice )
-        {
-            tcflush(linux_cb.sock, TCIOFLUSH);
-            tcgetattr(linux_cb.sock, &termios);
-
-            termios.c_cflag &= ~(CSIZE | PARENB);
-            termios.c_cflag = CLOCAL|CREAD|data_bits|stop_bits|parity;
-            if (!parity)
-                termios.c_cflag |= IGNPAR;
-            // termios.c_cflag &= ~CRTSCTS;
-            termios.c_oflag = 0;
-            termios.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
-            termios.c_iflag &= ~(BRKINT | ICRNL | INLCR | ISTRIP | IXON | IGNBRK | PARMRK | INPCK);
-            termios.c_lflag = 0;
-            termios.c_iflag = 0;
-            cfsetospeed(&termios, baud);
-            cfsetispeed(&termios, baud);
-
-            termios.c_cc[VTIME] = 0;
-            termios.c_cc[VMIN] = 1;
-            tcsetattr(linux_cb.sock, TCSANOW, &termios);
-
-            tcflush(linux_cb.sock, TCIOFLUSH);
-
-#if (USERIAL_USE_IO_BT_WAKE==TRUE)
-            userial_io_init_bt_wake( linux_cb.sock, &linux_cb.bt_wake_state );
-#endif
-            GKI_delay(gPowerOnDelay);
-        }
-        else
-        {
-            USERIAL_PowerupDevice(port);
-        }
+        p_userial_transport->power(port, TRUE);
     }
 
     linux_cb.ser_cb     = p_cback;
     linux_cb.port = port;
     memcpy(&linux_cb.open_cfg, p_cfg, sizeof(tUSERIAL_OPEN_CFG));
+#if (USERIAL_DIRECT_READ == TRUE)
+    /* NFC_HAL_TASK reads the driver itself whenever it becomes readable */
+    sDirectErrorCount = 0;
+    GKI_register_fd (NFC_HAL_TASK, linux_cb.sock, NFC_HAL_TASK_EVT_DATA_RDY);
+#else
     GKI_create_task ((TASKPTR)userial_read_thread, USERIAL_HAL_TASK, (INT8*)"USERIAL_HAL_TASK", 0, 0, (pthread_cond_t*)NULL, NULL);
+#endif
 
 
 #if (defined USERIAL_DEBUG) && (USERIAL_DEBUG == TRUE)
@@ -1174,7 +1768,13 @@ UDRV_API UINT16  USERIAL_Read(tUSERIAL_PORT port, UINT8 *p_data, UINT16 len)
         }
 
         if (pbuf_USERIAL_Read == NULL && (total_len < len))
+        {
             pbuf_USERIAL_Read = (BT_HDR *)GKI_dequeue(&Userial_in_q);
+#if (USERIAL_DIRECT_READ == TRUE)
+            if (pbuf_USERIAL_Read == NULL)
+                pbuf_USERIAL_Read = userial_read_direct();
+#endif
+        }
 
     } while ((pbuf_USERIAL_Read != NULL) && (total_len < len));
 
@@ -1203,7 +1803,19 @@ UDRV_API UINT16  USERIAL_Read(tUSERIAL_PORT port, UINT8 *p_data, UINT16 len)
 
 UDRV_API void    USERIAL_ReadBuf(tUSERIAL_PORT port, BT_HDR **p_buf)
 {
+    /* Whatever USERIAL_Read() left of its current buffer comes first */
+    if (pbuf_USERIAL_Read != NULL)
+    {
+        *p_buf = pbuf_USERIAL_Read;
+        pbuf_USERIAL_Read = NULL;
+        return;
+    }
 
+    *p_buf = (BT_HDR *) GKI_dequeue(&Userial_in_q);
+#if (USERIAL_DIRECT_READ == TRUE)
+    if (*p_buf == NULL)
+        *p_buf = userial_read_direct();
+#endif
 }
 
 /*******************************************************************************
@@ -1244,16 +1856,19 @@ UDRV_API UINT16  USERIAL_Write(tUSERIAL_PORT port, UINT8 *p_data, UINT16 len)
 {
     int ret = 0, total = 0;
     int i = 0;
-    clock_t t;
+    struct iovec iov;
+    UINT64 t;
 
     ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "USERIAL_Write: (%d bytes)", len);
     pthread_mutex_lock(&close_thread_mutex);
 
     doWriteDelay();
-    t = clock();
+    t = perf_now();
     while (len != 0 && linux_cb.sock != -1)
     {
-        ret = write(linux_cb.sock, p_data + total, len);
+        iov.iov_base = p_data + total;
+        iov.iov_len  = len;
+        ret = p_userial_transport->write(linux_cb.sock, &iov, 1);
         if (ret < 0)
         {
             ALOGE("USERIAL_Write len = %d, ret = %d, errno = %d", len, ret, errno);
@@ -1267,10 +1882,86 @@ UDRV_API UINT16  USERIAL_Write(tUSERIAL_PORT port, UINT8 *p_data, UINT16 len)
         total += ret;
         len -= ret;
     }
-    perf_update(&perf_write, clock() - t, total);
+    perf_update(USERIAL_PERF_WRITE, perf_now() - t, total);
 
     /* register a delay for next write */
-    setWriteDelay(total * nfc_write_delay / 1000);
+    setWritePacing(total, total + len);
+
+    pthread_mutex_unlock(&close_thread_mutex);
+
+    return ((UINT16)total);
+}
+
+/*******************************************************************************
+**
+** Function           USERIAL_WriteV
+**
+** Description        Write several packets to a serial port with one writev().
+**                    A character driver without vectored write support gets
+**                    each packet as its own write() from the kernel, so packet
+**                    boundaries are kept on I2C/SPI. When NFC_WRITE_DELAY or
+**                    NFC_WRITE_GUARD_TIME asks for a gap between packets, they
+**                    are written one at a time with USERIAL_Write.
+**
+** Output Parameter   None
+**
+** Returns            Number of bytes actually written to the transport.  This
+**                    may be less than the total length of the packets.
+**
+*******************************************************************************/
+UDRV_API UINT16  USERIAL_WriteV(tUSERIAL_PORT port, tUSERIAL_IOV *p_iov, UINT8 count)
+{
+    struct iovec iov[USERIAL_MAX_IOV];
+    int ret = 0, total = 0, requested = 0;
+    UINT8 i, first = 0;
+    UINT64 t;
+
+    if ((count == 1) || (count > USERIAL_MAX_IOV) || (nfc_write_delay > 0) || (nfc_write_guard_time > 0))
+    {
+        for (i = 0; i < count; i++)
+            total += USERIAL_Write(port, p_iov[i].p_data, p_iov[i].len);
+        return ((UINT16)total);
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        iov[i].iov_base = p_iov[i].p_data;
+        iov[i].iov_len  = p_iov[i].len;
+        requested += p_iov[i].len;
+    }
+
+    ALOGD_IF((appl_trace_level>=BT_TRACE_LEVEL_DEBUG), "USERIAL_WriteV: (%d packets, %d bytes)", count, requested);
+    pthread_mutex_lock(&close_thread_mutex);
+
+    doWriteDelay();
+    t = perf_now();
+    while (first < count && linux_cb.sock != -1)
+    {
+        ret = p_userial_transport->write(linux_cb.sock, &iov[first], count - first);
+        if (ret < 0)
+        {
+            ALOGE("USERIAL_WriteV len = %d, ret = %d, errno = %d", requested - total, ret, errno);
+            break;
+        }
+
+        total += ret;
+
+        /* skip the packets written, a short write may stop inside one */
+        while (first < count && (size_t) ret >= iov[first].iov_len)
+        {
+            ret -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count)
+        {
+            iov[first].iov_base = (UINT8 *) iov[first].iov_base + ret;
+            iov[first].iov_len -= ret;
+        }
+    }
+    perf_update(USERIAL_PERF_WRITE, perf_now() - t, total);
+
+    /* register a delay for next write */
+    setWritePacing(total, requested);
 
     pthread_mutex_unlock(&close_thread_mutex);
 
@@ -1463,6 +2154,12 @@ UDRV_API void    USERIAL_Close(tUSERIAL_PORT port)
         GKI_delay(delay);
     }
 
+#if (USERIAL_DIRECT_READ == TRUE)
+    // stop NFC_HAL_TASK polling the driver before the close thread closes it
+    if (linux_cb.sock > 0)
+        GKI_deregister_fd (NFC_HAL_TASK, linux_cb.sock);
+#endif
+
     // check to see if thread is already running
     if (pthread_mutex_trylock(&close_thread_mutex) == 0)
     {
@@ -1498,7 +2195,9 @@ UDRV_API void    USERIAL_Close(tUSERIAL_PORT port)
 void userial_close_thread(UINT32 params)
 {
     BT_HDR                  *p_buf = NULL;
+#if (USERIAL_DIRECT_READ == FALSE)
     int result;
+#endif
 
     ALOGD( "%s: closing transport (%d)\n", __FUNCTION__, linux_cb.sock);
     pthread_mutex_lock(&close_thread_mutex);
@@ -1511,35 +2210,23 @@ void userial_close_thread(UINT32 params)
         return;
     }
 
+#if (USERIAL_DIRECT_READ == FALSE)
     send_wakeup_signal();
     result = pthread_join( worker_thread1, NULL );
     if ( result < 0 )
         ALOGE( "%s: pthread_join() FAILED: result: %d", __FUNCTION__, result );
     else
         ALOGD( "%s: pthread_join() joined: result: %d", __FUNCTION__, result );
+#endif
 
-    if (linux_cb.sock_power_control > 0)
-    {
-        result = ioctl(linux_cb.sock_power_control, BCMNFC_WAKE_CTL, sleep_state());
-        ALOGD("%s: Delay %dms before turning off the chip", __FUNCTION__, gPrePowerOffDelay);
-        GKI_delay(gPrePowerOffDelay);
-        result = ioctl(linux_cb.sock_power_control, BCMNFC_POWER_CTL, 0);
-        ALOGD("%s: Delay %dms after turning off the chip", __FUNCTION__, gPostPowerOffDelay);
-        GKI_delay(gPostPowerOffDelay);
-    }
-    result = close(linux_cb.sock);
-    if (result == -1)
-        ALOGE("%s: fail close linux_cb.sock; errno=%d", __FUNCTION__, errno);
-
-    if (linux_cb.sock_power_control > 0 && linux_cb.sock_power_control != linux_cb.sock)
-    result = close(linux_cb.sock_power_control);
-    if (result == -1)
-        ALOGE("%s: fail close linux_cb.sock_power_control; errno=%d", __FUNCTION__, errno);
+    p_userial_transport->power(linux_cb.port, FALSE);
+    p_userial_transport->close(linux_cb.sock);
 
-    linux_cb.sock_power_control = -1;
     linux_cb.sock = -1;
 
+#if (USERIAL_DIRECT_READ == FALSE)
     close_signal_fds();
+#endif
     pthread_mutex_unlock(&close_thread_mutex);
     ALOGD("%s: exiting", __FUNCTION__);
 }
@@ -1636,7 +2323,7 @@ UDRV_API void UPIO_Set(tUPIO_TYPE type, tUPIO pio, tUPIO_STATE new_state)
                     if (isWake(new_state) && nfc_wake_delay > 0 && new_state != current_nfc_wake_state)
                     {
                         ALOGD("%s: ioctl, old state=%d, insert delay for %d ms", __func__, current_nfc_wake_state, nfc_wake_delay);
-                        setWriteDelay(nfc_wake_delay);
+                        setWriteDelay(nfc_wake_delay * 1000);
                     }
                     current_nfc_wake_state = new_state;
                 }
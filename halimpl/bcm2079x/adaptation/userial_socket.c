@@ -0,0 +1,187 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Userial transport backend for a software NFCC on the host. With
+ *  TRANSPORT_DRIVER="unix:/path" the HAL connects to a Unix domain stream
+ *  socket, with TRANSPORT_DRIVER="/dev/pts/N" it opens a pseudo terminal.
+ *  Either way the NCI packets are sent as on a UART, an HCI packet type
+ *  followed by the packet, and there is no power or wake control.
+ *
+ ******************************************************************************/
+#include "OverrideLog.h"
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "gki.h"
+#include "userial_transport.h"
+
+/*******************************************************************************
+**
+** Function         userial_socket_match
+**
+** Description      Check for a socket or pty device name
+**
+** Returns          TRUE if this backend handles the device
+**
+*******************************************************************************/
+static BOOLEAN userial_socket_match (const char *p_dev)
+{
+    return ((strncmp (p_dev, USERIAL_SOCKET_PREFIX, sizeof (USERIAL_SOCKET_PREFIX) - 1) == 0)
+          ||(strncmp (p_dev, USERIAL_PTY_PREFIX, sizeof (USERIAL_PTY_PREFIX) - 1) == 0));
+}
+
+/*******************************************************************************
+**
+** Function         userial_socket_open
+**
+** Description      Connect to the socket of the software NFCC, or open its
+**                  pty in raw mode
+**
+** Returns          file descriptor, -1 if failed
+**
+*******************************************************************************/
+static int userial_socket_open (const char *p_dev)
+{
+    struct sockaddr_un  addr;
+    struct termios      termios;
+    const char          *p_path;
+    int                 fd;
+
+    if (strncmp (p_dev, USERIAL_SOCKET_PREFIX, sizeof (USERIAL_SOCKET_PREFIX) - 1) != 0)
+    {
+        if ((fd = open (p_dev, O_RDWR | O_NOCTTY)) == -1)
+        {
+            ALOGE ("%s: unable to open %s; errno=%d", __FUNCTION__, p_dev, errno);
+            return (-1);
+        }
+
+        /* no line discipline processing of the NCI bytes */
+        if (tcgetattr (fd, &termios) == 0)
+        {
+            cfmakeraw (&termios);
+            termios.c_cc[VTIME] = 0;
+            termios.c_cc[VMIN]  = 1;
+            tcsetattr (fd, TCSANOW, &termios);
+        }
+        return (fd);
+    }
+
+    p_path = p_dev + sizeof (USERIAL_SOCKET_PREFIX) - 1;
+    if (strlen (p_path) >= sizeof (addr.sun_path))
+    {
+        ALOGE ("%s: socket path too long: %s", __FUNCTION__, p_path);
+        return (-1);
+    }
+
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) == -1)
+    {
+        ALOGE ("%s: unable to create socket; errno=%d", __FUNCTION__, errno);
+        return (-1);
+    }
+
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strcpy (addr.sun_path, p_path);
+
+    if (connect (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1)
+    {
+        ALOGE ("%s: unable to connect to %s; errno=%d", __FUNCTION__, p_path, errno);
+        close (fd);
+        return (-1);
+    }
+
+    ALOGD ("%s: connected to %s", __FUNCTION__, p_path);
+    return (fd);
+}
+
+/*******************************************************************************
+**
+** Function         userial_socket_read
+**
+** Description      Read from the software NFCC
+**
+** Returns          number of bytes read, 0 if it went away, or -1
+**
+*******************************************************************************/
+static int userial_socket_read (int fd, UINT8 *p_data, int len)
+{
+    return (read (fd, p_data, (size_t) len));
+}
+
+/*******************************************************************************
+**
+** Function         userial_socket_write
+**
+** Description      Write to the software NFCC
+**
+** Returns          number of bytes written, or -1
+**
+*******************************************************************************/
+static int userial_socket_write (int fd, const struct iovec *p_iov, int count)
+{
+    return (writev (fd, p_iov, count));
+}
+
+/*******************************************************************************
+**
+** Function         userial_socket_close
+**
+** Description      Disconnect from the software NFCC
+**
+** Returns          None
+**
+*******************************************************************************/
+static void userial_socket_close (int fd)
+{
+    if (close (fd) == -1)
+        ALOGE ("%s: fail close fd %d; errno=%d", __FUNCTION__, fd, errno);
+}
+
+/*******************************************************************************
+**
+** Function         userial_socket_power
+**
+** Description      The software NFCC is powered while it is connected, so
+**                  there is nothing to switch. It resets on CORE_RESET_CMD
+**                  like a real controller.
+**
+** Returns          None
+**
+*******************************************************************************/
+static void userial_socket_power (tUSERIAL_PORT port, BOOLEAN on)
+{
+    ALOGD ("%s: port %d power %s", __FUNCTION__, port, on ? "on" : "off");
+}
+
+const tUSERIAL_TRANSPORT userial_socket_transport =
+{
+    "socket",
+    userial_socket_match,
+    userial_socket_open,
+    userial_socket_read,
+    userial_socket_write,
+    userial_socket_close,
+    userial_socket_power,
+    TRUE
+};
@@ -41,10 +41,6 @@
     #include "bt_types.h"
 #endif
 
-/* Uncomment this line for verbose GKI debugging and buffer tracking */
-/*#define GKI_BUFFER_DEBUG   TRUE*/
-
-
 /* Error codes */
 #define GKI_SUCCESS         0x00
 #define GKI_FAILURE         0x01
@@ -106,6 +102,21 @@
 #define GKI_MAX_TIMER_QUEUES    3
 #endif
 
+/************************************************************************
+**  Timer list timing wheel: GKI_TIMER_WHEEL_LEVELS levels of
+**  GKI_TIMER_WHEEL_SLOTS slots, each level GKI_TIMER_WHEEL_SLOTS times
+**  coarser than the one below. Longer timers are re-filed as time passes.
+**/
+#ifndef GKI_TIMER_WHEEL_BITS
+#define GKI_TIMER_WHEEL_BITS    6
+#endif
+
+#ifndef GKI_TIMER_WHEEL_LEVELS
+#define GKI_TIMER_WHEEL_LEVELS  3
+#endif
+
+#define GKI_TIMER_WHEEL_SLOTS   (1 << GKI_TIMER_WHEEL_BITS)
+
 
 /************************************************************************
 **  Macro to determine the pool buffer size based on the GKI POOL ID at compile time.
@@ -341,15 +352,23 @@ typedef struct _tle
     TIMER_PARAM_TYPE   param;
     UINT16        event;
     UINT8         in_use;
+    UINT8         wheel_level;      /* GKI internal: wheel level, GKI_TIMER_WHEEL_LEVELS once expired */
+    UINT8         wheel_slot;       /* GKI internal: slot within the wheel level */
+    UINT32        expiry;           /* GKI internal: expiration time in timer list units */
 } TIMER_LIST_ENT;
 
-/* Define a timer list queue
+/* Define a timer list queue. An all-zero queue is a valid empty queue.
+** p_first is the first expired entry (ticks 0). While entries are queued
+** but none has expired, it points to a placeholder whose ticks are non-zero.
 */
 typedef struct
 {
     TIMER_LIST_ENT   *p_first;
     TIMER_LIST_ENT   *p_last;
-    INT32             last_ticks;
+    UINT32            now;          /* timer list units elapsed so far */
+    UINT16            num_pending;  /* entries in the wheel */
+    UINT16            num_expired;  /* expired entries, from p_first to p_last */
+    TIMER_LIST_ENT   *wheel[GKI_TIMER_WHEEL_LEVELS][GKI_TIMER_WHEEL_SLOTS];
 } TIMER_LIST_Q;
 
 
@@ -371,6 +390,19 @@ typedef struct
 typedef void (*TASKPTR)(UINT32);
 #endif
 
+/* Task scheduling policies. The values are those of the Linux policies */
+#define GKI_SCHED_OTHER         0       /* time-shared */
+#define GKI_SCHED_FIFO          1       /* real-time, first in first out */
+#define GKI_SCHED_RR            2       /* real-time, round robin */
+#define GKI_SCHED_DEFAULT       0xFF    /* GKI's own choice, by task id */
+
+typedef struct
+{
+    UINT8   policy;                 /* GKI_SCHED_xxx */
+    UINT8   priority;               /* real-time priority (GKI_SCHED_FIFO or GKI_SCHED_RR) */
+    UINT32  cpu_mask;               /* CPUs the task may run on (bit n = CPU n); 0 for any */
+} tGKI_TASK_SCHED;
+
 
 #define GKI_PUBLIC_POOL         0       /* General pool accessible to GKI_getbuf() */
 #define GKI_RESTRICTED_POOL     1       /* Inaccessible pool to GKI_getbuf() */
@@ -407,8 +439,13 @@ GKI_API extern void GKI_shiftup (UINT8 *p_dest, UINT8 *p_src, UINT32 len);
 GKI_API extern UINT8   GKI_isend_event (UINT8, UINT16);
 GKI_API extern void    GKI_isend_msg (UINT8, UINT8, void *);
 GKI_API extern void   *GKI_read_mbox  (UINT8);
+GKI_API extern UINT16  GKI_read_mbox_batch (UINT8, BUFFER_Q *);
 GKI_API extern void    GKI_send_msg   (UINT8, UINT8, void *);
 GKI_API extern UINT8   GKI_send_event (UINT8, UINT16);
+#if (GKI_WAIT_EVENTFD == TRUE)
+GKI_API extern UINT8   GKI_register_fd (UINT8, int, UINT16);
+GKI_API extern UINT8   GKI_deregister_fd (UINT8, int);
+#endif
 
 
 /* To get and release buffers, change owner and get size
@@ -418,20 +455,22 @@ GKI_API extern UINT8   GKI_create_pool (UINT16, UINT16, UINT8, void *);
 GKI_API extern void    GKI_delete_pool (UINT8);
 GKI_API extern void   *GKI_find_buf_start (void *);
 GKI_API extern void    GKI_freebuf (void *);
-#if GKI_BUFFER_DEBUG
-#define GKI_getbuf(size)    GKI_getbuf_debug(size, __FUNCTION__, __LINE__)
-GKI_API extern void   *GKI_getbuf_debug (UINT16, const char *, int);
+#if (GKI_BUF_TRACKER == TRUE)
+/* Each call site registers itself once and then passes its one byte site id */
+#define GKI_BUF_SITE()      ({ static UINT8 _gki_site; _gki_site ? _gki_site : (_gki_site = GKI_register_buf_site (__FUNCTION__, __LINE__)); })
+#define GKI_getbuf(size)    GKI_getbuf_site(size, GKI_BUF_SITE())
+#define GKI_getpoolbuf(id)  GKI_getpoolbuf_site(id, GKI_BUF_SITE())
+GKI_API extern void   *GKI_getbuf_site (UINT16, UINT8);
+GKI_API extern void   *GKI_getpoolbuf_site (UINT8, UINT8);
+GKI_API extern UINT8   GKI_register_buf_site (const char *, int);
+GKI_API extern void    GKI_buf_site_dump (void);
 #else
 GKI_API extern void   *GKI_getbuf (UINT16);
-#endif
-GKI_API extern UINT16  GKI_get_buf_size (void *);
-#if GKI_BUFFER_DEBUG
-#define GKI_getpoolbuf(id)    GKI_getpoolbuf_debug(id, __FUNCTION__, __LINE__)
-GKI_API extern void   *GKI_getpoolbuf_debug (UINT8, const char *, int);
-#else
 GKI_API extern void   *GKI_getpoolbuf (UINT8);
 #endif
+GKI_API extern UINT16  GKI_get_buf_size (void *);
 
+GKI_API extern void   *GKI_igetpoolbuf (UINT8);
 GKI_API extern UINT16  GKI_poolcount (UINT8);
 GKI_API extern UINT16  GKI_poolfreecount (UINT8);
 GKI_API extern UINT16  GKI_poolutilization (UINT8);
@@ -439,9 +478,22 @@ GKI_API extern void    GKI_register_mempool (void *p_mem);
 GKI_API extern UINT8   GKI_set_pool_permission(UINT8, UINT8);
 
 
+/* Task scheduling (see GKI_set_task_sched)
+*/
+GKI_API extern UINT8   GKI_set_task_sched (UINT8, tGKI_TASK_SCHED *);
+GKI_API extern UINT8   GKI_get_task_sched (UINT8, tGKI_TASK_SCHED *);
+
+
+/* Buffer chains (a buffer followed by linked segments)
+*/
+GKI_API extern void    GKI_chain_buf (void *, void *);
+GKI_API extern void   *GKI_get_next_seg (void *);
+GKI_API extern void   *GKI_unchain_buf (void *);
+
 /* User buffer queue management
 */
 GKI_API extern void   *GKI_dequeue  (BUFFER_Q *);
+GKI_API extern void   *GKI_dequeue_batch (BUFFER_Q *);
 GKI_API extern void    GKI_enqueue (BUFFER_Q *, void *);
 GKI_API extern void    GKI_enqueue_head (BUFFER_Q *, void *);
 GKI_API extern void   *GKI_getfirst (BUFFER_Q *);
@@ -25,6 +25,18 @@
 #define GKI_DEBUG	FALSE
 #endif
 
+#ifndef GKI_TASK_BUF_CACHE
+#define GKI_TASK_BUF_CACHE  FALSE
+#endif
+
+#ifndef GKI_TICKLESS_TIMER
+#define GKI_TICKLESS_TIMER  FALSE
+#endif
+
+#ifndef GKI_ELASTIC_POOLS
+#define GKI_ELASTIC_POOLS   FALSE
+#endif
+
 /* Task States: (For OSRdyTbl) */
 #define TASK_DEAD       0   /* b0000 */
 #define TASK_READY      1   /* b0001 */
@@ -63,18 +75,11 @@
 typedef struct _buffer_hdr
 {
     struct _buffer_hdr *p_next;   /* next buffer in the queue */
+    struct _buffer_hdr *p_seg;    /* next segment of a buffer chain */
     UINT8   q_id;                 /* id of the queue */
     UINT8   task_id;              /* task which allocated the buffer*/
     UINT8   status;               /* FREE, UNLINKED or QUEUED */
-    UINT8   Type;
-
-#if GKI_BUFFER_DEBUG
-    /* for tracking who allocated the buffer */
-    #define _GKI_MAX_FUNCTION_NAME_LEN   (50)
-    char    _function[_GKI_MAX_FUNCTION_NAME_LEN+1];
-    int     _line;
-#endif
-
+    UINT8   site;                 /* allocating call site (GKI_BUF_TRACKER), 0 if untracked */
 } BUFFER_HDR_T;
 
 typedef struct _free_queue
@@ -85,8 +90,45 @@ typedef struct _free_queue
     UINT16          total;         /* toatal number of buffers */
     UINT16          cur_cnt;       /* number of  buffers currently allocated */
     UINT16          max_cnt;       /* maximum number of buffers allocated at any time */
+    UINT16          cache_cnt;     /* number of free buffers held in task caches */
 } FREE_QUEUE_T;
 
+/* Per-task cache of free buffers. Only the owning task touches it, so buffers
+** can be taken from and returned to it without GKI_disable(). It is refilled
+** from and drained to the pool free queue in batches.
+*/
+typedef struct _buf_cache
+{
+    BUFFER_HDR_T *p_first;      /* first buffer in the cache */
+    UINT16        count;        /* number of buffers in the cache */
+} BUF_CACHE_T;
+
+/* Extra buffers added to an exhausted fixed pool. Slab buffers are kept on the
+** slab's own free list, never in the pool free queue or task caches, so a slab
+** whose buffers are all free can be given back to the OS.
+*/
+typedef struct _buf_slab
+{
+    UINT8        *p_start;      /* slab memory, NULL if the slot is unused */
+    UINT8        *p_end;
+    BUFFER_HDR_T *p_free;       /* free buffers of the slab */
+    UINT16        free_cnt;     /* number of free buffers */
+    UINT32        idle_since;   /* OSTicks when the slab last became completely free */
+} BUF_SLAB_T;
+
+#if (GKI_BUF_TRACKER == TRUE)
+/* Buffer usage of one GKI_getbuf()/GKI_getpoolbuf() call site
+*/
+typedef struct _buf_site
+{
+    const char   *p_func;       /* function of the call site, NULL if the slot is unused */
+    UINT16        line;         /* line of the call site */
+    UINT16        live;         /* buffers currently allocated by the site */
+    UINT16        max_live;     /* high-water mark of live */
+    UINT32        allocs;       /* total number of allocations */
+} BUF_SITE_T;
+#endif
+
 
 /* Buffer related defines
 */
@@ -96,6 +138,13 @@ typedef struct _free_queue
 #define MAX_USER_BUF_SIZE   ((UINT16)0xffff - BUFFER_PADDING_SIZE)  /* pool size must allow for header */
 #define MAGIC_NO            0xDDBADDBA
 
+/* TRUE if the mailbox of a task has messages waiting to be read */
+#define GKI_MBOX_PENDING(task_id, mbox) \
+    ((gki_cb.com.OSTaskQFirst[task_id][mbox] != NULL) || (gki_cb.com.OSTaskQIn[task_id][mbox] != NULL))
+
+/* Number of size buckets in the GKI_getbuf pool lookup table */
+#define GKI_POOL_SIZE_LUT_ENTRIES   64
+
 #define BUF_STATUS_FREE     0
 #define BUF_STATUS_UNLINKED 1
 #define BUF_STATUS_QUEUED   2
@@ -307,8 +356,12 @@ typedef struct
 
     /* Buffer related variables
     */
-    BUFFER_HDR_T    *OSTaskQFirst[GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the first event in the task mailbox */
-    BUFFER_HDR_T    *OSTaskQLast [GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the last event in the task mailbox */
+    /* Each mailbox is a lock-free multi-producer/single-consumer queue: senders push
+    ** onto OSTaskQIn with compare-and-swap, and the owning task moves the whole
+    ** chain, in arrival order, to its private OSTaskQFirst list when that runs dry.
+    */
+    BUFFER_HDR_T    *OSTaskQFirst[GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the first event in the task mailbox (reader only) */
+    BUFFER_HDR_T    *OSTaskQIn   [GKI_MAX_TASKS][NUM_TASK_MBOX]; /* array of pointers to the last event sent to the task mailbox (newest first) */
 
     /* Define the buffer pool management variables
     */
@@ -318,6 +371,25 @@ typedef struct
     UINT16   pool_max_count[GKI_NUM_TOTAL_BUF_POOLS];
     UINT16   pool_additions[GKI_NUM_TOTAL_BUF_POOLS];
 
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    /* Per-task free buffer caches, fixed pools only (dynamic pools may be deleted) */
+    BUF_CACHE_T buf_cache[GKI_MAX_TASKS][GKI_NUM_FIXED_BUF_POOLS];
+    UINT16      buf_cache_batch[GKI_NUM_TOTAL_BUF_POOLS];   /* refill/drain batch, 0 if pool is not cached */
+#endif
+
+#if (GKI_ELASTIC_POOLS == TRUE)
+    /* Slabs grown on demand by the fixed pools; freeq[].total includes their buffers */
+    BUF_SLAB_T  pool_slab[GKI_NUM_FIXED_BUF_POOLS][GKI_ELASTIC_MAX_SLABS];
+    UINT16      pool_slab_bufs[GKI_NUM_FIXED_BUF_POOLS];    /* number of buffers per slab */
+    UINT8       pool_num_slabs[GKI_NUM_FIXED_BUF_POOLS];    /* number of slabs currently added */
+#endif
+
+#if (GKI_BUF_TRACKER == TRUE)
+    /* Buffer usage per allocation call site, indexed by BUFFER_HDR_T.site */
+    BUF_SITE_T  buf_site[GKI_BUF_TRACKER_MAX_SITES];
+    UINT16      num_buf_sites;                      /* number of sites registered so far, including site 0 */
+#endif
+
     /* Define the buffer pool start addresses
     */
     UINT8   *pool_start[GKI_NUM_TOTAL_BUF_POOLS];   /* array of pointers to the start of each buffer pool */
@@ -330,6 +402,12 @@ typedef struct
     UINT8       pool_list[GKI_NUM_TOTAL_BUF_POOLS]; /* buffer pools arranged in the order of size */
     UINT8       curr_total_no_of_pools;             /* number of fixed buf pools + current number of dynamic pools */
 
+    /* GKI_getbuf pool lookup, rebuilt whenever the pool list or permissions change */
+    UINT8       pool_size_lut[GKI_POOL_SIZE_LUT_ENTRIES]; /* pool_list index of first pool that may fit each size bucket */
+    UINT8       pool_size_lut_shift;                /* size bucket = (size - 1) >> pool_size_lut_shift */
+    UINT16      pool_size_max;                      /* largest buffer size of any pool in pool_list */
+    UINT16      pool_public_list_mask;              /* bit i set if pool_list[i] is a public pool */
+
     BOOLEAN     timer_nesting;                      /* flag to prevent timer interrupt nesting */
 
     /* Time queue arrays */
@@ -355,8 +433,19 @@ extern "C" {
 GKI_API extern BOOLEAN   gki_chk_buf_damage(void *);
 extern BOOLEAN   gki_chk_buf_owner(void *);
 extern void      gki_buffer_init (void);
+extern void      gki_buffer_flush_task_cache (UINT8);
+#if (GKI_ELASTIC_POOLS == TRUE)
+extern void      gki_buffer_reclaim_slabs (BOOLEAN);
+extern void      gki_buffer_free_slabs (void);
+#endif
 extern void      gki_timers_init(void);
 extern void      gki_adjust_timer_count (INT32);
+#if (GKI_TICKLESS_TIMER == TRUE)
+/* OS specific, for the tickless timer thread */
+extern UINT32    gki_timer_pending_ticks (void);
+extern UINT32    gki_timer_tick_count (void);
+extern void      gki_timer_rearm (void);
+#endif
 
 extern void    OSStartRdy(void);
 extern void	   OSCtxSw(void);
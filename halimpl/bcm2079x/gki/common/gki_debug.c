@@ -52,20 +52,20 @@ void GKI_PrintBufferUsage(UINT8 *p_num_pools, UINT16 *p_cur_used)
     GKI_TRACE_0("");
     GKI_TRACE_0("--- GKI Buffer Pool Summary (R - restricted, P - public) ---");
 
-    GKI_TRACE_0("POOL     SIZE  USED  MAXU  TOTAL");
-    GKI_TRACE_0("------------------------------");
+    GKI_TRACE_0("POOL     SIZE  USED  MAXU  CACHED  TOTAL");
+    GKI_TRACE_0("--------------------------------------");
     for (i = 0; i < gki_cb.com.curr_total_no_of_pools; i++)
     {
         p = &gki_cb.com.freeq[i];
         if ((1 << i) & gki_cb.com.pool_access_mask)
         {
-            GKI_TRACE_5("%02d: (R), %4d, %3d, %3d, %3d",
-                        i, p->size, p->cur_cnt, p->max_cnt, p->total);
+            GKI_TRACE_6("%02d: (R), %4d, %3d, %3d, %5d, %3d",
+                        i, p->size, p->cur_cnt, p->max_cnt, p->cache_cnt, p->total);
         }
         else
         {
-            GKI_TRACE_5("%02d: (P), %4d, %3d, %3d, %3d",
-                        i, p->size, p->cur_cnt, p->max_cnt, p->total);
+            GKI_TRACE_6("%02d: (P), %4d, %3d, %3d, %5d, %3d",
+                        i, p->size, p->cur_cnt, p->max_cnt, p->cache_cnt, p->total);
         }
         cur[i] = p->cur_cnt;
     }
@@ -15,6 +15,7 @@
  *  limitations under the License.
  *
  ******************************************************************************/
+#include <string.h>
 #include "gki_int.h"
 
 #ifndef BT_ERROR_TRACE_0
@@ -31,6 +32,26 @@
 #define GKI_UNUSED_LIST_ENTRY   (0x80000000L)   /* Marks an unused timer list entry (initial value) */
 #define GKI_MAX_INT32           (0x7fffffffL)
 
+#define GKI_TIMER_WHEEL_MASK    (GKI_TIMER_WHEEL_SLOTS - 1)
+#define GKI_TIMER_WHEEL_RANGE   (1UL << (GKI_TIMER_WHEEL_BITS * GKI_TIMER_WHEEL_LEVELS))
+
+/* p_first of a timer list holding only unexpired entries. Its ticks are never '0', so
+** the "while (p_first && !p_first->ticks)" expiry loops of the timer list users stop on it.
+*/
+static TIMER_LIST_ENT gki_timer_list_running =
+{
+    NULL,           /* p_next */
+    NULL,           /* p_prev */
+    NULL,           /* p_cback */
+    GKI_MAX_INT32,  /* ticks */
+    0,              /* param */
+    0,              /* event */
+    0,              /* in_use */
+    0,              /* wheel_level */
+    0,              /* wheel_slot */
+    0               /* expiry */
+};
+
 /*******************************************************************************
 **
 ** Function         gki_timers_init
@@ -147,7 +168,12 @@ BOOLEAN gki_timers_is_timer_running(void)
 *******************************************************************************/
 UINT32  GKI_get_tick_count(void)
 {
+#if (GKI_TICKLESS_TIMER == TRUE)
+    /* OSTicks is only advanced when the timer thread wakes up */
+    return gki_timer_tick_count ();
+#else
     return gki_cb.com.OSTicks;
+#endif
 }
 
 
@@ -236,6 +262,14 @@ void GKI_start_timer (UINT8 tnum, INT32 ticks, BOOLEAN is_continuous)
         }
 #endif
     }
+
+#if (GKI_TICKLESS_TIMER == TRUE)
+    /* The timer thread has not credited the ticks elapsed since it last woke
+    ** up; count the new timer from that update rather than from now */
+    orig_ticks += (INT32) gki_timer_pending_ticks ();
+    ticks = orig_ticks;
+#endif
+
     /* Add the time since the last task timer update.
     ** Note that this works when no timers are active since
     ** both OSNumOrigTicks and OSTicksTilExp are 0.
@@ -356,6 +390,9 @@ void GKI_stop_timer (UINT8 tnum)
 #else
             gki_cb.com.system_tick_running = FALSE;
             gki_cb.com.p_tick_cb(FALSE); /* stop system tick */
+#if (GKI_ELASTIC_POOLS == TRUE)
+            gki_buffer_reclaim_slabs (TRUE);    /* going idle, give back the free slabs */
+#endif
 #endif
         }
     }
@@ -414,6 +451,11 @@ void GKI_timer_update (INT32 ticks_since_last_update)
                 gki_cb.com.system_tick_running = FALSE;
                 (gki_cb.com.p_tick_cb) (FALSE); /* stop system tick */
             }
+#if (GKI_ELASTIC_POOLS == TRUE)
+            GKI_disable();
+            gki_buffer_reclaim_slabs (TRUE);    /* going idle, give back the free slabs */
+            GKI_enable();
+#endif
             gki_cb.com.OSTicksTilStop = 0;      /* clear inactivity delay timer */
             gki_cb.com.timer_nesting = 0;
             return;
@@ -566,6 +608,10 @@ void GKI_timer_update (INT32 ticks_since_last_update)
 
     gki_cb.com.timer_nesting = 0;
 
+#if (GKI_ELASTIC_POOLS == TRUE)
+    gki_buffer_reclaim_slabs (FALSE);
+#endif
+
     GKI_enable();
 
     return;
@@ -631,9 +677,7 @@ void GKI_timer_queue_register_callback (SYSTEM_TICK_CBACK *p_callback)
 *******************************************************************************/
 void GKI_init_timer_list (TIMER_LIST_Q *p_timer_listq)
 {
-    p_timer_listq->p_first    = NULL;
-    p_timer_listq->p_last     = NULL;
-    p_timer_listq->last_ticks = 0;
+    memset (p_timer_listq, 0, sizeof (TIMER_LIST_Q));
 
     return;
 }
@@ -659,6 +703,118 @@ void GKI_init_timer_list_entry (TIMER_LIST_ENT  *p_tle)
     p_tle->in_use  = FALSE;
 }
 
+/*******************************************************************************
+**
+** Function         gki_timer_list_set_first
+**
+** Description      Internal function to point p_first at the placeholder entry
+**                  or NULL when no entry of a timer list has expired.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_list_set_first (TIMER_LIST_Q *p_timer_listq)
+{
+    if (p_timer_listq->num_expired == 0)
+    {
+        p_timer_listq->p_first = (p_timer_listq->num_pending) ? &gki_timer_list_running : NULL;
+        p_timer_listq->p_last  = NULL;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_wheel_insert
+**
+** Description      Internal function to file a timer list entry in the wheel
+**                  slot matching its expiration time.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_wheel_insert (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT *p_tle)
+{
+    UINT32  delta = p_tle->expiry - p_timer_listq->now;
+    UINT32  when  = p_tle->expiry;
+    UINT8   level = 0;
+
+    /* Beyond the wheel: park in the furthest slot, it is re-filed when that slot cascades */
+    if (delta >= GKI_TIMER_WHEEL_RANGE)
+    {
+        delta = GKI_TIMER_WHEEL_RANGE - 1;
+        when  = p_timer_listq->now + delta;
+    }
+
+    while (delta >= ((UINT32) GKI_TIMER_WHEEL_SLOTS << (GKI_TIMER_WHEEL_BITS * level)))
+        level++;
+
+    p_tle->wheel_level = level;
+    p_tle->wheel_slot  = (UINT8) ((when >> (GKI_TIMER_WHEEL_BITS * level)) & GKI_TIMER_WHEEL_MASK);
+
+    p_tle->p_prev = NULL;
+    p_tle->p_next = p_timer_listq->wheel[level][p_tle->wheel_slot];
+    if (p_tle->p_next)
+        p_tle->p_next->p_prev = p_tle;
+    p_timer_listq->wheel[level][p_tle->wheel_slot] = p_tle;
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_list_expire
+**
+** Description      Internal function to mark a timer list entry expired and
+**                  append it to the expired entries of the list.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_list_expire (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT *p_tle)
+{
+    /* We set the number of ticks to '0' so that the legacy code
+     * that assumes a '0' or nonzero value will still work as coded. */
+    p_tle->ticks       = 0;
+    p_tle->wheel_level = GKI_TIMER_WHEEL_LEVELS;
+    p_tle->p_next      = NULL;
+
+    if (p_timer_listq->num_expired)
+    {
+        p_tle->p_prev = p_timer_listq->p_last;
+        p_timer_listq->p_last->p_next = p_tle;
+    }
+    else
+    {
+        p_tle->p_prev = NULL;
+        p_timer_listq->p_first = p_tle;
+    }
+
+    p_timer_listq->p_last = p_tle;
+    p_timer_listq->num_expired++;
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_queue_set_active
+**
+** Description      Internal function to add a timer list to, or remove it from,
+**                  the array of non-empty timer lists.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_queue_set_active (TIMER_LIST_Q *p_timer_listq, BOOLEAN active)
+{
+    UINT8 tt;
+
+    for (tt = 0; tt < GKI_MAX_TIMER_QUEUES; tt++)
+    {
+        if (gki_cb.com.timer_queues[tt] == (active ? NULL : p_timer_listq))
+        {
+            gki_cb.com.timer_queues[tt] = (active ? p_timer_listq : NULL);
+            break;
+        }
+    }
+}
+
 
 /*******************************************************************************
 **
@@ -668,6 +824,9 @@ void GKI_init_timer_list_entry (TIMER_LIST_ENT  *p_tle)
 **                  want to update a timer list. This should be at every
 **                  timer list unit tick, e.g. once per sec, once per minute etc.
 **
+**                  Timers are kept in a timing wheel, so the cost does not
+**                  depend on the number of running timers.
+**
 ** Parameters       p_timer_listq   - (input) pointer to the timer list queue object
 **                  num_units_since_last_update - (input) number of units since the last update
 **                                  (allows for variable unit update)
@@ -681,55 +840,54 @@ void GKI_init_timer_list_entry (TIMER_LIST_ENT  *p_tle)
 UINT16 GKI_update_timer_list (TIMER_LIST_Q *p_timer_listq, INT32 num_units_since_last_update)
 {
     TIMER_LIST_ENT  *p_tle;
-    UINT16           num_time_out = 0;
-    INT32            rem_ticks;
-    INT32            temp_ticks;
+    TIMER_LIST_ENT  *p_next;
+    UINT32           now;
+    UINT8            level;
+    UINT8            slot;
 
-    p_tle = p_timer_listq->p_first;
-
-    /* First, get the guys who have previously timed out */
-    /* Note that the tick value of the timers should always be '0' */
-    while ((p_tle) && (p_tle->ticks <= 0))
+    while ((num_units_since_last_update > 0) && (p_timer_listq->num_pending))
     {
-        num_time_out++;
-        p_tle = p_tle->p_next;
-    }
+        num_units_since_last_update--;
+        now = ++p_timer_listq->now;
 
-    /* Timer entriy tick values are relative to the preceeding entry */
-    rem_ticks = num_units_since_last_update;
-
-    /* Now, adjust remaining timer entries */
-    while ((p_tle != NULL) && (rem_ticks > 0))
-    {
-        temp_ticks = p_tle->ticks;
-        p_tle->ticks -= rem_ticks;
-
-        /* See if this timer has just timed out */
-        if (p_tle->ticks <= 0)
+        /* Each time a level wraps, re-file the entries of the next slot of the level above */
+        for (level = 1; level < GKI_TIMER_WHEEL_LEVELS; level++)
         {
-            /* We set the number of ticks to '0' so that the legacy code
-             * that assumes a '0' or nonzero value will still work as coded. */
-            p_tle->ticks = 0;
+            if (now & ((1UL << (GKI_TIMER_WHEEL_BITS * level)) - 1))
+                break;
+
+            slot  = (UINT8) ((now >> (GKI_TIMER_WHEEL_BITS * level)) & GKI_TIMER_WHEEL_MASK);
+            p_tle = p_timer_listq->wheel[level][slot];
+            p_timer_listq->wheel[level][slot] = NULL;
 
-            num_time_out++;
+            while (p_tle)
+            {
+                p_next = p_tle->p_next;
+                gki_timer_wheel_insert (p_timer_listq, p_tle);
+                p_tle = p_next;
+            }
         }
 
-        rem_ticks -= temp_ticks;  /* Decrement the remaining ticks to process */
-        p_tle = p_tle->p_next;
+        /* Everything in the current slot of the first level expires now */
+        slot  = (UINT8) (now & GKI_TIMER_WHEEL_MASK);
+        p_tle = p_timer_listq->wheel[0][slot];
+        p_timer_listq->wheel[0][slot] = NULL;
+
+        while (p_tle)
+        {
+            p_next = p_tle->p_next;
+            p_timer_listq->num_pending--;
+            gki_timer_list_expire (p_timer_listq, p_tle);
+            p_tle = p_next;
+        }
     }
 
-    if (p_timer_listq->last_ticks > 0)
-    {
-        p_timer_listq->last_ticks -= num_units_since_last_update;
+    /* Nothing left in the wheel, just keep the time */
+    p_timer_listq->now += num_units_since_last_update;
 
-        /* If the last timer has expired set last_ticks to 0 so that other list update
-        * functions will calculate correctly
-        */
-        if (p_timer_listq->last_ticks < 0)
-            p_timer_listq->last_ticks = 0;
-    }
+    gki_timer_list_set_first (p_timer_listq);
 
-    return (num_time_out);
+    return (p_timer_listq->num_expired);
 }
 
 /*******************************************************************************
@@ -748,30 +906,13 @@ UINT16 GKI_update_timer_list (TIMER_LIST_Q *p_timer_listq, INT32 num_units_since
 *******************************************************************************/
 UINT32 GKI_get_remaining_ticks (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_target_tle)
 {
-    TIMER_LIST_ENT  *p_tle;
     UINT32           rem_ticks = 0;
 
     if (p_target_tle->in_use)
     {
-        p_tle = p_timer_listq->p_first;
-
-        /* adding up all of ticks in previous entries */
-        while ((p_tle)&&(p_tle != p_target_tle))
-        {
-            rem_ticks += p_tle->ticks;
-            p_tle = p_tle->p_next;
-        }
-
-        /* if found target entry */
-        if (p_tle == p_target_tle)
-        {
-            rem_ticks += p_tle->ticks;
-        }
-        else
-        {
-            BT_ERROR_TRACE_0(TRACE_LAYER_GKI, "GKI_get_remaining_ticks: No timer entry in the list");
-            return(0);
-        }
+        /* expired entries have no ticks left */
+        if (p_target_tle->wheel_level < GKI_TIMER_WHEEL_LEVELS)
+            rem_ticks = p_target_tle->expiry - p_timer_listq->now;
     }
     else
     {
@@ -799,9 +940,8 @@ UINT32 GKI_get_remaining_ticks (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_
 *******************************************************************************/
 void GKI_add_to_timer_list (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_tle)
 {
-    UINT32           nr_ticks_total;
-    UINT8 tt;
-    TIMER_LIST_ENT  *p_temp;
+    BOOLEAN          was_empty;
+
     if (p_tle == NULL || p_timer_listq == NULL) {
         GKI_TRACE_3("%s: invalid argument %x, %x****************************<<", __func__, p_timer_listq, p_tle);
         return;
@@ -811,76 +951,25 @@ void GKI_add_to_timer_list (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_tle)
     /* Only process valid tick values */
     if (p_tle->ticks >= 0)
     {
-        /* If this entry is the last in the list */
-        if (p_tle->ticks >= p_timer_listq->last_ticks)
-        {
-            /* If this entry is the only entry in the list */
-            if (p_timer_listq->p_first == NULL)
-                p_timer_listq->p_first = p_tle;
-            else
-            {
-                /* Insert the entry onto the end of the list */
-                if (p_timer_listq->p_last != NULL)
-                    p_timer_listq->p_last->p_next = p_tle;
-
-                p_tle->p_prev = p_timer_listq->p_last;
-            }
+        was_empty = (p_timer_listq->num_pending == 0) && (p_timer_listq->num_expired == 0);
 
-            p_tle->p_next = NULL;
-            p_timer_listq->p_last = p_tle;
-            nr_ticks_total = p_tle->ticks;
-            p_tle->ticks -= p_timer_listq->last_ticks;
-
-            p_timer_listq->last_ticks = nr_ticks_total;
+        if (p_tle->ticks == 0)
+        {
+            gki_timer_list_expire (p_timer_listq, p_tle);
         }
-        else    /* This entry needs to be inserted before the last entry */
+        else
         {
-            /* Find the entry that the new one needs to be inserted in front of */
-            p_temp = p_timer_listq->p_first;
-            while (p_tle->ticks > p_temp->ticks)
-            {
-                /* Update the tick value if looking at an unexpired entry */
-                if (p_temp->ticks > 0)
-                    p_tle->ticks -= p_temp->ticks;
-
-                p_temp = p_temp->p_next;
-            }
-
-            /* The new entry is the first in the list */
-            if (p_temp == p_timer_listq->p_first)
-            {
-                p_tle->p_next = p_timer_listq->p_first;
-                p_timer_listq->p_first->p_prev = p_tle;
-                p_timer_listq->p_first = p_tle;
-            }
-            else
-            {
-                p_temp->p_prev->p_next = p_tle;
-                p_tle->p_prev = p_temp->p_prev;
-                p_temp->p_prev = p_tle;
-                p_tle->p_next = p_temp;
-            }
-            p_temp->ticks -= p_tle->ticks;
+            p_tle->expiry = p_timer_listq->now + (UINT32) p_tle->ticks;
+            gki_timer_wheel_insert (p_timer_listq, p_tle);
+            p_timer_listq->num_pending++;
         }
 
         p_tle->in_use = TRUE;
+        gki_timer_list_set_first (p_timer_listq);
 
-        /* if we already add this timer queue to the array */
-        for (tt = 0; tt < GKI_MAX_TIMER_QUEUES; tt++)
-        {
-             if (gki_cb.com.timer_queues[tt] == p_timer_listq)
-                 return;
-        }
         /* add this timer queue to the array */
-        for (tt = 0; tt < GKI_MAX_TIMER_QUEUES; tt++)
-        {
-             if (gki_cb.com.timer_queues[tt] == NULL)
-                 break;
-        }
-        if (tt < GKI_MAX_TIMER_QUEUES)
-        {
-            gki_cb.com.timer_queues[tt] = p_timer_listq;
-        }
+        if (was_empty)
+            gki_timer_queue_set_active (p_timer_listq, TRUE);
     }
 
     return;
@@ -902,83 +991,50 @@ void GKI_add_to_timer_list (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_tle)
 *******************************************************************************/
 void GKI_remove_from_timer_list (TIMER_LIST_Q *p_timer_listq, TIMER_LIST_ENT  *p_tle)
 {
-    UINT8 tt;
-
     /* Verify that the entry is valid */
     if (p_tle == NULL || p_tle->in_use == FALSE || p_timer_listq->p_first == NULL)
     {
         return;
     }
 
-    /* Add the ticks remaining in this timer (if any) to the next guy in the list.
-    ** Note: Expired timers have a tick value of '0'.
-    */
-    if (p_tle->p_next != NULL)
+    if (p_tle->wheel_level < GKI_TIMER_WHEEL_LEVELS)
     {
-        p_tle->p_next->ticks += p_tle->ticks;
-    }
-    else
-    {
-        p_timer_listq->last_ticks -= p_tle->ticks;
-    }
-
-    /* Unlink timer from the list.
-    */
-    if (p_timer_listq->p_first == p_tle)
-    {
-        p_timer_listq->p_first = p_tle->p_next;
+        /* Unlink timer from its wheel slot */
+        if (p_tle->p_prev != NULL)
+            p_tle->p_prev->p_next = p_tle->p_next;
+        else
+            p_timer_listq->wheel[p_tle->wheel_level][p_tle->wheel_slot] = p_tle->p_next;
 
-        if (p_timer_listq->p_first != NULL)
-            p_timer_listq->p_first->p_prev = NULL;
+        if (p_tle->p_next != NULL)
+            p_tle->p_next->p_prev = p_tle->p_prev;
 
-        if (p_timer_listq->p_last == p_tle)
-            p_timer_listq->p_last = NULL;
+        p_timer_listq->num_pending--;
     }
     else
     {
-        if (p_timer_listq->p_last == p_tle)
-        {
-            p_timer_listq->p_last = p_tle->p_prev;
+        /* Unlink timer from the expired entries */
+        if (p_tle->p_prev != NULL)
+            p_tle->p_prev->p_next = p_tle->p_next;
+        else
+            p_timer_listq->p_first = p_tle->p_next;
 
-            if (p_timer_listq->p_last != NULL)
-                p_timer_listq->p_last->p_next = NULL;
-        }
+        if (p_tle->p_next != NULL)
+            p_tle->p_next->p_prev = p_tle->p_prev;
         else
-        {
-            if (p_tle->p_next != NULL && p_tle->p_next->p_prev == p_tle)
-                p_tle->p_next->p_prev = p_tle->p_prev;
-            else
-            {
-                /* Error case - chain messed up ?? */
-                return;
-            }
+            p_timer_listq->p_last = p_tle->p_prev;
 
-            if (p_tle->p_prev != NULL && p_tle->p_prev->p_next == p_tle)
-                p_tle->p_prev->p_next = p_tle->p_next;
-            else
-            {
-                /* Error case - chain messed up ?? */
-                return;
-            }
-        }
+        p_timer_listq->num_expired--;
     }
 
     p_tle->p_next = p_tle->p_prev = NULL;
     p_tle->ticks = GKI_UNUSED_LIST_ENTRY;
     p_tle->in_use = FALSE;
 
+    gki_timer_list_set_first (p_timer_listq);
+
     /* if timer queue is empty */
-    if (p_timer_listq->p_first == NULL && p_timer_listq->p_last == NULL)
-    {
-        for (tt = 0; tt < GKI_MAX_TIMER_QUEUES; tt++)
-        {
-            if (gki_cb.com.timer_queues[tt] == p_timer_listq)
-            {
-                gki_cb.com.timer_queues[tt] = NULL;
-                break;
-            }
-        }
-    }
+    if (p_timer_listq->p_first == NULL)
+        gki_timer_queue_set_active (p_timer_listq, FALSE);
 
     return;
 }
@@ -1010,6 +1066,11 @@ void gki_adjust_timer_count (INT32 ticks)
         {
             gki_cb.com.OSNumOrigTicks = (gki_cb.com.OSNumOrigTicks - gki_cb.com.OSTicksTilExp) + ticks;
             gki_cb.com.OSTicksTilExp = ticks;
+
+#if (GKI_TICKLESS_TIMER == TRUE)
+            /* The timer thread may be asleep until a later expiration */
+            gki_timer_rearm ();
+#endif
         }
     }
 
@@ -32,14 +32,26 @@ typedef struct
 {
     pthread_mutex_t     GKI_mutex;
     pthread_t           thread_id[GKI_MAX_TASKS];
+    pid_t               thread_tid[GKI_MAX_TASKS];      /* kernel thread id, for CPU affinity */
+    tGKI_TASK_SCHED     task_sched[GKI_MAX_TASKS];      /* scheduling set by GKI_set_task_sched() */
     pthread_mutex_t     thread_evt_mutex[GKI_MAX_TASKS];
     pthread_cond_t      thread_evt_cond[GKI_MAX_TASKS];
+#if (GKI_WAIT_EVENTFD == TRUE)
+    int                 thread_evt_fd[GKI_MAX_TASKS];       /* eventfd GKI_wait() polls on, -1 if none */
+    BOOLEAN             thread_evt_polling[GKI_MAX_TASKS];  /* task is blocked in poll() */
+    int                 task_fd[GKI_MAX_TASKS][GKI_MAX_TASK_FDS];       /* registered fds, -1 if free */
+    UINT16              task_fd_evt[GKI_MAX_TASKS][GKI_MAX_TASK_FDS];   /* event raised when readable */
+#endif
     pthread_mutex_t     thread_timeout_mutex[GKI_MAX_TASKS];
     pthread_cond_t      thread_timeout_cond[GKI_MAX_TASKS];
     int                 no_timer_suspend;   /* 1: no suspend, 0 stop calling GKI_timer_update() */
     pthread_mutex_t     gki_timer_mutex;
     pthread_cond_t      gki_timer_cond;
     int                 gki_timer_wake_lock_on;
+#if (GKI_TICKLESS_TIMER == TRUE)
+    UINT64              timer_epoch_ns;     /* CLOCK_MONOTONIC time of the last GKI_timer_update() tick */
+    volatile UINT32     timer_seq;          /* odd while the epoch and OSTicks are being updated */
+#endif
 #if (GKI_DEBUG == TRUE)
     pthread_mutex_t     GKI_trace_mutex;
 #endif
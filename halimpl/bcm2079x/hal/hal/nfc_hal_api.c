@@ -28,6 +28,7 @@
 #include "nfc_hal_target.h"
 #include "nfc_hal_api.h"
 #include "nfc_hal_int.h"
+#include "userial.h"
 
 /*******************************************************************************
 ** NFC_HAL_TASK declarations
@@ -216,6 +217,67 @@ void HAL_NfcWrite (UINT16 data_len, UINT8 *p_data)
     }
 }
 
+/*******************************************************************************
+**
+** Function         HAL_NfcWriteBatch
+**
+** Description      Send several NCI control messages or data packets to the
+**                  transport, as HAL_NfcWrite does for each of them. All the
+**                  packets are copied before any is sent, so that NFC_HAL_TASK
+**                  finds them together in its mailbox and can write the data
+**                  packets with a single system call. If a buffer runs out,
+**                  the packets copied so far are sent, the rest are dropped
+**                  and HAL_NFC_ERROR_EVT is reported.
+**
+** Returns          void
+**
+*******************************************************************************/
+void HAL_NfcWriteBatch (UINT8 num_pkts, UINT16 *p_data_len, UINT8 **pp_data)
+{
+    NFC_HDR *p_msg[USERIAL_MAX_IOV];
+    UINT8 mt, xx, yy, num_msgs = 0;
+
+    HAL_TRACE_API1 ("HAL_NfcWriteBatch (): %d packets", num_pkts);
+
+    for (xx = 0; xx < num_pkts; xx++)
+    {
+        if (p_data_len[xx] > (NCI_MAX_CTRL_SIZE + NCI_MSG_HDR_SIZE))
+        {
+            HAL_TRACE_ERROR1 ("HAL_NfcWriteBatch (): too many bytes (%d)", p_data_len[xx]);
+            continue;
+        }
+
+        if ((p_msg[num_msgs] = (NFC_HDR *)GKI_getpoolbuf (NFC_HAL_NCI_POOL_ID)) == NULL)
+            break;
+
+        p_msg[num_msgs]->event  = NFC_HAL_EVT_TO_NFC_NCI;
+        p_msg[num_msgs]->offset = NFC_HAL_NCI_MSG_OFFSET_SIZE;
+        p_msg[num_msgs]->len    = p_data_len[xx];
+        memcpy ((UINT8 *)(p_msg[num_msgs]+1) + p_msg[num_msgs]->offset, pp_data[xx], p_data_len[xx]);
+
+        /* Check if message is a command or data */
+        mt = (*(pp_data[xx]) & NCI_MT_MASK) >> NCI_MT_SHIFT;
+        p_msg[num_msgs]->layer_specific = (mt == NCI_MT_CMD) ? NFC_HAL_WAIT_RSP_CMD : 0;
+
+        /* Send what is copied so far when the batch is full */
+        if (++num_msgs == USERIAL_MAX_IOV)
+        {
+            for (yy = 0; yy < num_msgs; yy++)
+                GKI_send_msg (NFC_HAL_TASK, NFC_HAL_TASK_MBOX, p_msg[yy]);
+            num_msgs = 0;
+        }
+    }
+
+    for (yy = 0; yy < num_msgs; yy++)
+        GKI_send_msg (NFC_HAL_TASK, NFC_HAL_TASK_MBOX, p_msg[yy]);
+
+    if (xx < num_pkts)
+    {
+        HAL_TRACE_ERROR2 ("HAL_NfcWriteBatch (): no buffer, %d of %d packets dropped", num_pkts - xx, num_pkts);
+        nfc_hal_main_send_error (HAL_NFC_STATUS_FAILED);
+    }
+}
+
 /*******************************************************************************
 **
 ** Function         HAL_NfcPreDiscover
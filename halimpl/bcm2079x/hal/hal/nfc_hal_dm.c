@@ -33,10 +33,14 @@
 *****************************************************************************/
 
 #define NFC_HAL_I93_RW_CFG_LEN              (5)
+#define NFC_HAL_DM_SET_CONFIG_MAX_TLV_LEN   (0xFF - 1)  /* CORE_SET_CONFIG payload is num of params + TLVs */
 #define NFC_HAL_I93_RW_CFG_PARAM_LEN        (3)
 #define NFC_HAL_I93_AFI                     (0)
 #define NFC_HAL_I93_ENABLE_SMART_POLL       (1)
 
+/* OS ticks to ms at any tick rate, without overflow on long periods */
+#define NFC_HAL_LP_TICKS_TO_MS(x)           (((x) / OS_TICKS_PER_SEC) * 1000 + (((x) % OS_TICKS_PER_SEC) * 1000) / OS_TICKS_PER_SEC)
+
 static UINT8 nfc_hal_dm_i93_rw_cfg[NFC_HAL_I93_RW_CFG_LEN] =
 {
     NCI_PARAM_ID_I93_DATARATE,
@@ -207,6 +211,27 @@ void nfc_hal_dm_config_nfcc_cback (tNFC_HAL_NCI_EVT event, UINT16 data_len, UINT
     }
 }
 
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_check_startup_vsc
+**
+** Description      Check that the start-up VSC config is a sequence of whole
+**                  NCI commands, so a bad config fails before any is sent
+**
+** Returns          TRUE if well formed
+**
+*******************************************************************************/
+static BOOLEAN nfc_hal_dm_check_startup_vsc (void)
+{
+    UINT16 offset = 1;                  /* skip total length */
+    UINT16 end    = 1 + *p_nfc_hal_dm_start_up_vsc_cfg;
+
+    while (offset + NCI_MSG_HDR_SIZE <= end)
+        offset += NCI_MSG_HDR_SIZE + p_nfc_hal_dm_start_up_vsc_cfg[offset + 2];
+
+    return (offset == end);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_dm_send_startup_vsc
@@ -252,88 +277,150 @@ void nfc_hal_dm_send_startup_vsc (void)
 
 /*******************************************************************************
 **
-** Function         nfc_hal_dm_config_nfcc
+** Function         nfc_hal_dm_get_config_tlvs
 **
-** Description      Send VS config before NFA start-up
+** Description      Get the CORE_SET_CONFIG parameters of a post-initialization
+**                  config item
 **
-** Returns          void
+** Returns          length of the TLVs in *pp_tlvs, 0 if nothing to set
 **
 *******************************************************************************/
-void nfc_hal_dm_config_nfcc (void)
+static UINT8 nfc_hal_dm_get_config_tlvs (tNFC_HAL_DM_CONFIG config, UINT8 **pp_tlvs)
 {
-    HAL_TRACE_DEBUG1 ("nfc_hal_dm_config_nfcc (): next_dm_config = %d", nfc_hal_cb.dev_cb.next_dm_config);
-
-    if ((p_nfc_hal_dm_lptd_cfg[0]) && (nfc_hal_cb.dev_cb.next_dm_config <= NFC_HAL_DM_CONFIG_LPTD))
+    switch (config)
     {
-        nfc_hal_cb.dev_cb.next_dm_config = NFC_HAL_DM_CONFIG_PLL_325;
+    case NFC_HAL_DM_CONFIG_LPTD:
+        *pp_tlvs = &p_nfc_hal_dm_lptd_cfg[1];
+        return (p_nfc_hal_dm_lptd_cfg[0]);
 
-        if (nfc_hal_dm_set_config (p_nfc_hal_dm_lptd_cfg[0],
-                                   &p_nfc_hal_dm_lptd_cfg[1],
-                                   nfc_hal_dm_config_nfcc_cback) == HAL_NFC_STATUS_OK)
-        {
-            return;
-        }
-        else
-        {
-            NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
-            nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
-            return;
-        }
+    case NFC_HAL_DM_CONFIG_PLL_325:
+        if (p_nfc_hal_dm_pll_325_cfg == NULL)
+            return 0;
+        *pp_tlvs = p_nfc_hal_dm_pll_325_cfg;
+        return (NFC_HAL_PLL_325_SETCONFIG_PARAM_LEN);
+
+    case NFC_HAL_DM_CONFIG_START_UP:
+        *pp_tlvs = &p_nfc_hal_dm_start_up_cfg[1];
+        return (p_nfc_hal_dm_start_up_cfg[0]);
+
+#if (NFC_HAL_I93_FLAG_DATA_RATE == NFC_HAL_I93_FLAG_DATA_RATE_HIGH)
+    case NFC_HAL_DM_CONFIG_I93_DATA_RATE:
+        *pp_tlvs = nfc_hal_dm_i93_rw_cfg;
+        return (NFC_HAL_I93_RW_CFG_LEN);
+#endif
     }
 
-    if ((p_nfc_hal_dm_pll_325_cfg) && (nfc_hal_cb.dev_cb.next_dm_config <= NFC_HAL_DM_CONFIG_PLL_325))
-    {
-        nfc_hal_cb.dev_cb.next_dm_config = NFC_HAL_DM_CONFIG_START_UP;
+    return 0;
+}
 
-        if (nfc_hal_dm_set_config (NFC_HAL_PLL_325_SETCONFIG_PARAM_LEN,
-                                   p_nfc_hal_dm_pll_325_cfg,
-                                   nfc_hal_dm_config_nfcc_cback) == HAL_NFC_STATUS_OK)
-        {
-            return;
-        }
-        else
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_check_tlvs
+**
+** Description      Check that a buffer holds whole TLVs only
+**
+** Returns          TRUE if well formed
+**
+*******************************************************************************/
+static BOOLEAN nfc_hal_dm_check_tlvs (UINT8 *p_tlvs, UINT8 tlv_len)
+{
+    UINT16 offset = 0;
+
+    while (offset + 2 <= tlv_len)
+        offset += 2 + p_tlvs[offset + 1];
+
+    return (offset == tlv_len);
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_tlvs_overlap
+**
+** Description      Check if two well formed TLV buffers set the same parameter
+**
+** Returns          TRUE if a parameter ID is in both
+**
+*******************************************************************************/
+static BOOLEAN nfc_hal_dm_tlvs_overlap (UINT8 *p_a, UINT8 a_len, UINT8 *p_b, UINT8 b_len)
+{
+    UINT16 xx, yy;
+
+    for (yy = 0; yy < b_len; yy += 2 + p_b[yy + 1])
+    {
+        for (xx = 0; xx < a_len; xx += 2 + p_a[xx + 1])
         {
-            NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
-            nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
-            return;
+            if (p_a[xx] == p_b[yy])
+                return TRUE;
         }
     }
+    return FALSE;
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_config_nfcc
+**
+** Description      Send VS config before NFA start-up
+**
+** Returns          void
+**
+*******************************************************************************/
+void nfc_hal_dm_config_nfcc (void)
+{
+    UINT8  tlvs[NFC_HAL_DM_SET_CONFIG_MAX_TLV_LEN];
+    UINT8  tlv_len = 0, len;
+    UINT8  *p_src;
+
+    HAL_TRACE_DEBUG1 ("nfc_hal_dm_config_nfcc (): next_dm_config = %d", nfc_hal_cb.dev_cb.next_dm_config);
 
-    if ((p_nfc_hal_dm_start_up_cfg[0]) && (nfc_hal_cb.dev_cb.next_dm_config <= NFC_HAL_DM_CONFIG_START_UP))
+    /* Merge the CORE_SET_CONFIG items into as few commands as possible */
+    while (nfc_hal_cb.dev_cb.next_dm_config < NFC_HAL_DM_CONFIG_FW_FSM)
     {
-        nfc_hal_cb.dev_cb.next_dm_config = NFC_HAL_DM_CONFIG_I93_DATA_RATE;
-        if (nfc_hal_dm_set_config (p_nfc_hal_dm_start_up_cfg[0],
-                                   &p_nfc_hal_dm_start_up_cfg[1],
-                                   nfc_hal_dm_config_nfcc_cback) == HAL_NFC_STATUS_OK)
-        {
-            return;
-        }
-        else
+        if ((len = nfc_hal_dm_get_config_tlvs (nfc_hal_cb.dev_cb.next_dm_config, &p_src)) != 0)
         {
-            NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
-            nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
-            return;
+            if (!nfc_hal_dm_check_tlvs (p_src, len))
+            {
+                HAL_TRACE_ERROR1 ("nfc_hal_dm_config_nfcc (): Bad TLV in config item %d", nfc_hal_cb.dev_cb.next_dm_config);
+                NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
+                nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
+                return;
+            }
+
+            /* a parameter set twice goes in a later command, so the later value still wins */
+            if (  (tlv_len)
+                &&(  (tlv_len + len > NFC_HAL_DM_SET_CONFIG_MAX_TLV_LEN)
+                   ||(nfc_hal_dm_tlvs_overlap (tlvs, tlv_len, p_src, len))  )  )
+            {
+                break;
+            }
+
+            /* an item too big to share a command is sent as it is */
+            if (len > NFC_HAL_DM_SET_CONFIG_MAX_TLV_LEN)
+            {
+                nfc_hal_cb.dev_cb.next_dm_config++;
+                if (nfc_hal_dm_set_config (len, p_src, nfc_hal_dm_config_nfcc_cback) != HAL_NFC_STATUS_OK)
+                {
+                    NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
+                    nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
+                }
+                return;
+            }
+
+            memcpy (tlvs + tlv_len, p_src, len);
+            tlv_len += len;
         }
+        nfc_hal_cb.dev_cb.next_dm_config++;
     }
 
-#if (NFC_HAL_I93_FLAG_DATA_RATE == NFC_HAL_I93_FLAG_DATA_RATE_HIGH)
-    if (nfc_hal_cb.dev_cb.next_dm_config  <= NFC_HAL_DM_CONFIG_I93_DATA_RATE)
+    if (tlv_len)
     {
-        nfc_hal_cb.dev_cb.next_dm_config = NFC_HAL_DM_CONFIG_FW_FSM;
-        if (nfc_hal_dm_set_config (NFC_HAL_I93_RW_CFG_LEN,
-                                   nfc_hal_dm_i93_rw_cfg,
-                                   nfc_hal_dm_config_nfcc_cback) == HAL_NFC_STATUS_OK)
-        {
-            return;
-        }
-        else
+        if (nfc_hal_dm_set_config (tlv_len, tlvs, nfc_hal_dm_config_nfcc_cback) != HAL_NFC_STATUS_OK)
         {
             NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
             nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
-            return;
         }
+        return;
     }
-#endif
 
     /* FW FSM is disabled as default in NFCC */
     if (nfc_hal_cb.dev_cb.next_dm_config <= NFC_HAL_DM_CONFIG_FW_FSM)
@@ -347,6 +434,16 @@ void nfc_hal_dm_config_nfcc (void)
     {
         if (p_nfc_hal_dm_start_up_vsc_cfg && *p_nfc_hal_dm_start_up_vsc_cfg)
         {
+            /* check the whole sequence before sending the first VSC of it */
+            if (  (nfc_hal_cb.dev_cb.next_startup_vsc == 1)
+                &&(!nfc_hal_dm_check_startup_vsc ())  )
+            {
+                HAL_TRACE_ERROR0 ("nfc_hal_dm_config_nfcc (): Bad start-up VSC");
+                NFC_HAL_SET_INIT_STATE (NFC_HAL_INIT_STATE_IDLE);
+                nfc_hal_cb.p_stack_cback (HAL_NFC_POST_INIT_CPLT_EVT, HAL_NFC_STATUS_FAILED);
+                return;
+            }
+
             nfc_hal_dm_send_startup_vsc ();
             return;
         }
@@ -764,6 +861,14 @@ void nfc_hal_dm_proc_msg_during_init (NFC_HDR *p_msg)
                                                     p_msg->len,
                                                     (UINT8 *) (p_msg + 1) + p_msg->offset);
         }
+        else if (  (op_code == NFC_VS_SEC_PATCH_DOWNLOAD_EVT)
+                 &&(nfc_hal_cb.prm.spd_in_flight)  )
+        {
+            /* response to a segment pipelined by PRM without the command window */
+            nfc_hal_prm_nci_command_complete_cback ((tNFC_HAL_NCI_EVT) (op_code),
+                                                    p_msg->len,
+                                                    (UINT8 *) (p_msg + 1) + p_msg->offset);
+        }
     }
 }
 
@@ -925,6 +1030,98 @@ void nfc_hal_dm_send_bt_cmd (const UINT8 *p_data, UINT16 len, tNFC_HAL_BTVSC_CPL
     }
 }
 
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_lp_reset
+**
+** Description      Forget the learned idle timeout and clear low power counters
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_dm_lp_reset (void)
+{
+    nfc_hal_cb.dev_cb.lp_idle_timeout        = NFC_HAL_LP_IDLE_TIMEOUT;
+    nfc_hal_cb.dev_cb.lp_gap_avg             = 0;
+    nfc_hal_cb.dev_cb.lp_gap_dev             = 0;
+    nfc_hal_cb.dev_cb.lp_last_activity_ticks = GKI_get_os_tick_count ();
+    nfc_hal_cb.dev_cb.lp_wake_asserted       = FALSE;
+
+    memset (&nfc_hal_cb.dev_cb.lp_stats, 0, sizeof (tHAL_NFC_LP_STATS));
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_lp_end_wake
+**
+** Description      Add the current wake period to the time spent awake
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_dm_lp_end_wake (void)
+{
+    if (nfc_hal_cb.dev_cb.lp_wake_asserted)
+    {
+        nfc_hal_cb.dev_cb.lp_stats.awake_ms += NFC_HAL_LP_TICKS_TO_MS (GKI_get_os_tick_count ()
+                                                                       - nfc_hal_cb.dev_cb.lp_wake_ticks);
+        nfc_hal_cb.dev_cb.lp_wake_asserted = FALSE;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_dm_lp_update_idle_timeout
+**
+** Description      Learn the idle timeout from the gap since the last transport
+**                  activity. As for a TCP retransmission timeout, the timeout
+**                  is the smoothed gap plus four times its smoothed deviation,
+**                  so the NFCC stays awake through bursts such as LLCP or
+**                  multi-block reads and snoozes soon after them. Gaps longer
+**                  than NFC_HAL_LP_IDLE_TIMEOUT_MAX are idle periods between
+**                  bursts and are not learned.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_dm_lp_update_idle_timeout (void)
+{
+    UINT32 now = GKI_get_os_tick_count ();
+    UINT32 gap = NFC_HAL_LP_TICKS_TO_MS (now - nfc_hal_cb.dev_cb.lp_last_activity_ticks);
+    INT32  err;
+    UINT32 timeout;
+
+    nfc_hal_cb.dev_cb.lp_last_activity_ticks = now;
+
+    if (gap > NFC_HAL_LP_IDLE_TIMEOUT_MAX)
+        return;
+
+    if ((nfc_hal_cb.dev_cb.lp_gap_avg == 0) && (nfc_hal_cb.dev_cb.lp_gap_dev == 0))
+    {
+        /* first sample */
+        nfc_hal_cb.dev_cb.lp_gap_avg = gap << 3;
+        nfc_hal_cb.dev_cb.lp_gap_dev = gap << 1;
+    }
+    else
+    {
+        /* avg += err/8, dev += (|err| - dev)/4, with dev scaled by 4 */
+        err = (INT32) gap - (INT32) (nfc_hal_cb.dev_cb.lp_gap_avg >> 3);
+        nfc_hal_cb.dev_cb.lp_gap_avg += err;
+        if (err < 0)
+            err = -err;
+        nfc_hal_cb.dev_cb.lp_gap_dev += (UINT32) err - (nfc_hal_cb.dev_cb.lp_gap_dev >> 2);
+    }
+
+    timeout = (nfc_hal_cb.dev_cb.lp_gap_avg >> 3) + nfc_hal_cb.dev_cb.lp_gap_dev;
+
+    if (timeout < NFC_HAL_LP_IDLE_TIMEOUT_MIN)
+        timeout = NFC_HAL_LP_IDLE_TIMEOUT_MIN;
+    else if (timeout > NFC_HAL_LP_IDLE_TIMEOUT_MAX)
+        timeout = NFC_HAL_LP_IDLE_TIMEOUT_MAX;
+
+    nfc_hal_cb.dev_cb.lp_idle_timeout = timeout;
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_dm_set_nfc_wake
@@ -952,6 +1149,21 @@ void nfc_hal_dm_set_nfc_wake (UINT8 cmd)
         UPIO_Set (UPIO_GENERAL, NFC_HAL_LP_NFC_WAKE_GPIO, UPIO_OFF); /* pull down NFC_WAKE */
     else
         UPIO_Set (UPIO_GENERAL, NFC_HAL_LP_NFC_WAKE_GPIO, UPIO_ON);  /* pull up NFC_WAKE */
+
+    if (cmd == NFC_HAL_ASSERT_NFC_WAKE)
+    {
+        if (!nfc_hal_cb.dev_cb.lp_wake_asserted)
+        {
+            nfc_hal_cb.dev_cb.lp_wake_asserted = TRUE;
+            nfc_hal_cb.dev_cb.lp_wake_ticks    = GKI_get_os_tick_count ();
+            nfc_hal_cb.dev_cb.lp_stats.wake_count++;
+        }
+    }
+    else if (nfc_hal_cb.dev_cb.lp_wake_asserted)
+    {
+        nfc_hal_dm_lp_end_wake ();
+        nfc_hal_cb.dev_cb.lp_stats.snooze_count++;
+    }
 }
 
 /*******************************************************************************
@@ -985,9 +1197,12 @@ BOOLEAN nfc_hal_dm_power_mode_execute (tNFC_HAL_LP_EVT event)
                     nfc_hal_dm_set_nfc_wake (NFC_HAL_ASSERT_NFC_WAKE);
                 }
 
+#if (NFC_HAL_LP_ADAPTIVE == TRUE)
+                nfc_hal_dm_lp_update_idle_timeout ();
+#endif
                 /* start or extend idle timer */
                 nfc_hal_main_start_quick_timer (&nfc_hal_cb.dev_cb.lp_timer, 0x00,
-                                                ((UINT32) NFC_HAL_LP_IDLE_TIMEOUT) * QUICK_TIMER_TICKS_PER_SEC / 1000);
+                                                nfc_hal_cb.dev_cb.lp_idle_timeout * QUICK_TIMER_TICKS_PER_SEC / 1000);
             }
             else if (event == NFC_HAL_LP_TIMEOUT_EVT)
             {
@@ -1072,6 +1287,9 @@ void nfc_hal_dm_shutting_down_nfcc (void)
         nfc_hal_dm_set_nfc_wake (NFC_HAL_ASSERT_NFC_WAKE);
     }
 
+    /* NFCC is going down, stop counting time awake */
+    nfc_hal_dm_lp_end_wake ();
+
     nfc_hal_cb.ncit_cb.nci_wait_rsp = NFC_HAL_WAIT_RSP_NONE;
 
     nfc_hal_cb.dev_cb.power_mode  = NFC_HAL_POWER_MODE_FULL;
@@ -1103,6 +1321,7 @@ void nfc_hal_dm_init (void)
     HAL_TRACE_DEBUG0 ("nfc_hal_dm_init ()");
 
     nfc_hal_cb.dev_cb.lp_timer.p_cback = nci_brcm_lp_timeout_cback;
+    nfc_hal_dm_lp_reset ();
 
     nfc_hal_cb.ncit_cb.nci_wait_rsp_timer.p_cback = nfc_hal_nci_cmd_timeout_cback;
 
@@ -1193,13 +1412,16 @@ static void nfc_hal_dm_set_snooze_mode_cback (tNFC_HAL_BTVSC_CPLT *pData)
         /* update snooze mode */
         nfc_hal_cb.dev_cb.snooze_mode = nfc_hal_cb.dev_cb.new_snooze_mode;
 
+        /* learn the idle timeout and count transitions from scratch */
+        nfc_hal_dm_lp_reset ();
+
         nfc_hal_dm_set_nfc_wake (NFC_HAL_ASSERT_NFC_WAKE);
 
         if ( nfc_hal_cb.dev_cb.snooze_mode != NFC_HAL_LP_SNOOZE_MODE_NONE)
         {
             /* start idle timer */
             nfc_hal_main_start_quick_timer (&nfc_hal_cb.dev_cb.lp_timer, 0x00,
-                                            ((UINT32) NFC_HAL_LP_IDLE_TIMEOUT) * QUICK_TIMER_TICKS_PER_SEC / 1000);
+                                            nfc_hal_cb.dev_cb.lp_idle_timeout * QUICK_TIMER_TICKS_PER_SEC / 1000);
         }
         else
         {
@@ -1280,6 +1502,35 @@ tHAL_NFC_STATUS HAL_NfcSetSnoozeMode (UINT8 snooze_mode,
     return (NCI_STATUS_OK);
 }
 
+/*******************************************************************************
+**
+** Function         HAL_NfcGetLpStats
+**
+** Description      Get the low power counters since snooze mode was last set,
+**                  including the time of the current wake period
+**
+**                  p_stats
+**                      Counters are copied here
+**
+** Returns          void
+**
+*******************************************************************************/
+void HAL_NfcGetLpStats (tHAL_NFC_LP_STATS *p_stats)
+{
+    *p_stats = nfc_hal_cb.dev_cb.lp_stats;
+    p_stats->idle_timeout = nfc_hal_cb.dev_cb.lp_idle_timeout;
+
+    if (nfc_hal_cb.dev_cb.lp_wake_asserted)
+    {
+        p_stats->awake_ms += NFC_HAL_LP_TICKS_TO_MS (GKI_get_os_tick_count ()
+                                                     - nfc_hal_cb.dev_cb.lp_wake_ticks);
+    }
+
+    HAL_TRACE_API4 ("HAL_NfcGetLpStats (): wake=%d, snooze=%d, awake=%d ms, idle timeout=%d ms",
+                    p_stats->wake_count, p_stats->snooze_count,
+                    p_stats->awake_ms, p_stats->idle_timeout);
+}
+
 
 
 
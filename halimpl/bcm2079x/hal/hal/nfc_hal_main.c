@@ -46,6 +46,16 @@ tNFC_HAL_CB nfc_hal_cb;
 #endif
 
 extern tNFC_HAL_CFG *p_nfc_hal_cfg;
+
+/* NCI data packets taken from the mailbox, waiting for one vectored write */
+typedef struct
+{
+    NFC_HDR *p_pkt[USERIAL_MAX_IOV];
+    UINT8   num_pkts;
+} tNFC_HAL_TX_BATCH;
+
+static tNFC_HAL_TX_BATCH nfc_hal_tx_batch;
+
 /****************************************************************************
 ** Internal function prototypes
 ****************************************************************************/
@@ -491,11 +501,46 @@ static void nfc_hal_send_credit_ntf_for_cid (UINT8 cid)
     }
 }
 
+/*******************************************************************************
+**
+** Function         nfc_hal_main_flush_tx
+**
+** Description      Write the NCI data packets collected by
+**                  nfc_hal_main_send_message to the transport in one go.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_main_flush_tx (void)
+{
+    tUSERIAL_IOV iov[USERIAL_MAX_IOV];
+    UINT8        xx;
+
+    if (nfc_hal_tx_batch.num_pkts == 0)
+        return;
+
+    for (xx = 0; xx < nfc_hal_tx_batch.num_pkts; xx++)
+    {
+        iov[xx].p_data = (UINT8 *) (nfc_hal_tx_batch.p_pkt[xx] + 1) + nfc_hal_tx_batch.p_pkt[xx]->offset;
+        iov[xx].len    = nfc_hal_tx_batch.p_pkt[xx]->len;
+    }
+
+    USERIAL_WriteV (USERIAL_NFC_PORT, iov, nfc_hal_tx_batch.num_pkts);
+
+    for (xx = 0; xx < nfc_hal_tx_batch.num_pkts; xx++)
+        GKI_freebuf (nfc_hal_tx_batch.p_pkt[xx]);
+
+    nfc_hal_tx_batch.num_pkts = 0;
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_main_send_message
 **
 ** Description      This function is calledto send an NCI message.
+**                  Data packets are collected and written together by
+**                  nfc_hal_main_flush_tx; a command first flushes them so
+**                  the order on the transport is kept.
 **
 ** Returns          void
 **
@@ -516,6 +561,7 @@ static void nfc_hal_main_send_message (NFC_HDR *p_msg)
     if (  (p_msg->layer_specific == NFC_HAL_WAIT_RSP_CMD)
         ||(p_msg->layer_specific == NFC_HAL_WAIT_RSP_VSC)  )
     {
+        nfc_hal_main_flush_tx ();
         nfc_hal_nci_send_cmd (p_msg);
     }
     else
@@ -555,13 +601,15 @@ static void nfc_hal_main_send_message (NFC_HDR *p_msg)
         /* check low power mode state */
         if (nfc_hal_dm_power_mode_execute (NFC_HAL_LP_TX_DATA_EVT))
         {
-            USERIAL_Write (USERIAL_NFC_PORT, ps, p_msg->len);
+            nfc_hal_tx_batch.p_pkt[nfc_hal_tx_batch.num_pkts++] = p_msg;
+            if (nfc_hal_tx_batch.num_pkts == USERIAL_MAX_IOV)
+                nfc_hal_main_flush_tx ();
         }
         else
         {
             HAL_TRACE_ERROR0 ("nfc_hal_main_send_message(): drop data in low power mode");
+            GKI_freebuf (p_msg);
         }
-        GKI_freebuf (p_msg);
     }
 }
 
@@ -577,11 +625,14 @@ static void nfc_hal_main_send_message (NFC_HDR *p_msg)
 UINT32 nfc_hal_main_task (UINT32 param)
 {
     UINT16   event;
-    UINT8    byte;
     UINT8    num_interfaces;
     UINT8    *p;
     NFC_HDR  *p_msg;
+    NFC_HDR  *p_rx = NULL;
     BOOLEAN  free_msg;
+    BUFFER_Q msg_q;
+
+    GKI_init_q (&msg_q);
 
     HAL_TRACE_DEBUG0 ("NFC_HAL_TASK started");
 
@@ -633,9 +684,16 @@ UINT32 nfc_hal_main_task (UINT32 param)
         /* NCI message ready to be sent to NFCC */
         if (event & NFC_HAL_TASK_EVT_MBOX)
         {
-            while ((p_msg = (NFC_HDR *) GKI_read_mbox (NFC_HAL_TASK_MBOX)) != NULL)
+            GKI_read_mbox_batch (NFC_HAL_TASK_MBOX, &msg_q);
+
+            while ((p_msg = (NFC_HDR *) GKI_dequeue_batch (&msg_q)) != NULL)
             {
                 free_msg = TRUE;
+
+                /* anything but an NCI packet may write to the transport itself */
+                if ((p_msg->event & NFC_EVT_MASK) != NFC_HAL_EVT_TO_NFC_NCI)
+                    nfc_hal_main_flush_tx ();
+
                 switch (p_msg->event & NFC_EVT_MASK)
                 {
                 case NFC_HAL_EVT_TO_NFC_NCI:
@@ -685,6 +743,8 @@ UINT32 nfc_hal_main_task (UINT32 param)
                 if (free_msg)
                     GKI_freebuf (p_msg);
             }
+
+            nfc_hal_main_flush_tx ();
         }
 
         /* Data waiting to be read from serial port */
@@ -692,13 +752,15 @@ UINT32 nfc_hal_main_task (UINT32 param)
         {
             while (TRUE)
             {
-                /* Read one byte to see if there is anything waiting to be read */
-                if (USERIAL_Read (USERIAL_NFC_PORT, &byte, 1) == 0)
+                /* Take the next buffer read from the serial port, if the last one is used up */
+                if (p_rx == NULL)
                 {
-                    break;
+                    USERIAL_ReadBuf (USERIAL_NFC_PORT, (BT_HDR **) &p_rx);
+                    if (p_rx == NULL)
+                        break;
                 }
 
-                if (nfc_hal_nci_receive_msg (byte))
+                if (nfc_hal_nci_receive_buf (&p_rx))
                 {
                     /* complete of receiving NCI message */
                     nfc_hal_nci_assemble_nci_msg ();
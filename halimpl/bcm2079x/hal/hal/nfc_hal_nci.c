@@ -38,6 +38,57 @@
 ** Local function prototypes
 *****************************************************************************/
 
+/*******************************************************************************
+**
+** Function         nfc_hal_nci_flatten_msg
+**
+** Description      Make a reassembled NCI message contiguous. The segments are
+**                  copied after the first buffer if it has room, or else the
+**                  whole message is copied into a buffer of the right size.
+**
+** Returns          the contiguous message, or NULL if no buffer is available
+**                  (the chain is then left untouched)
+**
+*******************************************************************************/
+static NFC_HDR *nfc_hal_nci_flatten_msg (NFC_HDR *p_head)
+{
+    NFC_HDR *p_flat, *p_seg, *p_rest;
+    UINT16  total = 0;
+    UINT8   *pd;
+
+    for (p_seg = p_head; p_seg; p_seg = (NFC_HDR *) GKI_get_next_seg (p_seg))
+        total += p_seg->len;
+
+    if (GKI_get_buf_size (p_head) >= (NFC_HDR_SIZE + p_head->offset + total))
+    {
+        p_flat = p_head;
+        p_rest = (NFC_HDR *) GKI_unchain_buf (p_head);
+        p_seg  = p_rest;
+    }
+    else
+    {
+        if ((p_flat = (NFC_HDR *) GKI_getbuf ((UINT16) (NFC_HDR_SIZE + p_head->offset + total))) == NULL)
+            return (NULL);
+
+        memcpy (p_flat, p_head, NFC_HDR_SIZE);
+        memcpy ((UINT8 *) (p_flat + 1) + p_flat->offset, (UINT8 *) (p_head + 1) + p_head->offset, p_head->len);
+        p_rest = p_head;
+        p_seg  = (NFC_HDR *) GKI_get_next_seg (p_head);
+    }
+
+    pd = (UINT8 *) (p_flat + 1) + p_flat->offset + p_head->len;
+    for (; p_seg; p_seg = (NFC_HDR *) GKI_get_next_seg (p_seg))
+    {
+        memcpy (pd, (UINT8 *) (p_seg + 1) + p_seg->offset, p_seg->len);
+        pd += p_seg->len;
+    }
+
+    p_flat->len = total;
+    GKI_freebuf (p_rest);
+
+    return (p_flat);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_nci_assemble_nci_msg
@@ -52,11 +103,11 @@
 void nfc_hal_nci_assemble_nci_msg (void)
 {
     NFC_HDR *p_msg = nfc_hal_cb.ncit_cb.p_rcv_msg;
+    NFC_HDR *p_frag, *p_flat;
     UINT8 u8;
     UINT8 *p, *pp;
     UINT8 hdr[2];
-    UINT8   *ps, *pd;
-    UINT16  size, needed;
+    UINT16  needed;
     BOOLEAN disp_again = FALSE;
 
     if ((p_msg == NULL) || (p_msg->len < NCI_MSG_HDR_SIZE))
@@ -98,30 +149,28 @@ void nfc_hal_nci_assemble_nci_msg (void)
         else if (nfc_hal_cb.ncit_cb.nci_ras == 0)
         {
             disp_again = TRUE;
-            /* if not previous reassembly error, append the new fragment */
+            /* if not previous reassembly error, chain the new fragment.
+             * The message is made contiguous once the last fragment is in */
             p_msg->offset   += NCI_MSG_HDR_SIZE;
             p_msg->len      -= NCI_MSG_HDR_SIZE;
-            size    = GKI_get_buf_size (nfc_hal_cb.ncit_cb.p_frag_msg);
-            needed  = (NFC_HDR_SIZE + nfc_hal_cb.ncit_cb.p_frag_msg->len + nfc_hal_cb.ncit_cb.p_frag_msg->offset + p_msg->len);
-            if (size >= needed)
+            needed  = (NFC_HDR_SIZE + nfc_hal_cb.ncit_cb.p_frag_msg->offset + p_msg->len);
+            for (p_frag = nfc_hal_cb.ncit_cb.p_frag_msg; p_frag; p_frag = (NFC_HDR *) GKI_get_next_seg (p_frag))
+                needed += p_frag->len;
+
+            if (needed <= GKI_MAX_BUF_SIZE)
             {
-                /* the buffer for reassembly is big enough to append the new fragment */
-                ps   = (UINT8 *) (p_msg + 1) + p_msg->offset;
-                pd   = (UINT8 *) (nfc_hal_cb.ncit_cb.p_frag_msg + 1) + nfc_hal_cb.ncit_cb.p_frag_msg->offset + nfc_hal_cb.ncit_cb.p_frag_msg->len;
-                memcpy (pd, ps, p_msg->len);
-                nfc_hal_cb.ncit_cb.p_frag_msg->len  += p_msg->len;
-                /* adjust the NCI packet length */
-                pd   = (UINT8 *) (nfc_hal_cb.ncit_cb.p_frag_msg + 1) + nfc_hal_cb.ncit_cb.p_frag_msg->offset + 2;
-                *pd  = (UINT8) (nfc_hal_cb.ncit_cb.p_frag_msg->len - NCI_MSG_HDR_SIZE);
+                GKI_chain_buf (nfc_hal_cb.ncit_cb.p_frag_msg, p_msg);
+                p_msg = NULL;
             }
             else
             {
                 nfc_hal_cb.ncit_cb.nci_ras  |= NFC_HAL_NCI_RAS_TOO_BIG;
-                HAL_TRACE_ERROR2 ("nfc_hal_nci_assemble_nci_msg() buffer overrun (%d + %d)!!", nfc_hal_cb.ncit_cb.p_frag_msg->len, p_msg->len);
+                HAL_TRACE_ERROR2 ("nfc_hal_nci_assemble_nci_msg() buffer overrun (%d + %d)!!", needed - p_msg->len, p_msg->len);
             }
         }
-        /* we are done with this new fragment, free it */
-        GKI_freebuf (p_msg);
+        /* we are done with this new fragment, free it unless it was chained */
+        if (p_msg)
+            GKI_freebuf (p_msg);
     }
     else
     {
@@ -133,9 +182,28 @@ void nfc_hal_nci_assemble_nci_msg (void)
     {
         /* last fragment */
         p_msg               = nfc_hal_cb.ncit_cb.p_frag_msg;
+        nfc_hal_cb.ncit_cb.p_frag_msg  = NULL;
+
+        if (GKI_get_next_seg (p_msg))
+        {
+            if ((p_flat = nfc_hal_nci_flatten_msg (p_msg)) != NULL)
+            {
+                p_msg = p_flat;
+                /* adjust the NCI packet length */
+                pp    = (UINT8 *) (p_msg + 1) + p_msg->offset + 2;
+                *pp   = (UINT8) (p_msg->len - NCI_MSG_HDR_SIZE);
+            }
+            else
+            {
+                /* report what the first buffer holds, as if the message were too big */
+                nfc_hal_cb.ncit_cb.nci_ras  |= NFC_HAL_NCI_RAS_TOO_BIG;
+                HAL_TRACE_ERROR0 ("nfc_hal_nci_assemble_nci_msg() no buffer to reassemble");
+                GKI_freebuf (GKI_unchain_buf (p_msg));
+            }
+        }
+
         p                   = (UINT8 *) (p_msg + 1) + p_msg->offset;
         *p                  = u8; /* this should make the PBF flag as Last Fragment */
-        nfc_hal_cb.ncit_cb.p_frag_msg  = NULL;
 
         p_msg->layer_specific = nfc_hal_cb.ncit_cb.nci_ras;
         /* still report the data packet, if the incoming packet is too big */
@@ -195,7 +263,7 @@ static BOOLEAN nfc_hal_nci_receive_nci_msg (tNFC_HAL_NCIT_CB *p_cb, UINT8 byte)
             /* Initialize NFC_HDR */
             p_cb->p_rcv_msg->len    = 0;
             p_cb->p_rcv_msg->event  = 0;
-            p_cb->p_rcv_msg->offset = 0;
+            p_cb->p_rcv_msg->offset = NFC_HAL_NCI_RECEIVE_OFFSET;
 
             *((UINT8 *) (p_cb->p_rcv_msg + 1) + p_cb->p_rcv_msg->offset + p_cb->p_rcv_msg->len++) = byte;
         }
@@ -513,6 +581,103 @@ BOOLEAN nfc_hal_nci_receive_msg (UINT8 byte)
     return (msg_received);
 }
 
+/*****************************************************************************
+**
+** Function         nfc_hal_nci_receive_buf
+**
+** Description
+**      Bulk version of nfc_hal_nci_receive_msg() for a buffer read from the
+**      serial port. Packet type and header bytes go through the same state
+**      machine, so a message split across buffers is continued where the
+**      previous buffer left off. Payload runs are copied with memcpy, and a
+**      buffer holding exactly one NCI packet becomes the received message
+**      without any copy. BT messages are processed as they complete.
+**
+**      Returns after each complete NCI message, which is left in
+**      nfc_hal_cb.ncit_cb.p_rcv_msg; call again for the rest of the buffer.
+**      *pp_buf is set to NULL once the buffer has been used up.
+**
+** Returns          TRUE, if an NCI message has been received
+**
+*****************************************************************************/
+BOOLEAN nfc_hal_nci_receive_buf (NFC_HDR **pp_buf)
+{
+    tNFC_HAL_NCIT_CB *p_cb = &(nfc_hal_cb.ncit_cb);
+    NFC_HDR *p_buf = *pp_buf;
+    UINT8   *p;
+    UINT16  len;
+    BOOLEAN msg_received = FALSE;
+
+    while ((p_buf->len > 0) && (!msg_received))
+    {
+        p = (UINT8 *) (p_buf + 1) + p_buf->offset;
+
+        if (  (p_cb->rcv_state == NFC_HAL_RCV_IDLE_ST)
+            &&(p[0] == HCIT_TYPE_NFC)
+            &&(p_buf->len > NCI_MSG_HDR_SIZE)
+            &&(p_buf->len == 1 + NCI_MSG_HDR_SIZE + p[NCI_MSG_HDR_SIZE])
+            &&(p_buf->offset + 1 >= NFC_HAL_NCI_RECEIVE_OFFSET)  )
+        {
+            /* The buffer holds exactly one NCI packet: strip the packet type and adopt it */
+            p_buf->offset++;
+            p_buf->len--;
+            p_buf->event          = 0;
+            p_buf->layer_specific = 0;
+            p_cb->p_rcv_msg       = p_buf;
+            *pp_buf = NULL;
+            return (TRUE);
+        }
+
+        if (  (p_cb->rcv_state == NFC_HAL_RCV_NCI_PAYLOAD_ST)
+            ||(p_cb->rcv_state == NFC_HAL_RCV_BT_PAYLOAD_ST)  )
+        {
+            /* Copy as much of the payload as this buffer holds */
+            len = (p_buf->len < p_cb->rcv_len) ? p_buf->len : p_cb->rcv_len;
+            if (p_cb->p_rcv_msg)
+            {
+                memcpy ((UINT8 *) (p_cb->p_rcv_msg + 1) + p_cb->p_rcv_msg->offset + p_cb->p_rcv_msg->len, p, len);
+                p_cb->p_rcv_msg->len += len;
+            }
+            p_buf->offset  += len;
+            p_buf->len     -= len;
+            p_cb->rcv_len  -= len;
+
+            if (p_cb->rcv_len == 0)
+            {
+                if (p_cb->rcv_state == NFC_HAL_RCV_NCI_PAYLOAD_ST)
+                {
+                    p_cb->rcv_state = NFC_HAL_RCV_IDLE_ST;
+                    msg_received    = TRUE;
+                }
+                else
+                {
+                    p_cb->rcv_state = NFC_HAL_RCV_IDLE_ST;
+#if (NFC_HAL_TRACE_PROTOCOL == TRUE)
+                    if (p_cb->p_rcv_msg)
+                        DispHciEvt (p_cb->p_rcv_msg);
+#endif
+                    nfc_hal_nci_proc_rx_bt_msg ();
+                }
+            }
+        }
+        else
+        {
+            /* Packet type and header bytes: a few per message, not worth a bulk path */
+            p_buf->offset++;
+            p_buf->len--;
+            msg_received = nfc_hal_nci_receive_msg (*p);
+        }
+    }
+
+    if (p_buf->len == 0)
+    {
+        GKI_freebuf (p_buf);
+        *pp_buf = NULL;
+    }
+
+    return (msg_received);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_nci_preproc_rx_nci_msg
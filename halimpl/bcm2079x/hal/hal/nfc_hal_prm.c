@@ -67,6 +67,7 @@ const tNFC_HAL_PRM_RM_RF nfc_hal_prm_rm_rf_20795a1 [] =
     {0,         0}
 };
 static BOOLEAN nfc_hal_prm_nvm_rw_cmd(void);
+void nfc_hal_prm_spd_send_next_segment (void);
 
 /*****************************************************************************
 ** Extern variable from nfc_hal_dm_cfg.c
@@ -86,11 +87,142 @@ void nfc_hal_prm_spd_handle_download_complete (UINT8 event)
 {
     nfc_hal_cb.prm.state = NFC_HAL_PRM_ST_IDLE;
 
+    /* Responses still owed for pipelined segments are dropped */
+    nfc_hal_cb.prm.spd_in_flight = 0;
+
     /* Notify application now */
     if (nfc_hal_cb.prm.p_cback)
         (nfc_hal_cb.prm.p_cback) (event);
 }
 
+/*******************************************************************************
+**
+** Function         nfc_hal_prm_spd_is_pipelined
+**
+** Description      Check if an SPD segment may be sent before the responses to
+**                  the segments already sent. Only data segments of a patch in
+**                  a single buffer are; the header and the signature are always
+**                  sent alone. The NFCC must be in full power mode, since
+**                  nfc_hal_nci_send_cmd() can hold back only one message
+**                  while it wakes up.
+**
+** Returns          TRUE if the segment can be pipelined
+**
+*******************************************************************************/
+static BOOLEAN nfc_hal_prm_spd_is_pipelined (UINT8 oid, UINT8 type)
+{
+    return (  (nfc_hal_cb.prm.spd_window > 1)
+            &&(nfc_hal_cb.dev_cb.power_mode == NFC_HAL_POWER_MODE_FULL)
+            &&(nfc_hal_cb.prm.flags & NFC_HAL_PRM_FLAGS_USE_PATCHRAM_BUF)
+            &&(oid == NCI_MSG_SECURE_PATCH_DOWNLOAD)
+            &&(type != NCI_SPD_TYPE_HEADER)
+            &&(type != NCI_SPD_TYPE_SIGNATURE)  );
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_prm_spd_next_is_pipelined
+**
+** Description      Check if the next segment in the patch buffer can be sent
+**                  while responses are outstanding
+**
+** Returns          TRUE if the next segment can be pipelined
+**
+*******************************************************************************/
+static BOOLEAN nfc_hal_prm_spd_next_is_pipelined (void)
+{
+    const UINT8 *p = nfc_hal_cb.prm.p_cur_patch_data + nfc_hal_cb.prm.cur_patch_offset;
+
+    /* HCIT, NCI header and SPD type */
+    if (nfc_hal_cb.prm.cur_patch_len_remaining < NCI_MSG_HDR_SIZE + 2)
+        return FALSE;
+
+    return (nfc_hal_prm_spd_is_pipelined (p[2], p[4]));
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_prm_spd_send_pipelined
+**
+** Description      Send an SPD data segment without taking the NCI command
+**                  window. Its response is matched by the count of segments
+**                  in flight. The PRM timer is started when the window opens
+**                  and restarted by each response, so it always covers the
+**                  oldest segment in flight.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_prm_spd_send_pipelined (const UINT8 *p_data, UINT16 len)
+{
+    NFC_HDR *p_buf;
+
+    if ((p_buf = (NFC_HDR *) GKI_getpoolbuf (NFC_HAL_NCI_POOL_ID)) == NULL)
+    {
+        HAL_TRACE_ERROR0 ("nfc_hal_prm_spd_send_pipelined (): out of buffers");
+        nfc_hal_prm_spd_handle_download_complete (NFC_HAL_PRM_ABORT_EVT);
+        return;
+    }
+
+    p_buf->offset = NFC_HAL_NCI_MSG_OFFSET_SIZE;
+    p_buf->event  = NFC_HAL_EVT_TO_NFC_NCI;
+    p_buf->len    = len;
+    memcpy ((UINT8 *) (p_buf + 1) + p_buf->offset, p_data, len);
+
+    if (nfc_hal_cb.prm.spd_in_flight++ == 0)
+    {
+        nfc_hal_main_start_quick_timer (&nfc_hal_cb.prm.timer, 0x00,
+                                        (NFC_HAL_PRM_SPD_TOUT * QUICK_TIMER_TICKS_PER_SEC) / 1000);
+    }
+    nfc_hal_nci_send_cmd (p_buf);
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_prm_spd_fill_window
+**
+** Description      Send the next patch segment, then as many further data
+**                  segments as the SPD window allows
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_prm_spd_fill_window (void)
+{
+    nfc_hal_prm_spd_send_next_segment ();
+
+    while (  (nfc_hal_cb.prm.state == NFC_HAL_PRM_ST_SPD_DOWNLOADING)
+           &&(nfc_hal_cb.prm.spd_in_flight > 0)
+           &&(nfc_hal_cb.prm.spd_in_flight < nfc_hal_cb.prm.spd_window)
+           &&(nfc_hal_prm_spd_next_is_pipelined ())  )
+    {
+        nfc_hal_prm_spd_send_next_segment ();
+    }
+}
+
+/*******************************************************************************
+**
+** Function         nfc_hal_prm_spd_report_throughput
+**
+** Description      Log how fast the current patch was sent, from the start of
+**                  the patch to the response to its signature
+**
+** Returns          void
+**
+*******************************************************************************/
+static void nfc_hal_prm_spd_report_throughput (void)
+{
+    UINT32 elapsed_ms = GKI_OS_TICKS_TO_MS (GKI_get_os_tick_count () - nfc_hal_cb.prm.spd_start_ticks);
+
+    if (elapsed_ms == 0)
+        elapsed_ms = 1;
+
+    HAL_TRACE_DEBUG4 ("Patch sent: %u bytes in %u ms (%u bytes/s, window %u)",
+                      nfc_hal_cb.prm.spd_bytes_sent, elapsed_ms,
+                      (UINT32) (((UINT64) nfc_hal_cb.prm.spd_bytes_sent * 1000) / elapsed_ms),
+                      nfc_hal_cb.prm.spd_window);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_hal_prm_spd_send_next_segment
@@ -163,9 +295,18 @@ void nfc_hal_prm_spd_send_next_segment (void)
         }
     }
 
+    nfc_hal_cb.prm.spd_bytes_sent += len + NCI_MSG_HDR_SIZE;
+
     /* Send the command (not including HCIT here) */
-    nfc_hal_dm_send_nci_cmd ((UINT8*) (nfc_hal_cb.prm.p_cur_patch_data + offset + 1), (UINT8) (len + NCI_MSG_HDR_SIZE),
-                             nfc_hal_prm_nci_command_complete_cback);
+    if (nfc_hal_prm_spd_is_pipelined (oid, type))
+    {
+        nfc_hal_prm_spd_send_pipelined (nfc_hal_cb.prm.p_cur_patch_data + offset + 1, (UINT16) (len + NCI_MSG_HDR_SIZE));
+    }
+    else
+    {
+        nfc_hal_dm_send_nci_cmd ((UINT8*) (nfc_hal_cb.prm.p_cur_patch_data + offset + 1), (UINT8) (len + NCI_MSG_HDR_SIZE),
+                                 nfc_hal_prm_nci_command_complete_cback);
+    }
 }
 
 /*******************************************************************************
@@ -225,6 +366,8 @@ void nfc_hal_prm_spd_handle_next_patch_start (void)
     /* Begin downloading patch */
     HAL_TRACE_DEBUG1 ("Downloading patch for power_mode %i.", nfc_hal_cb.prm.spd_patch_desc[nfc_hal_cb.prm.spd_cur_patch_idx].power_mode);
     nfc_hal_cb.prm.state = NFC_HAL_PRM_ST_SPD_DOWNLOADING;
+    nfc_hal_cb.prm.spd_start_ticks = GKI_get_os_tick_count ();
+    nfc_hal_cb.prm.spd_bytes_sent  = 0;
     nfc_hal_prm_spd_send_next_segment ();
 }
 
@@ -530,6 +673,10 @@ void nfc_hal_prm_spd_check_version (void)
                               nfc_hal_cb.nvm_cb.ver_major, nfc_hal_cb.nvm_cb.ver_minor);
             firstTime = FALSE;
         }
+        /* NVM version in nvm_cb is the one the NFCC runs */
+        if (return_code == NFC_HAL_PRM_COMPLETE_EVT)
+            nfc_hal_cb.prm.spd_up_to_date = TRUE;
+
         /* Download complete */
         nfc_hal_prm_spd_handle_download_complete (return_code);
     }
@@ -679,6 +826,9 @@ void nfc_hal_prm_nci_command_complete_cback (tNFC_HAL_NCI_EVT event, UINT16 data
         STREAM_TO_UINT8 (status, p);
         STREAM_TO_UINT8 (u8, p);
 
+        if (nfc_hal_cb.prm.spd_in_flight)
+            nfc_hal_cb.prm.spd_in_flight--;
+
         if (status != NCI_STATUS_OK)
         {
 #if (NFC_HAL_TRACE_VERBOSE == TRUE)
@@ -692,9 +842,18 @@ void nfc_hal_prm_nci_command_complete_cback (tNFC_HAL_NCI_EVT event, UINT16 data
             return;
         }
 
+        /* The PRM timer now covers the oldest segment still in flight */
+        if (nfc_hal_cb.prm.spd_in_flight)
+        {
+            nfc_hal_main_start_quick_timer (&nfc_hal_cb.prm.timer, 0x00,
+                                            (NFC_HAL_PRM_SPD_TOUT * QUICK_TIMER_TICKS_PER_SEC) / 1000);
+        }
+
         /* If last segment (SIGNATURE) sent */
         if (nfc_hal_cb.prm.flags & NFC_HAL_PRM_FLAGS_SIGNATURE_SENT)
         {
+            nfc_hal_prm_spd_report_throughput ();
+
             /* Wait for authentication complete (SECURE_PATCH_DOWNLOAD NTF), including time to commit to NVM (for BCM43341B0) */
             nfc_hal_cb.prm.state = NFC_HAL_PRM_ST_SPD_AUTHENTICATING;
             nfc_hal_main_start_quick_timer (&nfc_hal_cb.prm.timer, 0x00,
@@ -704,8 +863,15 @@ void nfc_hal_prm_nci_command_complete_cback (tNFC_HAL_NCI_EVT event, UINT16 data
         /* Download next segment */
         else if (nfc_hal_cb.prm.flags & NFC_HAL_PRM_FLAGS_USE_PATCHRAM_BUF)
         {
+            if (  (nfc_hal_cb.prm.spd_in_flight > 0)
+                &&(!nfc_hal_prm_spd_next_is_pipelined ())  )
+            {
+                /* Signature (or end of patch) waits for the segments still in flight */
+                return;
+            }
+
             /* If patch is in a buffer, get next patch from buffer */
-            nfc_hal_prm_spd_send_next_segment ();
+            nfc_hal_prm_spd_fill_window ();
         }
         else
         {
@@ -1013,10 +1179,15 @@ BOOLEAN HAL_NfcPrmDownloadStart (tNFC_HAL_PRM_FORMAT format_type,
                                  UINT32              patchram_delay,
                                  tNFC_HAL_PRM_CBACK  *p_cback)
 {
+    UINT8 spd_window = nfc_hal_cb.prm.spd_window;
+
     HAL_TRACE_API0 ("HAL_NfcPrmDownloadStart ()");
 
     memset (&nfc_hal_cb.prm, 0, sizeof (tNFC_HAL_PRM_CB));
 
+    /* Keep the window set by HAL_NfcPrmSetSpdWindow */
+    nfc_hal_cb.prm.spd_window = (spd_window) ? spd_window : NFC_HAL_PRM_SPD_WINDOW;
+
     if (p_patchram_buf)
     {
         nfc_hal_cb.prm.p_cur_patch_data = p_patchram_buf;
@@ -1193,3 +1364,33 @@ tHAL_NFC_STATUS HAL_NfcPrmSetSpdNciCmdPayloadSize (UINT8 max_payload_size)
         return (HAL_NFC_STATUS_OK);
     }
 }
+
+/*******************************************************************************
+**
+** Function         HAL_NfcPrmSetSpdWindow
+**
+** Description      Set the number of patch segments PRM sends ahead of their
+**                  SECURE_PATCH_DOWNLOAD responses during secure patch download.
+**
+**                  This API must be called before calling HAL_NfcPrmDownloadStart.
+**                  If the API is not called, then PRM will use
+**                  NFC_HAL_PRM_SPD_WINDOW.
+**
+**                  Valid window range: 1 to NFC_HAL_PRM_MAX_SPD_WINDOW.
+**
+** Returns          HAL_NFC_STATUS_OK if successful
+**                  HAL_NFC_STATUS_FAILED otherwise
+**
+*******************************************************************************/
+tHAL_NFC_STATUS HAL_NfcPrmSetSpdWindow (UINT8 window)
+{
+    if ((window == 0) || (window > NFC_HAL_PRM_MAX_SPD_WINDOW))
+    {
+        HAL_TRACE_ERROR2 ("HAL_NfcPrmSetSpdWindow: invalid window (%i). Must be between 1 and %i", window, NFC_HAL_PRM_MAX_SPD_WINDOW);
+        return (HAL_NFC_STATUS_FAILED);
+    }
+
+    HAL_TRACE_API1 ("HAL_NfcPrmSetSpdWindow: %i segments in flight during download", window);
+    nfc_hal_cb.prm.spd_window = window;
+    return (HAL_NFC_STATUS_OK);
+}
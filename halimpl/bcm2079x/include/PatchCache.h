@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ * Remember which patch file the controller was last found to be running, so
+ * that a warm start can skip the patch download state machine. The record
+ * holds the patch file's path, size, inode, times and content hash, along
+ * with the hardware ID and the patch information the controller reported in
+ * GET_PATCH_VERSION. It lives next to the HAL's other non-volatile files.
+ ******************************************************************************/
+
+#pragma once
+#include <stddef.h>
+#include "nfc_hal_int.h"
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheIsCurrent
+**
+** Description:     Check if the controller already runs the given patch file.
+**                  The file must be the one recorded (same path and size, and
+**                  either the same inode and times or the same content hash),
+**                  and the controller must report exactly the hardware ID and
+**                  patch information recorded with it. Any other answer from
+**                  the controller deletes the record.
+**                  pPatchFn: patch file name from the .conf file.
+**                  hwId: hardware ID from GET_BUILD_INFO.
+**                  pNvm: patch information from GET_PATCH_VERSION.
+**
+** Returns:         True if the patch download can be skipped.
+**
+*******************************************************************************/
+bool patchCacheIsCurrent (const char* pPatchFn, UINT32 hwId, const tNFC_HAL_NVM* pNvm);
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheSave
+**
+** Description:     Record that the controller runs the given patch file.
+**                  pPatchFn: patch file name from the .conf file.
+**                  pPatch: content of the patch file.
+**                  patchLen: size of the patch file.
+**                  hwId: hardware ID from GET_BUILD_INFO.
+**                  pNvm: patch information from GET_PATCH_VERSION.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void patchCacheSave (const char* pPatchFn, const void* pPatch, size_t patchLen, UINT32 hwId, const tNFC_HAL_NVM* pNvm);
+
+
+/*******************************************************************************
+**
+** Function:        patchCacheDelete
+**
+** Description:     Forget the recorded patch, so the next start runs the
+**                  full patch download state machine.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void patchCacheDelete ();
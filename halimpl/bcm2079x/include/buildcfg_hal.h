@@ -20,6 +20,21 @@
 
 #include "bt_types.h"
 
+#ifdef NFC_HAL_SHARED_GKI
+//the HAL runs on the GKI instance of libnfc-nci, so the task, pool and GKI settings are the
+//stack's own (buildcfg.h, gki_target.h and nfc_target.h under src/include); NCI messages use
+//the stack's NCI pool so that they can be sent to NFC_TASK as they are
+#undef LOGMSG_TAG_NAME
+#include "../../../src/include/nfc_target.h"
+#undef LOGMSG_TAG_NAME
+#define LOGMSG_TAG_NAME "NfcNciHal"  //as in the HAL's buildcfg.h, not the stack's
+
+#define NFC_HAL_TASK  NCIT_TASK  //execute the Broadcom HAL
+#define USERIAL_HAL_TASK  HCISU_TASK  //execute userial's read thread
+
+//NFC_TASK reserves NFC_RECEIVE_MSGS_OFFSET in front of the NCI packets it receives
+#define NFC_HAL_NCI_RECEIVE_OFFSET  NFC_RECEIVE_MSGS_OFFSET
+#else
 //NFC_HAL_TASK=0 is already defined in gki_hal_target.h; it executes the Broadcom HAL
 #define USERIAL_HAL_TASK  1  //execute userial's read thread
 #define GKI_RUNNER_HAL_TASK 2  //execute GKI_run(), which runs forever
@@ -27,5 +42,6 @@
 
 #define GKI_BUF0_MAX                16
 #define GKI_BUF1_MAX                16
+#endif
 
 #define NFC_HAL_PRM_POST_I2C_FIX_DELAY (500)
@@ -236,6 +236,38 @@ typedef union
 /* callback for events */
 typedef void (tUSERIAL_CBACK)(tUSERIAL_PORT, tUSERIAL_EVT, tUSERIAL_EVT_DATA *);
 
+/* one packet of a vectored write */
+typedef struct
+{
+    UINT8   *p_data;
+    UINT16  len;
+} tUSERIAL_IOV;
+
+/* maximum number of packets in one vectored write */
+#ifndef USERIAL_MAX_IOV
+#define USERIAL_MAX_IOV           16
+#endif
+
+/**** Transport latency histograms ****/
+#define USERIAL_PERF_POLL         0     /* waiting for input, in poll() or GKI_wait() with direct reads */
+#define USERIAL_PERF_READ         1     /* read() of received data */
+#define USERIAL_PERF_WRITE        2     /* write() or writev() of packets */
+#define USERIAL_PERF_WRITE_DELAY  3     /* sleep for the inter-write delay */
+#define USERIAL_PERF_POLL_TO_POLL 4     /* from one poll() return to the next */
+#define USERIAL_PERF_NUM_HIST     5
+
+/* bucket 0 counts lapses under 1 us, bucket n lapses of 2^(n-1) to 2^n - 1 us */
+#define USERIAL_PERF_NUM_BUCKETS  24
+
+typedef struct
+{
+    UINT32  count;                              /* number of operations */
+    UINT32  max_us;                             /* longest lapse */
+    UINT64  total_us;                           /* sum of all lapses */
+    UINT64  bytes;                              /* bytes read or written */
+    UINT32  bucket[USERIAL_PERF_NUM_BUCKETS];
+} tUSERIAL_PERF_HIST;
+
 /*******************************************************************************
 ** Function Prototypes
 *******************************************************************************/
@@ -250,12 +282,17 @@ UDRV_API extern void    USERIAL_ReadBuf(tUSERIAL_PORT, BT_HDR **);
 UDRV_API extern UINT16  USERIAL_Read(tUSERIAL_PORT, UINT8 *, UINT16);
 UDRV_API extern BOOLEAN USERIAL_WriteBuf(tUSERIAL_PORT, BT_HDR *);
 UDRV_API extern UINT16  USERIAL_Write(tUSERIAL_PORT, UINT8 *, UINT16);
+UDRV_API extern UINT16  USERIAL_WriteV(tUSERIAL_PORT, tUSERIAL_IOV *, UINT8);
 UDRV_API extern void    USERIAL_Ioctl(tUSERIAL_PORT, tUSERIAL_OP, tUSERIAL_IOCTL_DATA *);
 UDRV_API extern void    USERIAL_Close(tUSERIAL_PORT);
 UDRV_API extern BOOLEAN USERIAL_Feature(tUSERIAL_FEATURE);
 UDRV_API extern BOOLEAN USERIAL_IsClosed();
 UDRV_API extern void    USERIAL_SetPowerOffDelays(int,int);
 UDRV_API extern void    USERIAL_PowerupDevice(tUSERIAL_PORT port);
+UDRV_API extern BOOLEAN USERIAL_GetPerfHist(UINT8 id, tUSERIAL_PERF_HIST *p_hist);
+UDRV_API extern UINT32  USERIAL_GetPerfPercentile(UINT8 id, UINT8 percent);
+UDRV_API extern void    USERIAL_ResetPerfHist(void);
+UDRV_API extern void    USERIAL_DumpPerfHist(void);
 
 /*******************************************************************************
  **
@@ -0,0 +1,68 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Transport backends of the Linux userial driver. USERIAL_Open picks the
+ *  first backend that accepts the TRANSPORT_DRIVER name from the config file
+ *  and does all its I/O on the port through that backend's functions.
+ *
+ ******************************************************************************/
+#ifndef USERIAL_TRANSPORT_H
+#define USERIAL_TRANSPORT_H
+
+#include <sys/uio.h>
+#include "userial.h"
+
+/* TRANSPORT_DRIVER prefix selecting a Unix domain stream socket */
+#define USERIAL_SOCKET_PREFIX       "unix:"
+/* TRANSPORT_DRIVER prefix selecting a pseudo terminal */
+#define USERIAL_PTY_PREFIX          "/dev/pts/"
+
+typedef struct
+{
+    const char *name;
+
+    /* TRUE if this backend handles the named device */
+    BOOLEAN (*match) (const char *p_dev);
+
+    /* open the device, returns the file descriptor or -1 */
+    int     (*open) (const char *p_dev);
+
+    /* read or write the open device, as read(2) and writev(2) */
+    int     (*read) (int fd, UINT8 *p_data, int len);
+    int     (*write) (int fd, const struct iovec *p_iov, int count);
+
+    /* close the device opened by open */
+    void    (*close) (int fd);
+
+    /* power the controller up after open, or down before close */
+    void    (*power) (tUSERIAL_PORT port, BOOLEAN on);
+
+    /* TRUE if the device is always a byte stream, so packets are framed
+     * from their header as on a UART */
+    BOOLEAN stream;
+} tUSERIAL_TRANSPORT;
+
+/* bcm2079x kernel driver or UART, in userial_linux.c */
+extern const tUSERIAL_TRANSPORT userial_driver_transport;
+
+/* Unix socket or pty to a software NFCC, in userial_socket.c */
+extern const tUSERIAL_TRANSPORT userial_socket_transport;
+
+#endif /* USERIAL_TRANSPORT_H */
@@ -25,6 +25,7 @@ extern "C"
 }
 #include "config.h"
 #include "android_logmsg.h"
+#include "TaskSched.h"
 
 #define LOG_TAG "NfcAdaptation"
 
@@ -166,6 +167,8 @@ void NfcAdaptation::Initialize ()
 
     GKI_init ();
     GKI_enable ();
+    taskSchedConfigure (BTU_TASK, NAME_NFCA_TASK_SCHED_POLICY, NAME_NFCA_TASK_SCHED_PRIORITY, NAME_NFCA_TASK_CPU_AFFINITY);
+    taskSchedConfigure (NFC_TASK, NAME_NFC_TASK_SCHED_POLICY, NAME_NFC_TASK_SCHED_PRIORITY, NAME_NFC_TASK_CPU_AFFINITY);
     GKI_create_task ((TASKPTR)NFCA_TASK, BTU_TASK, (INT8*)"NFCA_TASK", 0, 0, (pthread_cond_t*)NULL, NULL);
     {
         AutoThreadMutex guard(mCondVar);
@@ -313,6 +316,7 @@ void NfcAdaptation::InitializeHalDeviceContext ()
     mHalEntryFuncs.control_granted = HalControlGranted;
     mHalEntryFuncs.power_cycle = HalPowerCycle;
     mHalEntryFuncs.get_max_ee = HalGetMaxNfcee;
+    mHalEntryFuncs.write_batch = NULL;  // nfc_nci_device_t writes one packet at a time
 
     ret = hw_get_module (nci_hal_module, &hw_module);
     if (ret == 0)
@@ -0,0 +1,79 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#include "OverrideLog.h"
+extern "C"
+{
+    #include "gki.h"
+}
+#include "TaskSched.h"
+#include "config.h"
+#define LOG_TAG "NfcTaskSched"
+
+
+/*******************************************************************************
+**
+** Function:    taskSchedConfigure
+**
+** Description: Read a task's scheduling policy (0=other, 1=FIFO, 2=RR),
+**              priority and CPU affinity mask from the config file and hand
+**              them to GKI. An unknown policy is rejected; a priority is only
+**              used with the FIFO or RR policy, otherwise it is reported and
+**              ignored. Tasks without any valid setting keep GKI's default.
+**
+** Returns:     none
+**
+*******************************************************************************/
+void taskSchedConfigure (UINT8 task_id, const char* policyName, const char* priorityName, const char* cpuName)
+{
+    tGKI_TASK_SCHED sched;
+    unsigned long num;
+    bool found = false;
+
+    GKI_get_task_sched (task_id, &sched);
+    if ( GetNumValue ( policyName, &num, sizeof ( num ) ) )
+    {
+        if ( (num == GKI_SCHED_OTHER) || (num == GKI_SCHED_FIFO) || (num == GKI_SCHED_RR) )
+        {
+            sched.policy = (UINT8) num;
+            found = true;
+        }
+        else
+            ALOGE ("%s: %s=%lu is not a policy (0=other, 1=FIFO, 2=RR); ignored", __FUNCTION__, policyName, num);
+    }
+    if ( GetNumValue ( priorityName, &num, sizeof ( num ) ) )
+    {
+        if ( (sched.policy == GKI_SCHED_FIFO) || (sched.policy == GKI_SCHED_RR) )
+        {
+            sched.priority = (UINT8) num;
+            found = true;
+        }
+        else
+            ALOGE ("%s: %s=%lu needs %s set to 1 (FIFO) or 2 (RR); ignored", __FUNCTION__, priorityName, num, policyName);
+    }
+    if ( GetNumValue ( cpuName, &num, sizeof ( num ) ) )
+    {
+        sched.cpu_mask = (UINT32) num;
+        found = true;
+    }
+    if (!found)
+        return;
+
+    ALOGD ("%s: task %u policy=%u prio=%u cpus=0x%x", __FUNCTION__, task_id, sched.policy, sched.priority, sched.cpu_mask);
+    if (GKI_set_task_sched (task_id, &sched) != GKI_SUCCESS)
+        ALOGE ("%s: task %u scheduling not fully applied", __FUNCTION__, task_id);
+}
@@ -26,13 +26,8 @@
 static void gki_add_to_pool_list(UINT8 pool_id);
 static void gki_remove_from_pool_list(UINT8 pool_id);
 #endif /*  BTU_STACK_LITE_ENABLED == FALSE */
+static void gki_update_pool_lookup(void);
 
-#if GKI_BUFFER_DEBUG
-#define LOG_TAG "GKI_DEBUG"
-#include <android/log.h>
-#include <cutils/log.h>
-#define LOGD(format, ...)  LogMsg (TRACE_CTRL_GENERAL | TRACE_LAYER_GKI | TRACE_ORG_GKI | TRACE_TYPE_GENERIC, format, ## __VA_ARGS__)
-#endif
 /*******************************************************************************
 **
 ** Function         gki_init_free_queue
@@ -70,9 +65,23 @@ static void gki_init_free_queue (UINT8 id, UINT16 size, UINT16 total, void *p_me
     p_cb->freeq[id].total     = total;
     p_cb->freeq[id].cur_cnt   = 0;
     p_cb->freeq[id].max_cnt   = 0;
+    p_cb->freeq[id].cache_cnt = 0;
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    /* Only cache fixed pools, and keep every cache small relative to the pool */
+    p_cb->buf_cache_batch[id] = 0;
+    if (id < GKI_NUM_FIXED_BUF_POOLS)
+    {
+        p_cb->buf_cache_batch[id] = total / 16;
+        if (p_cb->buf_cache_batch[id] > GKI_TASK_BUF_CACHE_SIZE / 2)
+            p_cb->buf_cache_batch[id] = GKI_TASK_BUF_CACHE_SIZE / 2;
+    }
+#endif
 
-#if GKI_BUFFER_DEBUG
-    LOGD("gki_init_free_queue() init pool=%d, size=%d (aligned=%d) total=%d start=%p", id, size, tempsize, total, p_mem);
+#if (GKI_ELASTIC_POOLS == TRUE)
+    /* Each slab grown on demand holds a quarter of the configured buffers */
+    if (id < GKI_NUM_FIXED_BUF_POOLS)
+        p_cb->pool_slab_bufs[id] = (UINT16)((total + 3) / 4);
 #endif
 
     /* Initialize  index table */
@@ -102,36 +111,628 @@ static BOOLEAN gki_alloc_free_queue(UINT8 id)
 {
     FREE_QUEUE_T  *Q;
     tGKI_COM_CB *p_cb = &gki_cb.com;
-    #if GKI_BUFFER_DEBUG
-        ALOGD("\ngki_alloc_free_queue in, id:%d \n", id);
-    #endif
 
-    Q = &p_cb->freeq[p_cb->pool_list[id]];
+    Q = &p_cb->freeq[id];
 
-    if(Q->p_first == 0)
+    /* Only allocate once; an empty free queue may just mean the buffers are cached by tasks */
+    if(p_cb->pool_start[id] == NULL)
     {
         void* p_mem = GKI_os_malloc((Q->size + BUFFER_PADDING_SIZE) * Q->total);
         if(p_mem)
         {
             //re-initialize the queue with allocated memory
-            #if GKI_BUFFER_DEBUG
-                ALOGD("\ngki_alloc_free_queue calling  gki_init_free_queue, id:%d  size:%d, totol:%d\n", id, Q->size, Q->total);
-            #endif
             gki_init_free_queue(id, Q->size, Q->total, p_mem);
-            #if GKI_BUFFER_DEBUG
-                ALOGD("\ngki_alloc_free_queue ret OK, id:%d  size:%d, totol:%d\n", id, Q->size, Q->total);
-            #endif
             return TRUE;
         }
         GKI_exception (GKI_ERROR_BUF_SIZE_TOOBIG, "gki_alloc_free_queue: Not enough memory");
     }
-    #if GKI_BUFFER_DEBUG
-        ALOGD("\ngki_alloc_free_queue out failed, id:%d\n", id);
-    #endif
     return FALSE;
 }
 #endif
 
+/*******************************************************************************
+**
+** Function         gki_count_alloc
+**
+** Description      Internal function to account for a buffer handed out from
+**                  a pool. The counters are updated atomically since the task
+**                  buffer caches allocate without GKI_disable().
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_count_alloc (FREE_QUEUE_T *Q)
+{
+    UINT16 cur = __sync_add_and_fetch (&Q->cur_cnt, 1);
+    UINT16 max;
+
+    while (cur > (max = Q->max_cnt))
+    {
+        if (__sync_bool_compare_and_swap (&Q->max_cnt, max, cur))
+            break;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_count_free
+**
+** Description      Internal function to account for a buffer returned to a pool.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_count_free (FREE_QUEUE_T *Q)
+{
+    UINT16 cur;
+
+    while ((cur = Q->cur_cnt) > 0)
+    {
+        if (__sync_bool_compare_and_swap (&Q->cur_cnt, cur, (UINT16)(cur - 1)))
+            break;
+    }
+}
+
+#if (GKI_BUF_TRACKER == TRUE)
+/*******************************************************************************
+**
+** Function         gki_buf_site_alloc
+**
+** Description      Internal function to charge a buffer handed out to the call
+**                  site that requested it. The counters are updated atomically
+**                  like the pool counters, so no lock is taken.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_buf_site_alloc (BUFFER_HDR_T *p_hdr, UINT8 site)
+{
+    BUF_SITE_T *p_site = &gki_cb.com.buf_site[site];
+    UINT16      live;
+    UINT16      max;
+
+    p_hdr->site = site;
+
+    __sync_add_and_fetch (&p_site->allocs, 1);
+    live = __sync_add_and_fetch (&p_site->live, 1);
+
+    while (live > (max = p_site->max_live))
+    {
+        if (__sync_bool_compare_and_swap (&p_site->max_live, max, live))
+            break;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         GKI_register_buf_site
+**
+** Description      Called once per GKI_getbuf()/GKI_getpoolbuf() call site
+**                  (through GKI_BUF_SITE) to get the id the site passes with
+**                  every allocation. When the table is full, the site shares
+**                  the last entry with the other sites that did not fit.
+**
+** Parameters       p_func - (input) function name of the call site
+**                  line   - (input) line number of the call site
+**
+** Returns          the site id, never 0
+**
+*******************************************************************************/
+UINT8 GKI_register_buf_site (const char *p_func, int line)
+{
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+    UINT16       xx;
+
+    GKI_disable();
+
+    /* another task may have registered the same site in the meantime */
+    for (xx = 1; xx < p_cb->num_buf_sites; xx++)
+    {
+        if ((p_cb->buf_site[xx].p_func == p_func) && (p_cb->buf_site[xx].line == (UINT16) line))
+            break;
+    }
+
+    if (xx == p_cb->num_buf_sites)
+    {
+        if (xx < GKI_BUF_TRACKER_MAX_SITES - 1)
+        {
+            p_cb->buf_site[xx].p_func = p_func;
+            p_cb->buf_site[xx].line   = (UINT16) line;
+            p_cb->num_buf_sites++;
+        }
+        else
+        {
+            xx = GKI_BUF_TRACKER_MAX_SITES - 1;
+            p_cb->buf_site[xx].p_func = "(other)";
+            p_cb->num_buf_sites = GKI_BUF_TRACKER_MAX_SITES;
+        }
+    }
+
+    GKI_enable();
+
+    return ((UINT8) xx);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_buf_site_dump
+**
+** Description      Called on demand to log the usage of every buffer pool and
+**                  of every call site that has allocated buffers: buffers
+**                  currently held (live), high-water mark and total number of
+**                  allocations. A site whose live count keeps growing leaks.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_buf_site_dump (void)
+{
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+    BUF_SITE_T  *p_site;
+    UINT16       xx;
+
+    GKI_TRACE_ERROR_0("GKI buffer usage: pool size used max total");
+    for (xx = 0; xx < p_cb->curr_total_no_of_pools; xx++)
+    {
+        GKI_TRACE_ERROR_5("  pool %d: %d %d %d %d", xx, p_cb->freeq[xx].size,
+                          p_cb->freeq[xx].cur_cnt, p_cb->freeq[xx].max_cnt, p_cb->freeq[xx].total);
+    }
+
+    GKI_TRACE_ERROR_0("GKI buffer usage: site live max allocs");
+    for (xx = 0, p_site = p_cb->buf_site; xx < p_cb->num_buf_sites; xx++, p_site++)
+    {
+        if (p_site->allocs)
+        {
+            GKI_TRACE_ERROR_5("  %s:%d %d %d %u", p_site->p_func, p_site->line,
+                              p_site->live, p_site->max_live, p_site->allocs);
+        }
+    }
+}
+#endif
+
+#if (GKI_ELASTIC_POOLS == TRUE)
+/*******************************************************************************
+**
+** Function         gki_slab_reclaim
+**
+** Description      Internal function to give back to the OS the slabs of a pool
+**                  that have been completely free for GKI_ELASTIC_IDLE_TICKS,
+**                  or every completely free slab if force is TRUE.
+**                  Must be called with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_slab_reclaim (UINT8 pool_id, BOOLEAN force)
+{
+    tGKI_COM_CB   *p_cb = &gki_cb.com;
+    BUF_SLAB_T    *p_slab = p_cb->pool_slab[pool_id];
+    UINT8          xx;
+
+    for (xx = 0; xx < GKI_ELASTIC_MAX_SLABS; xx++, p_slab++)
+    {
+        if (  (p_slab->p_start)
+            &&(p_slab->free_cnt == p_cb->pool_slab_bufs[pool_id])
+            &&((force) || ((UINT32)(p_cb->OSTicks - p_slab->idle_since) >= GKI_ELASTIC_IDLE_TICKS))  )
+        {
+            GKI_os_free (p_slab->p_start);
+
+            p_slab->p_start  = NULL;
+            p_slab->p_end    = NULL;
+            p_slab->p_free   = NULL;
+            p_slab->free_cnt = 0;
+
+            p_cb->freeq[pool_id].total -= p_cb->pool_slab_bufs[pool_id];
+            p_cb->pool_num_slabs[pool_id]--;
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_slab_alloc
+**
+** Description      Internal function to take a buffer from the slabs of a fixed
+**                  pool. Lower slabs are used first so that the higher ones can
+**                  go idle. If every slab is in use and 'grow' is TRUE, a slab
+**                  is added unless the pool is at its ceiling.
+**                  Must be called with GKI disabled.
+**
+** Returns          the buffer header, or NULL if none is available
+**
+*******************************************************************************/
+static BUFFER_HDR_T *gki_slab_alloc (UINT8 pool_id, BOOLEAN grow)
+{
+    tGKI_COM_CB   *p_cb = &gki_cb.com;
+    BUF_SLAB_T    *p_slab;
+    BUF_SLAB_T    *p_unused = NULL;
+    BUFFER_HDR_T  *p_hdr;
+    UINT32         act_size;
+    UINT16         i;
+    UINT8          xx;
+
+    /* Only fixed pools grow, and only once their own buffers are allocated */
+    if ((pool_id >= GKI_NUM_FIXED_BUF_POOLS) || (p_cb->pool_start[pool_id] == NULL))
+        return (NULL);
+
+    for (xx = 0, p_slab = p_cb->pool_slab[pool_id]; xx < GKI_ELASTIC_MAX_SLABS; xx++, p_slab++)
+    {
+        if (p_slab->p_free)
+            break;
+
+        if ((p_slab->p_start == NULL) && (p_unused == NULL))
+            p_unused = p_slab;
+    }
+
+    if (xx == GKI_ELASTIC_MAX_SLABS)
+    {
+        if ((!grow) || (p_unused == NULL) || (p_cb->pool_slab_bufs[pool_id] == 0))
+            return (NULL);
+
+        act_size = p_cb->pool_size[pool_id];
+        p_slab   = p_unused;
+
+        if ((p_slab->p_start = (UINT8 *)GKI_os_malloc (act_size * p_cb->pool_slab_bufs[pool_id])) == NULL)
+        {
+            GKI_TRACE_ERROR_1("gki_slab_alloc() fail to grow pool %d", pool_id);
+            return (NULL);
+        }
+
+        p_slab->p_end    = p_slab->p_start + (act_size * p_cb->pool_slab_bufs[pool_id]);
+        p_slab->p_free   = NULL;
+        p_slab->free_cnt = p_cb->pool_slab_bufs[pool_id];
+
+        for (i = 0; i < p_slab->free_cnt; i++)
+        {
+            p_hdr = (BUFFER_HDR_T *)(p_slab->p_start + (act_size * i));
+            p_hdr->task_id = GKI_INVALID_TASK;
+            p_hdr->q_id    = pool_id;
+            p_hdr->status  = BUF_STATUS_FREE;
+            *(UINT32 *)((UINT8 *)p_hdr + BUFFER_HDR_SIZE + p_cb->freeq[pool_id].size) = MAGIC_NO;
+            p_hdr->p_next  = p_slab->p_free;
+            p_slab->p_free = p_hdr;
+        }
+
+        p_cb->freeq[pool_id].total += p_slab->free_cnt;
+        p_cb->pool_num_slabs[pool_id]++;
+    }
+
+    p_hdr = p_slab->p_free;
+    p_slab->p_free = p_hdr->p_next;
+    p_slab->free_cnt--;
+
+    gki_count_alloc (&p_cb->freeq[pool_id]);
+
+    return (p_hdr);
+}
+
+/*******************************************************************************
+**
+** Function         gki_slab_free
+**
+** Description      Internal function to return a buffer to the slab it belongs
+**                  to, if any, then release the idle slabs of its pool.
+**
+** Returns          TRUE if the buffer belonged to a slab
+**
+*******************************************************************************/
+static BOOLEAN gki_slab_free (BUFFER_HDR_T *p_hdr)
+{
+    tGKI_COM_CB   *p_cb = &gki_cb.com;
+    UINT8          pool_id = p_hdr->q_id;
+    BUF_SLAB_T    *p_slab = p_cb->pool_slab[pool_id];
+    UINT8          xx;
+
+    GKI_disable();
+
+    for (xx = 0; xx < GKI_ELASTIC_MAX_SLABS; xx++, p_slab++)
+    {
+        if (((UINT8 *)p_hdr >= p_slab->p_start) && ((UINT8 *)p_hdr < p_slab->p_end))
+            break;
+    }
+
+    if (xx == GKI_ELASTIC_MAX_SLABS)
+    {
+        GKI_enable();
+        return (FALSE);
+    }
+
+    p_hdr->status  = BUF_STATUS_FREE;
+    p_hdr->task_id = GKI_INVALID_TASK;
+    p_hdr->p_next  = p_slab->p_free;
+    p_slab->p_free = p_hdr;
+    gki_count_free (&p_cb->freeq[pool_id]);
+
+    if (++p_slab->free_cnt == p_cb->pool_slab_bufs[pool_id])
+        p_slab->idle_since = p_cb->OSTicks;
+
+    /* OSTicks does not advance while the system tick is stopped */
+    gki_slab_reclaim (pool_id, (BOOLEAN) ((p_cb->p_tick_cb) && (!p_cb->system_tick_running)));
+
+    GKI_enable();
+
+    return (TRUE);
+}
+
+/*******************************************************************************
+**
+** Function         gki_buffer_reclaim_slabs
+**
+** Description      Called from the timer code to give back the idle slabs of
+**                  all pools, so memory is returned even when no more buffers
+**                  are allocated or freed. Must be called with GKI disabled.
+**
+** Parameters       force - TRUE to release every completely free slab
+**                          (system tick stopping), FALSE to release only the
+**                          slabs idle for GKI_ELASTIC_IDLE_TICKS
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_buffer_reclaim_slabs (BOOLEAN force)
+{
+    UINT8   i;
+
+    for (i = 0; i < GKI_NUM_FIXED_BUF_POOLS; i++)
+    {
+        if (gki_cb.com.pool_num_slabs[i])
+            gki_slab_reclaim (i, force);
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_buffer_free_slabs
+**
+** Description      Called at GKI shutdown to free every slab, in use or not.
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_buffer_free_slabs (void)
+{
+    tGKI_COM_CB   *p_cb = &gki_cb.com;
+    BUF_SLAB_T    *p_slab;
+    UINT8          i, xx;
+
+    for (i = 0; i < GKI_NUM_FIXED_BUF_POOLS; i++)
+    {
+        p_slab = p_cb->pool_slab[i];
+
+        for (xx = 0; xx < GKI_ELASTIC_MAX_SLABS; xx++, p_slab++)
+        {
+            if (p_slab->p_start)
+            {
+                GKI_os_free (p_slab->p_start);
+
+                p_slab->p_start  = NULL;
+                p_slab->p_end    = NULL;
+                p_slab->p_free   = NULL;
+                p_slab->free_cnt = 0;
+
+                p_cb->freeq[i].total -= p_cb->pool_slab_bufs[i];
+            }
+        }
+        p_cb->pool_num_slabs[i] = 0;
+    }
+}
+
+#define GKI_POOL_MAY_GROW(id, grow) \
+    ((grow) && ((id) < GKI_NUM_FIXED_BUF_POOLS) && (gki_cb.com.pool_num_slabs[id] < GKI_ELASTIC_MAX_SLABS))
+#else
+#define GKI_POOL_MAY_GROW(id, grow) FALSE
+#endif
+
+/* GKI_getbuf() makes a second pass over the pools, allowing them to grow */
+#if (GKI_ELASTIC_POOLS == TRUE)
+#define GKI_GETBUF_PASSES           2
+#else
+#define GKI_GETBUF_PASSES           1
+#endif
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+/*******************************************************************************
+**
+** Function         gki_get_buf_cache
+**
+** Description      Internal function to find the buffer cache of a task for
+**                  a pool.
+**
+** Returns          pointer to the cache, or NULL if the pool is not cached or
+**                  the caller is not a GKI task
+**
+*******************************************************************************/
+static BUF_CACHE_T *gki_get_buf_cache (UINT8 pool_id, UINT8 task_id)
+{
+    if (  (task_id >= GKI_MAX_TASKS)
+        ||(pool_id >= GKI_NUM_FIXED_BUF_POOLS)
+        ||(gki_cb.com.buf_cache_batch[pool_id] == 0)  )
+        return (NULL);
+
+    return (&gki_cb.com.buf_cache[task_id][pool_id]);
+}
+
+/*******************************************************************************
+**
+** Function         gki_cache_refill
+**
+** Description      Internal function to move up to one batch of free buffers
+**                  from the pool free queue into a task cache.
+**                  Must be called with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_cache_refill (BUF_CACHE_T *p_cache, UINT8 pool_id)
+{
+    FREE_QUEUE_T  *Q = &gki_cb.com.freeq[pool_id];
+    BUFFER_HDR_T  *p_hdr;
+
+    while ((p_cache->count < gki_cb.com.buf_cache_batch[pool_id]) && ((p_hdr = Q->p_first) != NULL))
+    {
+        Q->p_first       = p_hdr->p_next;
+        p_hdr->p_next    = p_cache->p_first;
+        p_cache->p_first = p_hdr;
+        p_cache->count++;
+        __sync_add_and_fetch (&Q->cache_cnt, 1);
+    }
+
+    if (!Q->p_first)
+        Q->p_last = NULL;
+}
+
+/*******************************************************************************
+**
+** Function         gki_cache_drain
+**
+** Description      Internal function to return buffers from a task cache to
+**                  the tail of the pool free queue until only 'keep' remain.
+**                  Must be called with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_cache_drain (BUF_CACHE_T *p_cache, UINT8 pool_id, UINT16 keep)
+{
+    FREE_QUEUE_T  *Q = &gki_cb.com.freeq[pool_id];
+    BUFFER_HDR_T  *p_hdr;
+
+    while ((p_cache->count > keep) && ((p_hdr = p_cache->p_first) != NULL))
+    {
+        p_cache->p_first = p_hdr->p_next;
+        p_cache->count--;
+        __sync_sub_and_fetch (&Q->cache_cnt, 1);
+
+        p_hdr->p_next = NULL;
+        if (Q->p_last)
+            Q->p_last->p_next = p_hdr;
+        else
+            Q->p_first = p_hdr;
+        Q->p_last = p_hdr;
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_buffer_flush_task_cache
+**
+** Description      Called internally by GKI when a task exits, to return all
+**                  buffers cached by the task to the pool free queues.
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_buffer_flush_task_cache (UINT8 task_id)
+{
+    UINT8 pool_id;
+
+    if (task_id >= GKI_MAX_TASKS)
+        return;
+
+    GKI_disable();
+
+    for (pool_id = 0; pool_id < GKI_NUM_FIXED_BUF_POOLS; pool_id++)
+        gki_cache_drain (&gki_cb.com.buf_cache[task_id][pool_id], pool_id, 0);
+
+    GKI_enable();
+}
+#else
+void gki_buffer_flush_task_cache (UINT8 task_id)
+{
+    (void) task_id;
+}
+#endif
+
+/*******************************************************************************
+**
+** Function         gki_alloc_buf
+**
+** Description      Internal function to take a free buffer out of a pool. The
+**                  calling task's cache is used first; only when it is empty is
+**                  GKI disabled to refill it (or to dequeue directly from an
+**                  uncached pool). With elastic pools, the pool's slabs are
+**                  used next, and a slab is added if 'grow' is TRUE.
+**
+** Returns          the buffer header, or NULL if the pool has no free buffer
+**
+*******************************************************************************/
+static BUFFER_HDR_T *gki_alloc_buf (UINT8 pool_id, UINT8 task_id, BOOLEAN grow)
+{
+    FREE_QUEUE_T  *Q = &gki_cb.com.freeq[pool_id];
+    BUFFER_HDR_T  *p_hdr = NULL;
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    BUF_CACHE_T   *p_cache = gki_get_buf_cache (pool_id, task_id);
+
+    if (p_cache && p_cache->p_first)
+    {
+        p_hdr = p_cache->p_first;
+        p_cache->p_first = p_hdr->p_next;
+        p_cache->count--;
+        __sync_sub_and_fetch (&Q->cache_cnt, 1);
+
+        gki_count_alloc (Q);
+        return (p_hdr);
+    }
+#else
+    (void) task_id;
+#endif
+
+    /* No free buffer anywhere, cached or not; don't bother taking the lock */
+    if ((Q->cur_cnt >= Q->total) && (!GKI_POOL_MAY_GROW (pool_id, grow)))
+        return (NULL);
+
+    GKI_disable();
+
+    if (Q->cur_cnt < Q->total)
+    {
+#ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
+        if (gki_cb.com.pool_start[pool_id] == NULL)
+            gki_alloc_free_queue (pool_id);
+#endif
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+        if (p_cache)
+        {
+            gki_cache_refill (p_cache, pool_id);
+
+            if ((p_hdr = p_cache->p_first) != NULL)
+            {
+                p_cache->p_first = p_hdr->p_next;
+                p_cache->count--;
+                __sync_sub_and_fetch (&Q->cache_cnt, 1);
+            }
+        }
+        else
+#endif
+        if ((p_hdr = Q->p_first) != NULL)
+        {
+            Q->p_first = p_hdr->p_next;
+
+            if (!Q->p_first)
+                Q->p_last = NULL;
+        }
+
+        if (p_hdr)
+            gki_count_alloc (Q);
+        else if (gki_cb.com.pool_start[pool_id] == NULL)
+        {
+            /* gki_alloc_free_queue() failed to alloc memory */
+            GKI_TRACE_ERROR_1("gki_alloc_buf() fail alloc free queue %d", pool_id);
+        }
+    }
+
+#if (GKI_ELASTIC_POOLS == TRUE)
+    if (p_hdr == NULL)
+        p_hdr = gki_slab_alloc (pool_id, grow);
+    else if ((pool_id < GKI_NUM_FIXED_BUF_POOLS) && (gki_cb.com.pool_num_slabs[pool_id]))
+        gki_slab_reclaim (pool_id, FALSE);  /* the pool's own buffers suffice again */
+#endif
+
+    GKI_enable();
+
+    return (p_hdr);
+}
+
 /*******************************************************************************
 **
 ** Function         gki_buffer_init
@@ -147,14 +748,29 @@ void gki_buffer_init(void)
     UINT8   i, tt, mb;
     tGKI_COM_CB *p_cb = &gki_cb.com;
 
+#if (GKI_BUF_TRACKER == TRUE)
+    /* Site 0 accounts for allocations made without a call site */
+    memset (p_cb->buf_site, 0, sizeof (p_cb->buf_site));
+    p_cb->buf_site[0].p_func = "(untracked)";
+    p_cb->num_buf_sites = 1;
+#endif
+
     /* Initialize mailboxes */
     for (tt = 0; tt < GKI_MAX_TASKS; tt++)
     {
         for (mb = 0; mb < NUM_TASK_MBOX; mb++)
         {
             p_cb->OSTaskQFirst[tt][mb] = NULL;
-            p_cb->OSTaskQLast [tt][mb] = NULL;
+            p_cb->OSTaskQIn   [tt][mb] = NULL;
+        }
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+        for (i = 0; i < GKI_NUM_FIXED_BUF_POOLS; i++)
+        {
+            p_cb->buf_cache[tt][i].p_first = NULL;
+            p_cb->buf_cache[tt][i].count   = 0;
         }
+#endif
     }
 
     for (tt = 0; tt < GKI_NUM_TOTAL_BUF_POOLS; tt++)
@@ -315,9 +931,60 @@ void gki_buffer_init(void)
 
     p_cb->curr_total_no_of_pools = GKI_NUM_FIXED_BUF_POOLS;
 
+    gki_update_pool_lookup();
+
     return;
 }
 
+/*******************************************************************************
+**
+** Function         gki_update_pool_lookup
+**
+** Description      Internal function to rebuild the tables GKI_getbuf uses to
+**                  select a pool: the size bucket to pool_list index table and
+**                  the mask of public pools in pool_list order. Called whenever
+**                  the pool list or pool permissions change.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_update_pool_lookup(void)
+{
+    tGKI_COM_CB *p_cb = &gki_cb.com;
+    UINT8        i, b;
+    UINT16       lowest;
+
+    p_cb->pool_size_max         = 0;
+    p_cb->pool_public_list_mask = 0;
+
+    for (i = 0; i < p_cb->curr_total_no_of_pools; i++)
+    {
+        if (p_cb->freeq[p_cb->pool_list[i]].size > p_cb->pool_size_max)
+            p_cb->pool_size_max = p_cb->freeq[p_cb->pool_list[i]].size;
+
+        if (!(((UINT16)1 << p_cb->pool_list[i]) & p_cb->pool_access_mask))
+            p_cb->pool_public_list_mask |= (UINT16)(1 << i);
+    }
+
+    /* Pick the bucket width so that the largest pool size falls in the table */
+    p_cb->pool_size_lut_shift = 0;
+    while (p_cb->pool_size_max && (((p_cb->pool_size_max - 1) >> p_cb->pool_size_lut_shift) >= GKI_POOL_SIZE_LUT_ENTRIES))
+        p_cb->pool_size_lut_shift++;
+
+    /* Each bucket holds the first pool that fits the smallest size in the bucket */
+    for (b = 0; b < GKI_POOL_SIZE_LUT_ENTRIES; b++)
+    {
+        lowest = (UINT16)((b << p_cb->pool_size_lut_shift) + 1);
+
+        for (i = 0; i < p_cb->curr_total_no_of_pools; i++)
+        {
+            if (lowest <= p_cb->freeq[p_cb->pool_list[i]].size)
+                break;
+        }
+        p_cb->pool_size_lut[b] = i;
+    }
+}
+
 
 /*******************************************************************************
 **
@@ -353,19 +1020,18 @@ void GKI_init_q (BUFFER_Q *p_q)
 ** Returns          A pointer to the buffer, or NULL if none available
 **
 *******************************************************************************/
-#if GKI_BUFFER_DEBUG
-void *GKI_getbuf_debug (UINT16 size, const char * _function_, int _line_)
+#if (GKI_BUF_TRACKER == TRUE)
+void *GKI_getbuf_site (UINT16 size, UINT8 site)
 #else
 void *GKI_getbuf (UINT16 size)
 #endif
 {
     UINT8         i;
-    FREE_QUEUE_T  *Q;
+    UINT8         task_id;
+    UINT8         pass;
+    UINT16        candidates;
     BUFFER_HDR_T  *p_hdr;
     tGKI_COM_CB *p_cb = &gki_cb.com;
-#if GKI_BUFFER_DEBUG
-    UINT8         x;
-#endif
 
     if (size == 0)
     {
@@ -373,112 +1039,58 @@ void *GKI_getbuf (UINT16 size)
         return (NULL);
     }
 
-#if GKI_BUFFER_DEBUG
-    LOGD("GKI_getbuf() requesting %d func:%s(line=%d)", size, _function_, _line_);
-#endif
-    /* Find the first buffer pool that is public that can hold the desired size */
-    for (i=0; i < p_cb->curr_total_no_of_pools; i++)
-    {
-        if ( size <= p_cb->freeq[p_cb->pool_list[i]].size )
-            break;
-    }
-
-    if(i == p_cb->curr_total_no_of_pools)
+    /* Find the first buffer pool that can hold the desired size. The lookup table
+     * gives the first candidate for the size bucket; step past any pool in the
+     * same bucket that is still too small */
+    if (  (size > p_cb->pool_size_max)
+        ||((i = p_cb->pool_size_lut[(size - 1) >> p_cb->pool_size_lut_shift]) >= p_cb->curr_total_no_of_pools)  )
     {
         GKI_exception (GKI_ERROR_BUF_SIZE_TOOBIG, "getbuf: Size is too big");
         return (NULL);
     }
 
-    /* Make sure the buffers aren't disturbed til finished with allocation */
-    GKI_disable();
+    while (size > p_cb->freeq[p_cb->pool_list[i]].size)
+        i++;
+
+    task_id = GKI_get_taskid();
 
     /* search the public buffer pools that are big enough to hold the size
-     * until a free buffer is found */
-    for ( ; i < p_cb->curr_total_no_of_pools; i++)
+     * until a free buffer is found (RESTRICTED pools are not in the mask).
+     * Pools are only grown on the second pass, once none of them has a free
+     * buffer left */
+    for (pass = 0; pass < GKI_GETBUF_PASSES; pass++)
     {
-        /* Only look at PUBLIC buffer pools (bypass RESTRICTED pools) */
-        if (((UINT16)1 << p_cb->pool_list[i]) & p_cb->pool_access_mask)
-            continue;
+        candidates = (UINT16)(p_cb->pool_public_list_mask & (0xFFFF << i));
 
-        Q = &p_cb->freeq[p_cb->pool_list[i]];
-        if(Q->cur_cnt < Q->total)
+        while (candidates)
         {
-        #ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
-            if(Q->p_first == 0 && gki_alloc_free_queue(i) != TRUE)
-            {
-                GKI_TRACE_ERROR_0("GKI_getbuf() out of buffer");
-                GKI_enable();
-                return NULL;
-            }
-        #endif
+            UINT8 xx = (UINT8)(__builtin_ffs (candidates) - 1);
+            candidates &= (UINT16)~(1 << xx);
 
-            if(Q->p_first == 0)
+            if ((p_hdr = gki_alloc_buf (p_cb->pool_list[xx], task_id, (BOOLEAN)(pass != 0))) != NULL)
             {
-                /* gki_alloc_free_queue() failed to alloc memory */
-                GKI_TRACE_ERROR_0("GKI_getbuf() fail alloc free queue");
-                GKI_enable();
-                return NULL;
-            }
-
-            p_hdr = Q->p_first;
-            Q->p_first = p_hdr->p_next;
-
-            if (!Q->p_first)
-                Q->p_last = NULL;
-
-            if(++Q->cur_cnt > Q->max_cnt)
-                Q->max_cnt = Q->cur_cnt;
-
-            GKI_enable();
-
-            p_hdr->task_id = GKI_get_taskid();
+                p_hdr->task_id = task_id;
 
-            p_hdr->status  = BUF_STATUS_UNLINKED;
-            p_hdr->p_next  = NULL;
-            p_hdr->Type    = 0;
-#if GKI_BUFFER_DEBUG
-            LOGD("GKI_getbuf() allocated, %x, %x (%d of %d used) %d", (UINT8*)p_hdr + BUFFER_HDR_SIZE, p_hdr, Q->cur_cnt, Q->total, p_cb->freeq[i].total);
-
-            strncpy(p_hdr->_function, _function_, _GKI_MAX_FUNCTION_NAME_LEN);
-            p_hdr->_function[_GKI_MAX_FUNCTION_NAME_LEN] = '\0';
-            p_hdr->_line = _line_;
+                p_hdr->status  = BUF_STATUS_UNLINKED;
+                p_hdr->p_next  = NULL;
+                p_hdr->p_seg   = NULL;
+#if (GKI_BUF_TRACKER == TRUE)
+                gki_buf_site_alloc (p_hdr, site);
+#else
+                p_hdr->site    = 0;
 #endif
-            return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
+                return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
+            }
         }
     }
 
     GKI_TRACE_ERROR_0("GKI_getbuf() unable to allocate buffer!!!!!");
-#if GKI_BUFFER_DEBUG
-    LOGD("GKI_getbuf() unable to allocate buffer!!!!!");
-    LOGD("******************** GKI Memory Pool Dump ********************");
-
-    p_cb = &gki_cb.com;
-
-    LOGD("Dumping total of %d buffer pools", p_cb->curr_total_no_of_pools);
-
-    for (i=0 ; i < p_cb->curr_total_no_of_pools; i++)
-    {
-        p_hdr = (BUFFER_HDR_T *)p_cb->pool_start[i];
-
-        LOGD("pool %d has a total of %d buffers (start=%p)", i, p_cb->freeq[i].total, p_hdr);
-
-        for (x=0; p_hdr && x < p_cb->freeq[i].total; x++)
-        {
-            if (p_hdr->status != BUF_STATUS_FREE)
-            {
-                LOGD("pool:%d, buf[%d]:%x, hdr:%x status=%d func:%s(line=%d)", i, x, (UINT8*)p_hdr + BUFFER_HDR_SIZE, p_hdr, p_hdr->status, p_hdr->_function, p_hdr->_line);
-            }
-
-            p_hdr = (BUFFER_HDR_T *)((UINT8 *)p_hdr + p_cb->pool_size[i]);
-        }
-    }
-    LOGD("**************************************************************");
+#if (GKI_BUF_TRACKER == TRUE)
+    GKI_TRACE_ERROR_2("GKI_getbuf() failed for %s line %d", gki_cb.com.buf_site[site].p_func, gki_cb.com.buf_site[site].line);
 #endif
 
     GKI_TRACE_ERROR_0("Failed to allocate GKI buffer");
 
-    GKI_enable();
-
     return (NULL);
 }
 
@@ -498,74 +1110,40 @@ void *GKI_getbuf (UINT16 size)
 ** Returns          A pointer to the buffer, or NULL if none available
 **
 *******************************************************************************/
-#if GKI_BUFFER_DEBUG
-void *GKI_getpoolbuf_debug (UINT8 pool_id, const char * _function_, int _line_)
+#if (GKI_BUF_TRACKER == TRUE)
+void *GKI_getpoolbuf_site (UINT8 pool_id, UINT8 site)
 #else
 void *GKI_getpoolbuf (UINT8 pool_id)
 #endif
 {
-    FREE_QUEUE_T  *Q;
+    UINT8         task_id;
     BUFFER_HDR_T  *p_hdr;
     tGKI_COM_CB *p_cb = &gki_cb.com;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (NULL);
 
-#if GKI_BUFFER_DEBUG
-    LOGD("GKI_getpoolbuf() requesting from %d func:%s(line=%d)", pool_id, _function_, _line_);
-#endif
-    /* Make sure the buffers aren't disturbed til finished with allocation */
-    GKI_disable();
+    task_id = GKI_get_taskid();
 
-    Q = &p_cb->freeq[pool_id];
-    if(Q->cur_cnt < Q->total)
+    if ((p_hdr = gki_alloc_buf (pool_id, task_id, TRUE)) != NULL)
     {
-#ifdef GKI_USE_DEFERED_ALLOC_BUF_POOLS
-        if(Q->p_first == 0 && gki_alloc_free_queue(pool_id) != TRUE)
-            return NULL;
-#endif
-
-        if(Q->p_first == 0)
-        {
-            /* gki_alloc_free_queue() failed to alloc memory */
-            GKI_TRACE_ERROR_0("GKI_getpoolbuf() fail alloc free queue");
-            return NULL;
-        }
-
-        p_hdr = Q->p_first;
-        Q->p_first = p_hdr->p_next;
-
-        if (!Q->p_first)
-            Q->p_last = NULL;
-
-        if(++Q->cur_cnt > Q->max_cnt)
-            Q->max_cnt = Q->cur_cnt;
-
-        GKI_enable();
-
-
-        p_hdr->task_id = GKI_get_taskid();
+        p_hdr->task_id = task_id;
 
         p_hdr->status  = BUF_STATUS_UNLINKED;
         p_hdr->p_next  = NULL;
-        p_hdr->Type    = 0;
-
-#if GKI_BUFFER_DEBUG
-        LOGD("GKI_getpoolbuf() allocated, %x, %x (%d of %d used) %d", (UINT8*)p_hdr + BUFFER_HDR_SIZE, p_hdr, Q->cur_cnt, Q->total, p_cb->freeq[pool_id].total);
-
-        strncpy(p_hdr->_function, _function_, _GKI_MAX_FUNCTION_NAME_LEN);
-        p_hdr->_function[_GKI_MAX_FUNCTION_NAME_LEN] = '\0';
-        p_hdr->_line = _line_;
+        p_hdr->p_seg   = NULL;
+#if (GKI_BUF_TRACKER == TRUE)
+        gki_buf_site_alloc (p_hdr, site);
+#else
+        p_hdr->site    = 0;
 #endif
         return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
     }
 
     /* If here, no buffers in the specified pool */
-    GKI_enable();
-
-#if GKI_BUFFER_DEBUG
+#if (GKI_BUF_TRACKER == TRUE)
     /* try for free buffers in public pools */
-    return (GKI_getbuf_debug(p_cb->freeq[pool_id].size, _function_, _line_));
+    return (GKI_getbuf_site(p_cb->freeq[pool_id].size, site));
 #else
     /* try for free buffers in public pools */
     return (GKI_getbuf(p_cb->freeq[pool_id].size));
@@ -577,6 +1155,7 @@ void *GKI_getpoolbuf (UINT8 pool_id)
 ** Function         GKI_freebuf
 **
 ** Description      Called by an application to return a buffer to the free pool.
+**                  If the buffer heads a chain, all its segments are freed too.
 **
 ** Parameters       p_buf - (input) address of the beginning of a buffer.
 **
@@ -587,6 +1166,10 @@ void GKI_freebuf (void *p_buf)
 {
     FREE_QUEUE_T    *Q;
     BUFFER_HDR_T    *p_hdr;
+    BUFFER_HDR_T    *p_seg;
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    BUF_CACHE_T     *p_cache;
+#endif
 
 #if (GKI_ENABLE_BUF_CORRUPTION_CHECK == TRUE)
     if (!p_buf || gki_chk_buf_damage(p_buf))
@@ -598,10 +1181,6 @@ void GKI_freebuf (void *p_buf)
 
     p_hdr = (BUFFER_HDR_T *) ((UINT8 *)p_buf - BUFFER_HDR_SIZE);
 
-#if GKI_BUFFER_DEBUG
-    LOGD("GKI_freebuf() freeing, %x, %x, func:%s(line=%d)", p_buf, p_hdr, p_hdr->_function, p_hdr->_line);
-#endif
-
     if (p_hdr->status != BUF_STATUS_UNLINKED)
     {
         GKI_exception(GKI_ERROR_FREEBUF_BUF_LINKED, "Freeing Linked Buf");
@@ -614,12 +1193,57 @@ void GKI_freebuf (void *p_buf)
         return;
     }
 
+    /* Release the rest of the chain, if any, along with its first buffer */
+    if (p_hdr->p_seg)
+    {
+        p_seg        = p_hdr->p_seg;
+        p_hdr->p_seg = NULL;
+        GKI_freebuf ((UINT8 *)p_seg + BUFFER_HDR_SIZE);
+    }
+
+    Q  = &gki_cb.com.freeq[p_hdr->q_id];
+
+#if (GKI_BUF_TRACKER == TRUE)
+    __sync_sub_and_fetch (&gki_cb.com.buf_site[p_hdr->site].live, 1);
+#endif
+
+#if (GKI_ELASTIC_POOLS == TRUE)
+    /* A buffer outside the pool's own memory belongs to one of its slabs */
+    if (  (p_hdr->q_id < GKI_NUM_FIXED_BUF_POOLS)
+        &&(gki_cb.com.pool_num_slabs[p_hdr->q_id])
+        &&(((UINT8 *)p_hdr < gki_cb.com.pool_start[p_hdr->q_id]) || ((UINT8 *)p_hdr >= gki_cb.com.pool_end[p_hdr->q_id]))
+        &&(gki_slab_free (p_hdr))  )
+        return;
+#endif
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    /* Keep the buffer in the calling task's cache; only drain a batch when it overflows */
+    if ((p_cache = gki_get_buf_cache (p_hdr->q_id, GKI_get_taskid())) != NULL)
+    {
+        p_hdr->status    = BUF_STATUS_FREE;
+        p_hdr->task_id   = GKI_INVALID_TASK;
+        p_hdr->p_next    = p_cache->p_first;
+        p_cache->p_first = p_hdr;
+        p_cache->count++;
+        __sync_add_and_fetch (&Q->cache_cnt, 1);
+
+        gki_count_free (Q);
+
+        if (p_cache->count > 2 * gki_cb.com.buf_cache_batch[p_hdr->q_id])
+        {
+            GKI_disable();
+            gki_cache_drain (p_cache, p_hdr->q_id, gki_cb.com.buf_cache_batch[p_hdr->q_id]);
+            GKI_enable();
+        }
+        return;
+    }
+#endif
+
     GKI_disable();
 
     /*
     ** Release the buffer
     */
-    Q  = &gki_cb.com.freeq[p_hdr->q_id];
     if (Q->p_last)
         Q->p_last->p_next = p_hdr;
     else
@@ -629,8 +1253,7 @@ void GKI_freebuf (void *p_buf)
     p_hdr->p_next  = NULL;
     p_hdr->status  = BUF_STATUS_FREE;
     p_hdr->task_id = GKI_INVALID_TASK;
-    if (Q->cur_cnt > 0)
-        Q->cur_cnt--;
+    gki_count_free (Q);
 
     GKI_enable();
 
@@ -638,6 +1261,93 @@ void GKI_freebuf (void *p_buf)
 }
 
 
+/*******************************************************************************
+**
+** Function         GKI_chain_buf
+**
+** Description      Called by an application to link a buffer (or a chain of
+**                  buffers) after the last segment of another buffer's chain.
+**                  The chain is owned through its first buffer: it is queued,
+**                  sent and freed as one, and GKI_get_next_seg() walks it.
+**
+** Parameters       p_head - (input) address of the first buffer of the chain
+**                  p_seg  - (input) address of the buffer to append
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_chain_buf (void *p_head, void *p_seg)
+{
+    BUFFER_HDR_T    *p_hdr;
+    BUFFER_HDR_T    *p_seg_hdr;
+
+    p_hdr     = (BUFFER_HDR_T *) ((UINT8 *) p_head - BUFFER_HDR_SIZE);
+    p_seg_hdr = (BUFFER_HDR_T *) ((UINT8 *) p_seg - BUFFER_HDR_SIZE);
+
+    if (p_seg_hdr->status != BUF_STATUS_UNLINKED)
+    {
+        GKI_exception(GKI_ERROR_ENQUEUE_BUF_LINKED, "Chaining Linked Buf");
+        return;
+    }
+
+    while (p_hdr->p_seg)
+        p_hdr = p_hdr->p_seg;
+
+    p_hdr->p_seg = p_seg_hdr;
+}
+
+/*******************************************************************************
+**
+** Function         GKI_get_next_seg
+**
+** Description      Called by an application to get the segment that follows a
+**                  buffer in its chain.
+**
+** Parameters       p_buf - (input) address of a buffer of the chain
+**
+** Returns          address of the next segment, or NULL if p_buf is the last
+**
+*******************************************************************************/
+void *GKI_get_next_seg (void *p_buf)
+{
+    BUFFER_HDR_T    *p_hdr;
+
+    p_hdr = (BUFFER_HDR_T *) ((UINT8 *) p_buf - BUFFER_HDR_SIZE);
+
+    if (p_hdr->p_seg)
+        return ((UINT8 *) p_hdr->p_seg + BUFFER_HDR_SIZE);
+    else
+        return (NULL);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_unchain_buf
+**
+** Description      Called by an application to split a chain after the given
+**                  buffer. The detached segments form a chain of their own.
+**
+** Parameters       p_buf - (input) address of a buffer of the chain
+**
+** Returns          address of the first detached segment, or NULL if none
+**
+*******************************************************************************/
+void *GKI_unchain_buf (void *p_buf)
+{
+    BUFFER_HDR_T    *p_hdr;
+    BUFFER_HDR_T    *p_seg;
+
+    p_hdr = (BUFFER_HDR_T *) ((UINT8 *) p_buf - BUFFER_HDR_SIZE);
+
+    if ((p_seg = p_hdr->p_seg) == NULL)
+        return (NULL);
+
+    p_hdr->p_seg = NULL;
+
+    return ((UINT8 *) p_seg + BUFFER_HDR_SIZE);
+}
+
+
 /*******************************************************************************
 **
 ** Function         GKI_get_buf_size
@@ -697,6 +1407,65 @@ BOOLEAN gki_chk_buf_damage(void *p_buf)
 #endif
 }
 
+/*******************************************************************************
+**
+** Function         gki_mbox_push
+**
+** Description      Internal function to add a buffer to a task mailbox. Any
+**                  number of senders may push concurrently without locking.
+**
+** Returns          TRUE if the mailbox was empty, i.e. the task must be woken
+**
+*******************************************************************************/
+static BOOLEAN gki_mbox_push (UINT8 task_id, UINT8 mbox, BUFFER_HDR_T *p_hdr)
+{
+    BUFFER_HDR_T * volatile *pp_in = &gki_cb.com.OSTaskQIn[task_id][mbox];
+    BUFFER_HDR_T  *p_old;
+
+    do
+    {
+        p_old = *pp_in;
+        p_hdr->p_next = p_old;
+    } while (!__sync_bool_compare_and_swap (pp_in, p_old, p_hdr));
+
+    return (p_old == NULL);
+}
+
+/*******************************************************************************
+**
+** Function         gki_mbox_detach
+**
+** Description      Internal function called by the owning task to take every
+**                  buffer pushed to its mailbox so far. The chain is stored as
+**                  the task's private list in the order the buffers were sent.
+**
+** Returns          first buffer of the chain, or NULL if the mailbox is empty
+**
+*******************************************************************************/
+static BUFFER_HDR_T *gki_mbox_detach (UINT8 task_id, UINT8 mbox)
+{
+    BUFFER_HDR_T * volatile *pp_in = &gki_cb.com.OSTaskQIn[task_id][mbox];
+    BUFFER_HDR_T  *p_in, *p_next, *p_first = NULL;
+
+    do
+    {
+        p_in = *pp_in;
+    } while (p_in && !__sync_bool_compare_and_swap (pp_in, p_in, NULL));
+
+    /* Senders push newest first; reverse into arrival order */
+    while (p_in)
+    {
+        p_next        = p_in->p_next;
+        p_in->p_next  = p_first;
+        p_first       = p_in;
+        p_in          = p_next;
+    }
+
+    gki_cb.com.OSTaskQFirst[task_id][mbox] = p_first;
+
+    return (p_first);
+}
+
 /*******************************************************************************
 **
 ** Function         GKI_send_msg
@@ -735,23 +1504,12 @@ void GKI_send_msg (UINT8 task_id, UINT8 mbox, void *msg)
         return;
     }
 
-    GKI_disable();
-
-    if (p_cb->OSTaskQFirst[task_id][mbox])
-        p_cb->OSTaskQLast[task_id][mbox]->p_next = p_hdr;
-    else
-        p_cb->OSTaskQFirst[task_id][mbox] = p_hdr;
-
-    p_cb->OSTaskQLast[task_id][mbox] = p_hdr;
-
-    p_hdr->p_next = NULL;
     p_hdr->status = BUF_STATUS_QUEUED;
     p_hdr->task_id = task_id;
 
-
-    GKI_enable();
-
-    GKI_send_event(task_id, (UINT16)EVENT_MASK(mbox));
+    /* Only the sender that finds the mailbox empty has to wake up the task */
+    if (gki_mbox_push (task_id, mbox, p_hdr))
+        GKI_send_event(task_id, (UINT16)EVENT_MASK(mbox));
 
     return;
 }
@@ -777,11 +1535,12 @@ void *GKI_read_mbox (UINT8 mbox)
     if ((task_id >= GKI_MAX_TASKS) || (mbox >= NUM_TASK_MBOX))
         return (NULL);
 
-    GKI_disable();
+    /* Only this task reads OSTaskQFirst, so no locking is needed */
+    if ((p_hdr = gki_cb.com.OSTaskQFirst[task_id][mbox]) == NULL)
+        p_hdr = gki_mbox_detach (task_id, mbox);
 
-    if (gki_cb.com.OSTaskQFirst[task_id][mbox])
+    if (p_hdr)
     {
-        p_hdr = gki_cb.com.OSTaskQFirst[task_id][mbox];
         gki_cb.com.OSTaskQFirst[task_id][mbox] = p_hdr->p_next;
 
         p_hdr->p_next = NULL;
@@ -790,11 +1549,56 @@ void *GKI_read_mbox (UINT8 mbox)
         p_buf = (UINT8 *)p_hdr + BUFFER_HDR_SIZE;
     }
 
-    GKI_enable();
-
     return (p_buf);
 }
 
+/*******************************************************************************
+**
+** Function         GKI_read_mbox_batch
+**
+** Description      Called by applications to take all the buffers waiting in
+**                  one of the task mailboxes at once. They are appended, in the
+**                  order they were sent, to a queue owned by the calling task,
+**                  and should be read back with GKI_dequeue_batch.
+**                  A task can only read its own mailbox.
+**
+** Parameters:      mbox  - (input) mailbox ID to read (0, 1, 2, or 3)
+**                  p_q   - (input) pointer to the task's queue
+**
+** Returns          the number of buffers added to the queue
+**
+*******************************************************************************/
+UINT16 GKI_read_mbox_batch (UINT8 mbox, BUFFER_Q *p_q)
+{
+    UINT8           task_id = GKI_get_taskid();
+    BUFFER_HDR_T    *p_first, *p_last;
+    UINT16          count;
+
+    if ((task_id >= GKI_MAX_TASKS) || (mbox >= NUM_TASK_MBOX))
+        return (0);
+
+    if ((p_first = gki_cb.com.OSTaskQFirst[task_id][mbox]) == NULL)
+    {
+        if ((p_first = gki_mbox_detach (task_id, mbox)) == NULL)
+            return (0);
+    }
+    gki_cb.com.OSTaskQFirst[task_id][mbox] = NULL;
+
+    /* The buffers stay marked as queued; only the chain needs to be spliced */
+    for (count = 1, p_last = p_first; p_last->p_next; count++)
+        p_last = p_last->p_next;
+
+    if (p_q->p_last)
+        ((BUFFER_HDR_T *)((UINT8 *)p_q->p_last - BUFFER_HDR_SIZE))->p_next = p_first;
+    else
+        p_q->p_first = (UINT8 *)p_first + BUFFER_HDR_SIZE;
+
+    p_q->p_last = (UINT8 *)p_last + BUFFER_HDR_SIZE;
+    p_q->count += count;
+
+    return (count);
+}
+
 
 
 /*******************************************************************************
@@ -952,6 +1756,44 @@ void *GKI_dequeue (BUFFER_Q *p_q)
     return ((UINT8 *)p_hdr + BUFFER_HDR_SIZE);
 }
 
+/*******************************************************************************
+**
+** Function         GKI_dequeue_batch
+**
+** Description      Dequeues a buffer from the head of a queue filled by
+**                  GKI_read_mbox_batch. The queue belongs to the calling task,
+**                  so no locking is done.
+**
+** Parameters:      p_q  - (input) pointer to a queue.
+**
+** Returns          NULL if queue is empty, else buffer
+**
+*******************************************************************************/
+void *GKI_dequeue_batch (BUFFER_Q *p_q)
+{
+    BUFFER_HDR_T    *p_hdr;
+
+    if (!p_q || !p_q->count)
+        return (NULL);
+
+    p_hdr = (BUFFER_HDR_T *)((UINT8 *)p_q->p_first - BUFFER_HDR_SIZE);
+
+    if (p_hdr->p_next)
+        p_q->p_first = ((UINT8 *)p_hdr->p_next + BUFFER_HDR_SIZE);
+    else
+    {
+        p_q->p_first = NULL;
+        p_q->p_last  = NULL;
+    }
+
+    p_q->count--;
+
+    p_hdr->p_next = NULL;
+    p_hdr->status = BUF_STATUS_UNLINKED;
+
+    return ((UINT8 *)p_hdr + BUFFER_HDR_SIZE);
+}
+
 
 /*******************************************************************************
 **
@@ -1117,6 +1959,26 @@ void *GKI_find_buf_start (void *p_user_area)
         }
     }
 
+#if (GKI_ELASTIC_POOLS == TRUE)
+    for (xx = 0; xx < GKI_NUM_FIXED_BUF_POOLS; xx++)
+    {
+        BUF_SLAB_T *p_slab = p_cb->pool_slab[xx];
+        UINT8       zz;
+
+        for (zz = 0; zz < GKI_ELASTIC_MAX_SLABS; zz++, p_slab++)
+        {
+            if ((p_ua > p_slab->p_start) && (p_ua < p_slab->p_end))
+            {
+                size = p_cb->pool_size[xx];
+                yy   = (UINT32)(p_ua - p_slab->p_start);
+                yy   = (yy / size) * size;
+
+                return ((void *) (p_slab->p_start + yy + sizeof(BUFFER_HDR_T)) );
+            }
+        }
+    }
+#endif
+
     /* If here, invalid address - not in one of our buffers */
     GKI_exception (GKI_ERROR_BUF_SIZE_ZERO, "GKI_get_buf_start:: bad addr");
 
@@ -1155,6 +2017,8 @@ UINT8 GKI_set_pool_permission(UINT8 pool_id, UINT8 permission)
         else    /* mark the pool as public */
             p_cb->pool_access_mask = (UINT16)(p_cb->pool_access_mask & ~(1 << pool_id));
 
+        gki_update_pool_lookup();
+
         return (GKI_SUCCESS);
     }
     else
@@ -1232,6 +2096,11 @@ static void gki_remove_from_pool_list(UINT8 pool_id)
 ** Description      Called by an interrupt service routine to get a free buffer from
 **                  a specific buffer pool.
 **
+**                  Note: The free queue can be empty while buffers of the pool
+**                        are free in task caches or slabs, so the buffer is
+**                        taken like in GKI_getpoolbuf(), except that the pool
+**                        is not grown and no public pool is tried.
+**
 ** Parameters       pool_id - (input) pool ID to get a buffer out of.
 **
 ** Returns          A pointer to the buffer, or NULL if none available
@@ -1239,30 +2108,26 @@ static void gki_remove_from_pool_list(UINT8 pool_id)
 *******************************************************************************/
 void *GKI_igetpoolbuf (UINT8 pool_id)
 {
-    FREE_QUEUE_T  *Q;
+    UINT8         task_id;
     BUFFER_HDR_T  *p_hdr;
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (NULL);
 
+    task_id = GKI_get_taskid();
 
-    Q = &gki_cb.com.freeq[pool_id];
-    if(Q->cur_cnt < Q->total)
+    if ((p_hdr = gki_alloc_buf (pool_id, task_id, FALSE)) != NULL)
     {
-        p_hdr = Q->p_first;
-        Q->p_first = p_hdr->p_next;
-
-        if (!Q->p_first)
-            Q->p_last = NULL;
-
-        if(++Q->cur_cnt > Q->max_cnt)
-            Q->max_cnt = Q->cur_cnt;
-
-        p_hdr->task_id = GKI_get_taskid();
+        p_hdr->task_id = task_id;
 
         p_hdr->status  = BUF_STATUS_UNLINKED;
         p_hdr->p_next  = NULL;
-        p_hdr->Type    = 0;
+        p_hdr->p_seg   = NULL;
+#if (GKI_BUF_TRACKER == TRUE)
+        gki_buf_site_alloc (p_hdr, 0);
+#else
+        p_hdr->site    = 0;
+#endif
 
         return ((void *) ((UINT8 *)p_hdr + BUFFER_HDR_SIZE));
     }
@@ -1295,7 +2160,9 @@ UINT16 GKI_poolcount (UINT8 pool_id)
 ** Function         GKI_poolfreecount
 **
 ** Description      Called by an application to get the number of free buffers
-**                  in the specified buffer pool.
+**                  in the specified buffer pool. Free buffers held in the
+**                  caches of other tasks are not available to the caller, so
+**                  they are not counted.
 **
 ** Parameters       pool_id - (input) pool ID to get the free count of.
 **
@@ -1305,13 +2172,27 @@ UINT16 GKI_poolcount (UINT8 pool_id)
 UINT16 GKI_poolfreecount (UINT8 pool_id)
 {
     FREE_QUEUE_T  *Q;
+    UINT16        avail;
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    BUF_CACHE_T   *p_cache;
+#endif
 
     if (pool_id >= GKI_NUM_TOTAL_BUF_POOLS)
         return (0);
 
     Q  = &gki_cb.com.freeq[pool_id];
 
-    return ((UINT16)(Q->total - Q->cur_cnt));
+    if (Q->cur_cnt + Q->cache_cnt >= Q->total)
+        avail = 0;
+    else
+        avail = (UINT16)(Q->total - Q->cur_cnt - Q->cache_cnt);
+
+#if (GKI_TASK_BUF_CACHE == TRUE)
+    if ((p_cache = gki_get_buf_cache (pool_id, GKI_get_taskid())) != NULL)
+        avail += p_cache->count;
+#endif
+
+    return (avail);
 }
 
 /*******************************************************************************
@@ -1382,18 +2263,11 @@ void GKI_isend_msg (UINT8 task_id, UINT8 mbox, void *msg)
         return;
     }
 
-    if (p_cb->OSTaskQFirst[task_id][mbox])
-        p_cb->OSTaskQLast[task_id][mbox]->p_next = p_hdr;
-    else
-        p_cb->OSTaskQFirst[task_id][mbox] = p_hdr;
-
-    p_cb->OSTaskQLast[task_id][mbox] = p_hdr;
-
-    p_hdr->p_next = NULL;
     p_hdr->status = BUF_STATUS_QUEUED;
     p_hdr->task_id = task_id;
 
-    GKI_isend_event(task_id, (UINT16)EVENT_MASK(mbox));
+    if (gki_mbox_push (task_id, mbox, p_hdr))
+        GKI_isend_event(task_id, (UINT16)EVENT_MASK(mbox));
 
     return;
 }
@@ -1427,8 +2301,9 @@ UINT8 GKI_create_pool (UINT16 size, UINT16 count, UINT8 permission, void *p_mem_
     if (size > MAX_USER_BUF_SIZE)
         return (GKI_INVALID_POOL);
 
-    /* First, look for an unused pool */
-    for (xx = 0; xx < GKI_NUM_TOTAL_BUF_POOLS; xx++)
+    /* First, look for an unused pool. Fixed pools may not be allocated yet
+     * (GKI_USE_DEFERED_ALLOC_BUF_POOLS), so never hand out their IDs */
+    for (xx = GKI_NUM_FIXED_BUF_POOLS; xx < GKI_NUM_TOTAL_BUF_POOLS; xx++)
     {
         if (!p_cb->pool_start[xx])
             break;
@@ -1450,8 +2325,8 @@ UINT8 GKI_create_pool (UINT16 size, UINT16 count, UINT8 permission, void *p_mem_
         /* Initialize the new pool */
         gki_init_free_queue (xx, size, count, p_mem_pool);
         gki_add_to_pool_list(xx);
-        (void) GKI_set_pool_permission (xx, permission);
         p_cb->curr_total_no_of_pools++;
+        (void) GKI_set_pool_permission (xx, permission);
 
         return (xx);
     }
@@ -1500,6 +2375,7 @@ void GKI_delete_pool (UINT8 pool_id)
 
         gki_remove_from_pool_list(pool_id);
         p_cb->curr_total_no_of_pools--;
+        gki_update_pool_lookup();
     }
     else
         GKI_exception(GKI_ERROR_DELETE_POOL_BAD_QID, "Deleting bad pool");
@@ -0,0 +1,88 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 1999-2012 Broadcom Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#ifndef GKI_INT_H
+#define GKI_INT_H
+
+#include "gki_common.h"
+#include <pthread.h>
+
+/**********************************************************************
+** OS specific definitions for the virtual-time simulation backend
+*/
+
+/* 'running' value while the scheduler itself holds the baton */
+#define GKI_SIM_SCHED       GKI_MAX_TASKS
+
+/* Simulation state of a task */
+#define GKI_SIM_IDLE        0   /* not created, or its thread has exited */
+#define GKI_SIM_READY       1   /* runnable, waiting for the baton */
+#define GKI_SIM_RUNNING     2   /* holds the baton */
+#define GKI_SIM_WAITING     3   /* blocked in GKI_wait() or GKI_delay() */
+
+typedef struct
+{
+    pthread_mutex_t     GKI_mutex;
+    pthread_t           thread_id[GKI_MAX_TASKS];
+    tGKI_TASK_SCHED     task_sched[GKI_MAX_TASKS];      /* kept for GKI_get_task_sched() only */
+    pthread_mutex_t     sim_mutex;                      /* protects the fields below */
+    pthread_cond_t      task_cond[GKI_MAX_TASKS];       /* signalled when a task gets the baton */
+    pthread_cond_t      sched_cond;                     /* signalled when the baton returns */
+    UINT8               running;                        /* task holding the baton, or GKI_SIM_SCHED */
+    UINT8               task_state[GKI_MAX_TASKS];      /* GKI_SIM_xxx */
+    BOOLEAN             wake_set[GKI_MAX_TASKS];        /* waiting task has a timeout */
+    UINT32              wake_ms[GKI_MAX_TASKS];         /* virtual time the wait times out */
+    UINT32              vtime_ms;                       /* virtual clock in milliseconds */
+    UINT32              timer_epoch_ms;                 /* virtual time of the last GKI_timer_update() tick */
+    BOOLEAN             sched_active;                   /* a thread is running the scheduler loop */
+    int                 no_timer_suspend;   /* 1: no suspend, 0 stop calling GKI_timer_update() */
+#if (GKI_DEBUG == TRUE)
+    pthread_mutex_t     GKI_trace_mutex;
+#endif
+} tGKI_OS;
+
+/* condition to exit or continue GKI_run() timer loop */
+#define GKI_TIMER_TICK_RUN_COND 1
+#define GKI_TIMER_TICK_STOP_COND 0
+#define GKI_TIMER_TICK_EXIT_COND 2
+
+extern void gki_system_tick_start_stop_cback(BOOLEAN start);
+
+/* Contains common control block as well as OS specific variables */
+typedef struct
+{
+    tGKI_OS     os;
+    tGKI_COM_CB com;
+} tGKI_CB;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if GKI_DYNAMIC_MEMORY == FALSE
+GKI_API extern tGKI_CB  gki_cb;
+#else
+GKI_API extern tGKI_CB *gki_cb_ptr;
+#define gki_cb (*gki_cb_ptr)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,1283 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 1999-2012 Broadcom Corporation
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Virtual-time GKI backend, a drop-in replacement for gki_ulinux.c used to
+ *  run the stack in simulations, benchmarks and regression tests.
+ *
+ *  Every GKI task still has its own thread, but the threads pass a baton so
+ *  that exactly one of them runs at any time. A task only gives the baton
+ *  back in GKI_wait(), GKI_delay() or when it returns. GKI_run() then hands
+ *  it to the lowest numbered ready task; when no task is ready it moves the
+ *  virtual clock straight to the next deadline (GKI timer expiry, GKI_wait()
+ *  timeout or end of a GKI_delay()) and runs GKI_timer_update(). No time is
+ *  ever slept, so multi-second protocol scenarios complete in milliseconds,
+ *  and the interleaving depends only on the inputs, so runs are repeatable.
+ *
+ *  GKI_run() returns once no task is ready and nothing is pending on the
+ *  virtual clock. Inputs must come from GKI tasks (e.g. a simulated NFCC
+ *  task) for the run to be deterministic; events sent from other threads
+ *  are delivered, but only while GKI_run() is active.
+ *
+ *  Build it instead of src/gki/ulinux with src/gki/sim ahead of
+ *  src/gki/ulinux in the include path (data_types.h is shared), and
+ *  GKI_WAIT_EVENTFD set to FALSE. tests/Android.mk builds it that way for
+ *  the gki_sim_test host executable.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <errno.h>
+
+#define GKI_DEBUG   FALSE
+
+#include <pthread.h>  /* must be 1st header defined  */
+#include "gki_int.h"
+#include "gki_target.h"
+
+#ifndef LINUX_NATIVE
+#include <cutils/log.h>
+#else
+#define LOGV(format, ...)  fprintf (stdout, LOG_TAG format, ## __VA_ARGS__)
+#define LOGE(format, ...)  fprintf (stderr, LOG_TAG format, ## __VA_ARGS__)
+#define LOGI(format, ...)  fprintf (stdout, LOG_TAG format, ## __VA_ARGS__)
+#endif
+
+/* Define the structure that holds the GKI variables
+*/
+#if GKI_DYNAMIC_MEMORY == FALSE
+tGKI_CB   gki_cb;
+#endif
+
+/* works only for 1ms to 1000ms heart beat ranges */
+#define GKI_SIM_TICK_MS (1000/TICKS_PER_SEC)
+
+#ifndef GKI_SHUTDOWN_EVT
+#define GKI_SHUTDOWN_EVT    APPL_EVT_7
+#endif
+
+typedef struct
+{
+    UINT8 task_id;          /* GKI task id */
+    TASKPTR task_entry;     /* Task entry function*/
+    UINT32 params;          /* Extra params to pass to task entry function */
+    pthread_cond_t* pCond;	/* for android*/
+    pthread_mutex_t* pMutex;  /* for android*/
+} gki_pthread_info_t;
+gki_pthread_info_t gki_pthread_info[GKI_MAX_TASKS];
+
+/*******************************************************************************
+**
+** Function         gki_sim_yield
+**
+** Description      Give the baton back to the scheduler and block until the
+**                  calling task is dispatched again. Called and returns with
+**                  sim_mutex locked.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_sim_yield (UINT8 task_id)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+
+    p_os->running = GKI_SIM_SCHED;
+    pthread_cond_signal (&p_os->sched_cond);
+
+    while (p_os->running != task_id)
+        pthread_cond_wait (&p_os->task_cond[task_id], &p_os->sim_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         gki_sim_task_done
+**
+** Description      Called by a task thread that is about to exit, with
+**                  sim_mutex locked. Returns the baton for good.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_sim_task_done (UINT8 task_id)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+
+    p_os->task_state[task_id] = GKI_SIM_IDLE;
+    p_os->wake_set[task_id]   = FALSE;
+    p_os->thread_id[task_id]  = 0;
+    p_os->running = GKI_SIM_SCHED;
+    pthread_cond_signal (&p_os->sched_cond);
+    pthread_mutex_unlock (&p_os->sim_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         gki_sim_advance
+**
+** Description      Move the virtual clock to 'now', run GKI_timer_update()
+**                  for the whole ticks elapsed if the system tick is running
+**                  and make the tasks whose wait timed out ready. Called
+**                  without sim_mutex, by the thread holding the baton.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_sim_advance (UINT32 now)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    UINT32  ticks;
+    UINT8   task_id;
+
+    pthread_mutex_lock (&p_os->sim_mutex);
+    p_os->vtime_ms = now;
+    pthread_mutex_unlock (&p_os->sim_mutex);
+
+    GKI_disable();
+    if (p_os->no_timer_suspend == GKI_TIMER_TICK_RUN_COND)
+    {
+        ticks = (now - p_os->timer_epoch_ms) / GKI_SIM_TICK_MS;
+        if (ticks > 0)
+        {
+            p_os->timer_epoch_ms += ticks * GKI_SIM_TICK_MS;
+            GKI_timer_update ((INT32) ticks);
+        }
+    }
+    else
+    {
+        /* OSTicks does not advance while the system tick is stopped */
+        p_os->timer_epoch_ms = now;
+    }
+    GKI_enable();
+
+    pthread_mutex_lock (&p_os->sim_mutex);
+    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        if ((p_os->task_state[task_id] == GKI_SIM_WAITING) && p_os->wake_set[task_id]
+          &&(p_os->wake_ms[task_id] <= now))
+        {
+            p_os->wake_set[task_id]   = FALSE;
+            p_os->task_state[task_id] = GKI_SIM_READY;
+        }
+    }
+    pthread_mutex_unlock (&p_os->sim_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         gki_sim_next_deadline
+**
+** Description      Find the earliest point on the virtual clock at which
+**                  something happens: a task wait times out, the next GKI
+**                  timer expires or the system tick is due to stop. Called
+**                  with sim_mutex locked.
+**
+** Returns          TRUE and the time in *p_when, or FALSE if nothing is pending
+**
+*******************************************************************************/
+static BOOLEAN gki_sim_next_deadline (UINT32 *p_when)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    BOOLEAN found = FALSE;
+    INT32   ticks;
+    UINT32  when;
+    UINT8   task_id;
+
+    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        if ((p_os->task_state[task_id] == GKI_SIM_WAITING) && p_os->wake_set[task_id]
+          &&((!found) || (p_os->wake_ms[task_id] < *p_when)))
+        {
+            *p_when = p_os->wake_ms[task_id];
+            found   = TRUE;
+        }
+    }
+
+    if (p_os->no_timer_suspend == GKI_TIMER_TICK_RUN_COND)
+    {
+        ticks = gki_cb.com.OSTicksTilExp;
+#if (defined(GKI_DELAY_STOP_SYS_TICK) && (GKI_DELAY_STOP_SYS_TICK > 0))
+        if ((gki_cb.com.OSTicksTilStop > 0) && ((ticks <= 0) || ((INT32) gki_cb.com.OSTicksTilStop < ticks)))
+            ticks = gki_cb.com.OSTicksTilStop;
+#endif
+        if (ticks > 0)
+        {
+            when = p_os->timer_epoch_ms + (UINT32) ticks * GKI_SIM_TICK_MS;
+            if ((!found) || (when < *p_when))
+            {
+                *p_when = when;
+                found   = TRUE;
+            }
+        }
+    }
+
+    return (found);
+}
+
+/*******************************************************************************
+**
+** Function         gki_sim_schedule
+**
+** Description      Scheduler loop. Dispatches the lowest numbered ready task
+**                  until it gives the baton back, and advances the virtual
+**                  clock whenever no task is ready. After GKI_shutdown() only
+**                  the remaining ready tasks are run, so their threads exit.
+**
+** Returns          void, when no task is ready and nothing is pending
+**
+*******************************************************************************/
+static void gki_sim_schedule (void)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    UINT8   task_id;
+    UINT32  when;
+
+    pthread_mutex_lock (&p_os->sim_mutex);
+    p_os->sched_active = TRUE;
+
+    for (;;)
+    {
+        for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+        {
+            if (p_os->task_state[task_id] == GKI_SIM_READY)
+                break;
+        }
+
+        if (task_id < GKI_MAX_TASKS)
+        {
+            p_os->task_state[task_id] = GKI_SIM_RUNNING;
+            p_os->running = task_id;
+            pthread_cond_signal (&p_os->task_cond[task_id]);
+
+            while (p_os->running != GKI_SIM_SCHED)
+                pthread_cond_wait (&p_os->sched_cond, &p_os->sim_mutex);
+            continue;
+        }
+
+        if (  (p_os->no_timer_suspend == GKI_TIMER_TICK_EXIT_COND)
+            ||(!gki_sim_next_deadline (&when))  )
+            break;
+
+        pthread_mutex_unlock (&p_os->sim_mutex);
+        gki_sim_advance (when);
+        pthread_mutex_lock (&p_os->sim_mutex);
+    }
+
+    p_os->sched_active = FALSE;
+    pthread_mutex_unlock (&p_os->sim_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         gki_task_entry
+**
+** Description      entry point of GKI created tasks. The thread waits for the
+**                  baton before calling the task entry function.
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_task_entry(UINT32 params)
+{
+    gki_pthread_info_t *p_pthread_info = (gki_pthread_info_t *)params;
+    UINT8              task_id = p_pthread_info->task_id;
+
+    pthread_mutex_lock (&gki_cb.os.sim_mutex);
+    gki_cb.os.thread_id[task_id] = pthread_self();
+
+    while (gki_cb.os.running != task_id)
+        pthread_cond_wait (&gki_cb.os.task_cond[task_id], &gki_cb.os.sim_mutex);
+    pthread_mutex_unlock (&gki_cb.os.sim_mutex);
+
+    /* Call the actual thread entry point, unless the task was stopped before it ran */
+    if (gki_cb.com.OSRdyTbl[task_id] != TASK_DEAD)
+        (p_pthread_info->task_entry)(p_pthread_info->params);
+
+    GKI_TRACE_1("gki_task task_id=%i terminating", task_id);
+
+    pthread_mutex_lock (&gki_cb.os.sim_mutex);
+    gki_sim_task_done (task_id);
+
+    pthread_exit(0);    /* GKI tasks have no return value */
+}
+
+#ifndef ANDROID
+void GKI_TRACE(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+
+    va_end(ap);
+}
+#endif
+
+/*******************************************************************************
+**
+** Function         GKI_init
+**
+** Description      This function is called once at startup to initialize
+**                  all the timer structures. The virtual clock starts at 0.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_init(void)
+{
+    pthread_mutexattr_t attr;
+    tGKI_OS             *p_os;
+    UINT8               task_id;
+
+    memset (&gki_cb, 0, sizeof (gki_cb));
+
+    gki_buffer_init();
+    gki_timers_init();
+    gki_cb.com.OSTicks = 0;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE_NP);
+
+    p_os = &gki_cb.os;
+    pthread_mutex_init(&p_os->GKI_mutex, &attr);
+    pthread_mutex_init(&p_os->sim_mutex, NULL);
+    pthread_cond_init(&p_os->sched_cond, NULL);
+
+    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        p_os->task_sched[task_id].policy = GKI_SCHED_DEFAULT;
+        pthread_cond_init(&p_os->task_cond[task_id], NULL);
+    }
+    p_os->running = GKI_SIM_SCHED;
+
+#if (GKI_DEBUG == TRUE)
+    pthread_mutex_init(&p_os->GKI_trace_mutex, NULL);
+#endif
+
+    p_os->no_timer_suspend = GKI_TIMER_TICK_RUN_COND;
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_get_os_tick_count
+**
+** Description      This function is called to retrieve the native OS system tick.
+**
+** Returns          Tick count of native OS.
+**
+*******************************************************************************/
+UINT32 GKI_get_os_tick_count(void)
+{
+    return (gki_cb.com.OSTicks);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_sim_get_time
+**
+** Description      This function returns the virtual clock of the simulation.
+**
+** Returns          milliseconds of virtual time since GKI_init()
+**
+*******************************************************************************/
+UINT32 GKI_sim_get_time (void)
+{
+    return (gki_cb.os.vtime_ms);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_create_task
+**
+** Description      This function is called to create a new OSS task. The task
+**                  is ready at once but only starts when GKI_run() (or the
+**                  task currently running) gives up the baton.
+**
+** Parameters:      task_entry  - (input) pointer to the entry function of the task
+**                  task_id     - (input) Task id is mapped to priority
+**                  taskname    - (input) name given to the task
+**                  stack       - (input) pointer to the top of the stack (highest memory location)
+**                  stacksize   - (input) size of the stack allocated for the task
+**
+** Returns          GKI_SUCCESS if all OK, GKI_FAILURE if any problem
+**
+*******************************************************************************/
+UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16 *stack, UINT16 stacksize, void* pCondVar, void* pMutex)
+{
+    pthread_attr_t  attr1;
+    pthread_t       thread_id;
+    int             ret;
+
+    GKI_TRACE_5 ("GKI_create_task func=0x%x  id=%d  name=%s  stack=0x%x  stackSize=%d", task_entry, task_id, taskname, stack, stacksize);
+
+    if (task_id >= GKI_MAX_TASKS)
+    {
+        GKI_TRACE_0("Error! task ID > max task allowed");
+        return (GKI_FAILURE);
+    }
+
+    if (gki_cb.os.task_state[task_id] != GKI_SIM_IDLE)
+    {
+        GKI_TRACE_1("Error! task %d already running", task_id);
+        return (GKI_FAILURE);
+    }
+
+    gki_cb.com.OSRdyTbl[task_id]    = TASK_READY;
+    gki_cb.com.OSTName[task_id]     = taskname;
+    gki_cb.com.OSWaitTmr[task_id]   = 0;
+    gki_cb.com.OSWaitEvt[task_id]   = 0;
+
+    gki_pthread_info[task_id].task_id = task_id;
+    gki_pthread_info[task_id].task_entry = task_entry;
+    gki_pthread_info[task_id].params = 0;
+    gki_pthread_info[task_id].pCond = (pthread_cond_t*)pCondVar;
+    gki_pthread_info[task_id].pMutex = (pthread_mutex_t*)pMutex;
+
+    pthread_mutex_lock (&gki_cb.os.sim_mutex);
+    gki_cb.os.task_state[task_id] = GKI_SIM_READY;
+    gki_cb.os.wake_set[task_id]   = FALSE;
+    pthread_mutex_unlock (&gki_cb.os.sim_mutex);
+
+    /* The thread only runs while it holds the baton, so nobody needs to join it */
+    pthread_attr_init(&attr1);
+    pthread_attr_setdetachstate(&attr1, PTHREAD_CREATE_DETACHED);
+
+    ret = pthread_create (&thread_id, &attr1, (void *)gki_task_entry, &gki_pthread_info[task_id]);
+    pthread_attr_destroy(&attr1);
+
+    if (ret != 0)
+    {
+        GKI_TRACE_2("pthread_create failed(%d), %s!", ret, taskname);
+        pthread_mutex_lock (&gki_cb.os.sim_mutex);
+        gki_cb.os.task_state[task_id] = GKI_SIM_IDLE;
+        pthread_mutex_unlock (&gki_cb.os.sim_mutex);
+        gki_cb.com.OSRdyTbl[task_id] = TASK_DEAD;
+        return (GKI_FAILURE);
+    }
+
+    return (GKI_SUCCESS);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_set_task_sched
+**
+** Description      Scheduling is decided by the simulation, so the settings
+**                  are only recorded.
+**
+** Returns          GKI_SUCCESS if all OK, GKI_FAILURE if any problem
+**
+*******************************************************************************/
+UINT8 GKI_set_task_sched (UINT8 task_id, tGKI_TASK_SCHED *p_sched)
+{
+    if ((task_id >= GKI_MAX_TASKS) || (p_sched == NULL))
+        return (GKI_FAILURE);
+
+    gki_cb.os.task_sched[task_id] = *p_sched;
+    return (GKI_SUCCESS);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_get_task_sched
+**
+** Description      Returns the settings recorded by GKI_set_task_sched().
+**
+** Returns          GKI_SUCCESS if all OK, GKI_FAILURE if any problem
+**
+*******************************************************************************/
+UINT8 GKI_get_task_sched (UINT8 task_id, tGKI_TASK_SCHED *p_sched)
+{
+    if ((task_id >= GKI_MAX_TASKS) || (p_sched == NULL))
+        return (GKI_FAILURE);
+
+    *p_sched = gki_cb.os.task_sched[task_id];
+    return (GKI_SUCCESS);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_shutdown
+**
+** Description      Marks all GKI tasks dead and lets their threads run to
+**                  exit. From a GKI task the threads unwind in GKI_run() once
+**                  the caller gives up the baton; from any other thread while
+**                  GKI_run() is not active they are unwound here.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_shutdown(void)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    UINT8   task_id;
+    BOOLEAN unwind;
+
+    for (task_id = GKI_MAX_TASKS; task_id > 0; task_id--)
+    {
+        if (gki_cb.com.OSRdyTbl[task_id - 1] != TASK_DEAD)
+        {
+            gki_cb.com.OSRdyTbl[task_id - 1] = TASK_DEAD;
+
+            /* paranoi settings, make sure that we do not execute any mailbox events */
+            gki_cb.com.OSWaitEvt[task_id-1] &= ~(TASK_MBOX_0_EVT_MASK|TASK_MBOX_1_EVT_MASK|
+                                                TASK_MBOX_2_EVT_MASK|TASK_MBOX_3_EVT_MASK);
+            GKI_send_event(task_id - 1, EVENT_MASK(GKI_SHUTDOWN_EVT));
+            GKI_exit_task(task_id - 1);
+        }
+    }
+
+#if (GKI_ELASTIC_POOLS == TRUE)
+    /* give the grown pool slabs back to the OS */
+    GKI_disable();
+    gki_buffer_free_slabs();
+    GKI_enable();
+#endif
+
+    pthread_mutex_lock (&p_os->sim_mutex);
+    p_os->no_timer_suspend = GKI_TIMER_TICK_EXIT_COND;
+    unwind = (!p_os->sched_active) && (GKI_get_taskid () >= GKI_MAX_TASKS);
+    pthread_mutex_unlock (&p_os->sim_mutex);
+
+    if (unwind)
+        gki_sim_schedule ();
+}
+
+/*******************************************************************************
+ **
+ ** Function        gki_system_tick_start_stop_cback
+ **
+ ** Description     Starts or stops the system tick. While it is stopped the
+ **                 GKI timers do not advance with the virtual clock.
+ **
+ ** Parameters:     start: TRUE start system tick (again), FALSE stop
+ **
+ ** Returns         void
+ **
+ *********************************************************************************/
+void gki_system_tick_start_stop_cback(BOOLEAN start)
+{
+    volatile int *p_run_cond = &gki_cb.os.no_timer_suspend;
+
+    if (*p_run_cond == GKI_TIMER_TICK_EXIT_COND)
+        return;
+
+    if (start)
+    {
+        /* ticks are counted from now */
+        gki_cb.os.timer_epoch_ms = gki_cb.os.vtime_ms;
+        *p_run_cond = GKI_TIMER_TICK_RUN_COND;
+    }
+    else
+        *p_run_cond = GKI_TIMER_TICK_STOP_COND;
+}
+
+#if (GKI_TICKLESS_TIMER == TRUE)
+/*******************************************************************************
+**
+** Function         gki_timer_pending_ticks
+**
+** Description      The scheduler credits the elapsed ticks every time it
+**                  advances the virtual clock, so none are ever pending.
+**
+** Returns          0
+**
+*******************************************************************************/
+UINT32 gki_timer_pending_ticks (void)
+{
+    return (0);
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_tick_count
+**
+** Description      Returns the current number of system ticks.
+**
+** Returns          OSTicks
+**
+*******************************************************************************/
+UINT32 gki_timer_tick_count (void)
+{
+    return (gki_cb.com.OSTicks);
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_rearm
+**
+** Description      Nothing to do: the scheduler reads the next expiration
+**                  every time it advances the virtual clock.
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_timer_rearm (void)
+{
+}
+#endif
+
+/*******************************************************************************
+**
+** Function         GKI_run
+**
+** Description      Runs the simulation: schedules the tasks and advances the
+**                  virtual clock until no task is ready and no timer, wait
+**                  timeout or delay is pending, or until GKI_shutdown().
+**
+** Parameters:      p_task_id  - (input) pointer to task id (unused)
+**
+** Returns          void
+**
+*********************************************************************************/
+void GKI_run (void *p_task_id)
+{
+    GKI_TRACE_1("%s enter", __func__);
+
+#ifndef GKI_NO_TICK_STOP
+    /* register start stop function which stops GKI_timer_update() calls when no
+     * timers are running, as on target */
+    GKI_timer_queue_register_callback( gki_system_tick_start_stop_cback );
+#endif
+
+    gki_sim_schedule ();
+
+    GKI_TRACE_2("%s exit at %u ms", __func__, gki_cb.os.vtime_ms);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_stop
+**
+** Description      This function is called to stop
+**                  the tasks and timers when the system is being stopped
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_stop (void)
+{
+    UINT8 task_id;
+
+    for(task_id = 0; task_id<GKI_MAX_TASKS; task_id++)
+    {
+        if(gki_cb.com.OSRdyTbl[task_id] != TASK_DEAD)
+        {
+            GKI_exit_task(task_id);
+        }
+    }
+}
+
+/*******************************************************************************
+**
+** Function         GKI_wait
+**
+** Description      This function is called by tasks to wait for a specific
+**                  event or set of events. The task may specify the duration
+**                  that it wants to wait for, or 0 if infinite. Gives the
+**                  baton to the next task if no requested event is pending.
+**
+** Parameters:      flag -    (input) the event or set of events to wait for
+**                  timeout - (input) the duration that the task wants to wait
+**                                    for the specific events (in milliseconds
+**                                    of virtual time)
+**
+** Returns          the event mask of received events or zero if timeout
+**
+*******************************************************************************/
+UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    UINT16  evt;
+    UINT8   rtask;
+
+    rtask = GKI_get_taskid();
+    GKI_TRACE_3("GKI_wait %d %x %d", rtask, flag, timeout);
+    if (rtask >= GKI_MAX_TASKS) {
+        pthread_exit(NULL);
+        return 0;
+    }
+
+    gki_pthread_info_t* p_pthread_info = &gki_pthread_info[rtask];
+    if (p_pthread_info->pCond != NULL && p_pthread_info->pMutex != NULL) {
+        pthread_mutex_lock(p_pthread_info->pMutex);
+        pthread_cond_signal(p_pthread_info->pCond);
+        pthread_mutex_unlock(p_pthread_info->pMutex);
+        p_pthread_info->pMutex = NULL;
+        p_pthread_info->pCond = NULL;
+    }
+
+    pthread_mutex_lock(&p_os->sim_mutex);
+    gki_cb.com.OSWaitForEvt[rtask] = flag;
+
+    /* Check if anything is waiting in any of the mailboxes */
+    if (GKI_MBOX_PENDING(rtask, 0))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 1))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 2))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 3))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
+
+    if (!(gki_cb.com.OSWaitEvt[rtask] & flag))
+    {
+        /* a stopped task would never be woken again */
+        if (gki_cb.com.OSRdyTbl[rtask] != TASK_DEAD)
+        {
+            p_os->task_state[rtask] = GKI_SIM_WAITING;
+            p_os->wake_set[rtask]   = (timeout != 0);
+            p_os->wake_ms[rtask]    = p_os->vtime_ms + timeout;
+
+            gki_sim_yield (rtask);
+        }
+
+        if (GKI_MBOX_PENDING(rtask, 0))
+            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
+        if (GKI_MBOX_PENDING(rtask, 1))
+            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
+        if (GKI_MBOX_PENDING(rtask, 2))
+            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
+        if (GKI_MBOX_PENDING(rtask, 3))
+            gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
+
+        if (gki_cb.com.OSRdyTbl[rtask] == TASK_DEAD)
+        {
+            gki_cb.com.OSWaitEvt[rtask] = 0;
+            GKI_TRACE_1("GKI TASK_DEAD received. exit thread %d...", rtask);
+            gki_sim_task_done (rtask);
+            pthread_exit(NULL);
+            return (EVENT_MASK(GKI_SHUTDOWN_EVT));
+        }
+    }
+
+    /* Clear the wait for event mask */
+    gki_cb.com.OSWaitForEvt[rtask] = 0;
+
+    /* Return only those bits which user wants... */
+    evt = gki_cb.com.OSWaitEvt[rtask] & flag;
+
+    /* Clear only those bits which user wants... */
+    gki_cb.com.OSWaitEvt[rtask] &= ~flag;
+
+    pthread_mutex_unlock(&p_os->sim_mutex);
+    GKI_TRACE_4("GKI_wait %d %x %d %x resumed", rtask, flag, timeout, evt);
+
+    return (evt);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_delay
+**
+** Description      This function is called by tasks to sleep unconditionally
+**                  for a specified amount of virtual time. The other tasks
+**                  run in the meantime. Outside a GKI task it returns at once.
+**
+** Parameters:      timeout -    (input) the duration in milliseconds
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_delay (UINT32 timeout)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+    UINT8   rtask = GKI_get_taskid();
+
+    GKI_TRACE_2("GKI_delay %d %d", rtask, timeout);
+
+    if ((rtask >= GKI_MAX_TASKS) || (gki_cb.com.OSRdyTbl[rtask] == TASK_DEAD))
+        return;
+
+    pthread_mutex_lock(&p_os->sim_mutex);
+
+    /* no event wakes a delayed task: GKI_send_event() only looks at OSWaitForEvt */
+    gki_cb.com.OSWaitForEvt[rtask] = 0;
+    p_os->task_state[rtask] = GKI_SIM_WAITING;
+    p_os->wake_set[rtask]   = TRUE;
+    p_os->wake_ms[rtask]    = p_os->vtime_ms + timeout;
+
+    gki_sim_yield (rtask);
+
+    pthread_mutex_unlock(&p_os->sim_mutex);
+
+    GKI_TRACE_2("GKI_delay %d %d done", rtask, timeout);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_send_event
+**
+** Description      This function is called by tasks to send events to other
+**                  tasks. Tasks can also send events to themselves. A waiting
+**                  task becomes ready, it runs when the sender gives up the
+**                  baton.
+**
+** Parameters:      task_id -  (input) The id of the task to which the event has to
+**                  be sent
+**                  event   -  (input) The event that has to be sent
+**
+** Returns          GKI_SUCCESS if all OK, else GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_send_event (UINT8 task_id, UINT16 event)
+{
+    tGKI_OS *p_os = &gki_cb.os;
+
+    GKI_TRACE_2("GKI_send_event %d %x", task_id, event);
+
+    if (task_id < GKI_MAX_TASKS)
+    {
+        pthread_mutex_lock(&p_os->sim_mutex);
+
+        /* Set the event bit */
+        gki_cb.com.OSWaitEvt[task_id] |= event;
+
+        if (  (p_os->task_state[task_id] == GKI_SIM_WAITING)
+            &&(  (gki_cb.com.OSWaitEvt[task_id] & gki_cb.com.OSWaitForEvt[task_id])
+               ||(gki_cb.com.OSRdyTbl[task_id] == TASK_DEAD)  )  )
+        {
+            p_os->wake_set[task_id]   = FALSE;
+            p_os->task_state[task_id] = GKI_SIM_READY;
+        }
+
+        pthread_mutex_unlock(&p_os->sim_mutex);
+
+        GKI_TRACE_2("GKI_send_event %d %x done", task_id, event);
+        return ( GKI_SUCCESS );
+    }
+    return (GKI_FAILURE);
+}
+
+#if (GKI_WAIT_EVENTFD == TRUE)
+/*******************************************************************************
+**
+** Function         GKI_register_fd
+**
+** Description      File descriptors are real-time inputs and cannot be waited
+**                  on in virtual time; simulated peers must be GKI tasks.
+**
+** Returns          GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_register_fd (UINT8 task_id, int fd, UINT16 event)
+{
+    GKI_TRACE_ERROR_2 ("GKI_register_fd: not supported in simulation (task %d, fd %d)", task_id, fd);
+    return (GKI_FAILURE);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_deregister_fd
+**
+** Description      See GKI_register_fd().
+**
+** Returns          GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_deregister_fd (UINT8 task_id, int fd)
+{
+    return (GKI_FAILURE);
+}
+#endif
+
+/*******************************************************************************
+**
+** Function         GKI_isend_event
+**
+** Description      This function is called from ISRs to send events to other
+**                  tasks. The only difference between this function and GKI_send_event
+**                  is that this function assumes interrupts are already disabled.
+**
+** Returns          GKI_SUCCESS if all OK, else GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_isend_event (UINT8 task_id, UINT16 event)
+{
+    return    GKI_send_event(task_id, event);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_get_taskid
+**
+** Description      This function gets the currently running task ID.
+**
+** Returns          task ID, or -1 if not called from a GKI task
+**
+*******************************************************************************/
+UINT8 GKI_get_taskid (void)
+{
+    int i;
+
+    pthread_t thread_id = pthread_self( );
+    for (i = 0; i < GKI_MAX_TASKS; i++) {
+        if ((gki_cb.os.thread_id[i] != 0) && pthread_equal (gki_cb.os.thread_id[i], thread_id)) {
+            return(i);
+        }
+    }
+
+    return(-1);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_map_taskname
+**
+** Description      This function gets the task name of the taskid passed as arg.
+**                  If GKI_MAX_TASKS is passed as arg the currently running task
+**                  name is returned
+**
+** Parameters:      task_id -  (input) The id of the task whose name is being
+**                  sought. GKI_MAX_TASKS is passed to get the name of the
+**                  currently running task.
+**
+** Returns          pointer to task name
+**
+*******************************************************************************/
+INT8 *GKI_map_taskname (UINT8 task_id)
+{
+    if (task_id < GKI_MAX_TASKS)
+    {
+         return (gki_cb.com.OSTName[task_id]);
+    }
+    else if (task_id == GKI_MAX_TASKS )
+    {
+        return (gki_cb.com.OSTName[GKI_get_taskid()]);
+    }
+    else
+    {
+        return (INT8*) "BAD";
+    }
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_enable
+**
+** Description      This function enables interrupts.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_enable (void)
+{
+    pthread_mutex_unlock(&gki_cb.os.GKI_mutex);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_disable
+**
+** Description      This function disables interrupts. Only one task runs at
+**                  a time, the mutex guards against non-GKI threads.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_disable (void)
+{
+    pthread_mutex_lock(&gki_cb.os.GKI_mutex);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_exception
+**
+** Description      This function throws an exception.
+**                  This is normally only called for a nonrecoverable error.
+**
+** Parameters:      code    -  (input) The code for the error
+**                  msg     -  (input) The message that has to be logged
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_exception (UINT16 code, char *msg)
+{
+    UINT8 task_id;
+
+    GKI_TRACE_ERROR_0( "GKI_exception(): Task State Table");
+
+    for(task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        GKI_TRACE_ERROR_3( "TASK ID [%d] task name [%s] state [%d]",
+                         task_id,
+                         gki_cb.com.OSTName[task_id],
+                         gki_cb.com.OSRdyTbl[task_id]);
+    }
+
+    GKI_TRACE_ERROR_0( "********************************************************************");
+    GKI_TRACE_ERROR_3( "* GKI_exception(): %d %s at %u ms", code, msg, gki_cb.os.vtime_ms);
+    GKI_TRACE_ERROR_0( "********************************************************************");
+
+#if (GKI_DEBUG == TRUE)
+    GKI_disable();
+
+    if (gki_cb.com.ExceptionCnt < GKI_MAX_EXCEPTION)
+    {
+        EXCEPTION_T *pExp;
+
+        pExp =  &gki_cb.com.Exception[gki_cb.com.ExceptionCnt++];
+        pExp->type = code;
+        pExp->taskid = GKI_get_taskid();
+        strncpy((char *)pExp->msg, msg, GKI_MAX_EXCEPTION_MSGLEN - 1);
+    }
+
+    GKI_enable();
+#endif
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_get_time_stamp
+**
+** Description      This function formats the virtual time into a user area
+**
+** Parameters:      tbuf -  (output) the address to the memory containing the
+**                  formatted time
+**
+** Returns          the address of the user area containing the formatted time
+**                  as "hh:mm:ss:cc:" (cc = hundredths of a second)
+**
+*******************************************************************************/
+INT8 *GKI_get_time_stamp (INT8 *tbuf)
+{
+    UINT32 ms_time = gki_cb.os.vtime_ms;
+    UINT32 s_time;
+    UINT32 m_time;
+    UINT32 h_time;
+    INT8   *p_out = tbuf;
+
+    s_time  = ms_time / 1000;
+    m_time  = s_time / 60;
+    h_time  = m_time / 60;
+
+    ms_time -= s_time * 1000;
+    s_time  -= m_time * 60;
+    m_time  -= h_time * 60;
+
+    *p_out++ = (INT8)(((h_time / 10) % 10) + '0');
+    *p_out++ = (INT8)((h_time % 10) + '0');
+    *p_out++ = ':';
+    *p_out++ = (INT8)((m_time / 10) + '0');
+    *p_out++ = (INT8)((m_time % 10) + '0');
+    *p_out++ = ':';
+    *p_out++ = (INT8)((s_time / 10) + '0');
+    *p_out++ = (INT8)((s_time % 10) + '0');
+    *p_out++ = ':';
+    *p_out++ = (INT8)((ms_time / 100) + '0');
+    *p_out++ = (INT8)(((ms_time / 10) % 10) + '0');
+    *p_out++ = ':';
+    *p_out   = 0;
+
+    return (tbuf);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_register_mempool
+**
+** Description      This function registers a specific memory pool.
+**
+** Parameters:      p_mem -  (input) pointer to the memory pool
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_register_mempool (void *p_mem)
+{
+    gki_cb.com.p_user_mempool = p_mem;
+}
+
+/*******************************************************************************
+**
+** Function         GKI_os_malloc
+**
+** Description      This function allocates memory
+**
+** Parameters:      size -  (input) The size of the memory that has to be
+**                  allocated
+**
+** Returns          the address of the memory allocated, or NULL if failed
+**
+*******************************************************************************/
+void *GKI_os_malloc (UINT32 size)
+{
+    return (malloc(size));
+}
+
+/*******************************************************************************
+**
+** Function         GKI_os_free
+**
+** Description      This function frees memory
+**
+** Parameters:      size -  (input) The address of the memory that has to be
+**                  freed
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_os_free (void *p_mem)
+{
+    if(p_mem != NULL)
+        free(p_mem);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_suspend_task()
+**
+** Description      Task suspension is not implemented.
+**
+** Returns          GKI_SUCCESS
+**
+*******************************************************************************/
+UINT8 GKI_suspend_task (UINT8 task_id)
+{
+    return (GKI_SUCCESS);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_resume_task()
+**
+** Description      Task suspension is not implemented.
+**
+** Returns          GKI_SUCCESS
+**
+*******************************************************************************/
+UINT8 GKI_resume_task (UINT8 task_id)
+{
+    return (GKI_SUCCESS);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_exit_task
+**
+** Description      This function is called to stop a GKI task. The task
+**                  thread exits the next time it is dispatched.
+**
+** Parameters:      task_id  - (input) the id of the task that has to be stopped
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_exit_task (UINT8 task_id)
+{
+    GKI_disable();
+    gki_cb.com.OSRdyTbl[task_id] = TASK_DEAD;
+
+    /* Return any free buffers the task still caches */
+    gki_buffer_flush_task_cache(task_id);
+
+    GKI_enable();
+
+    /* Wake the task so its thread can unwind */
+    pthread_mutex_lock(&gki_cb.os.sim_mutex);
+    if (gki_cb.os.task_state[task_id] == GKI_SIM_WAITING)
+    {
+        gki_cb.os.wake_set[task_id]   = FALSE;
+        gki_cb.os.task_state[task_id] = GKI_SIM_READY;
+    }
+    pthread_mutex_unlock(&gki_cb.os.sim_mutex);
+
+    GKI_TRACE_1("GKI_exit_task %d done", task_id);
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_sched_lock
+**
+** Description      This function is called by tasks to disable scheduler
+**                  task context switching.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_sched_lock(void)
+{
+    GKI_disable ();
+}
+
+
+/*******************************************************************************
+**
+** Function         GKI_sched_unlock
+**
+** Description      This function is called by tasks to enable scheduler switching.
+**
+** Returns          void
+**
+*******************************************************************************/
+void GKI_sched_unlock(void)
+{
+    GKI_enable ();
+}
+
+/*******************************************************************************
+**
+** Function         GKI_shiftdown
+**
+** Description      shift memory down (to make space to insert a record)
+**
+*******************************************************************************/
+void GKI_shiftdown (UINT8 *p_mem, UINT32 len, UINT32 shift_amount)
+{
+    register UINT8 *ps = p_mem + len - 1;
+    register UINT8 *pd = ps + shift_amount;
+    register UINT32 xx;
+
+    for (xx = 0; xx < len; xx++)
+        *pd-- = *ps--;
+}
+
+/*******************************************************************************
+**
+** Function         GKI_shiftup
+**
+** Description      shift memory up (to delete a record)
+**
+*******************************************************************************/
+void GKI_shiftup (UINT8 *p_dest, UINT8 *p_src, UINT32 len)
+{
+    register UINT8 *ps = p_src;
+    register UINT8 *pd = p_dest;
+    register UINT32 xx;
+
+    for (xx = 0; xx < len; xx++)
+        *pd++ = *ps++;
+}
@@ -15,6 +15,9 @@
  *  limitations under the License.
  *
  ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE     /* for the CPU_SET affinity macros */
+#endif
 #include <stdio.h>
 #include <stdarg.h>
 #include <errno.h>
@@ -23,8 +26,15 @@
 
 #include <pthread.h>  /* must be 1st header defined  */
 #include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include "gki_int.h"
 #include "gki_target.h"
+#if (GKI_WAIT_EVENTFD == TRUE)
+#include <poll.h>
+#include <sys/eventfd.h>
+#endif
 
 /* Temp android logging...move to android tgt config file */
 
@@ -53,6 +63,11 @@ tGKI_CB   gki_cb;
 
 /* works only for 1ms to 1000ms heart beat ranges */
 #define LINUX_SEC (1000/TICKS_PER_SEC)
+
+#if (GKI_TICKLESS_TIMER == TRUE)
+#define GKI_TICK_NSEC   ((UINT64) LINUX_SEC * NANOSEC_PER_MILLISEC)
+static UINT64 gki_monotonic_nsec (void);
+#endif
 // #define GKI_TICK_TIMER_DEBUG
 
 #define LOCK(m)  pthread_mutex_lock(&m)
@@ -88,6 +103,91 @@ typedef struct
 } gki_pthread_info_t;
 gki_pthread_info_t gki_pthread_info[GKI_MAX_TASKS];
 
+/*******************************************************************************
+**
+** Function         gki_set_thread_sched
+**
+** Description      Apply the scheduling policy, priority and CPU affinity
+**                  configured for a task to its thread. GKI_SCHED_DEFAULT
+**                  keeps the historical SCHED_RR priority derived from the
+**                  task id; a cpu_mask of 0 leaves the inherited affinity.
+**
+** Returns          GKI_SUCCESS if all settings were applied, else GKI_FAILURE
+**
+*******************************************************************************/
+static UINT8 gki_set_thread_sched (UINT8 task_id)
+{
+    tGKI_TASK_SCHED    *p_sched = &gki_cb.os.task_sched[task_id];
+    struct sched_param param;
+    int                policy;
+    UINT8              status = GKI_SUCCESS;
+    int                ret;
+
+    memset (&param, 0, sizeof (param));
+
+    switch (p_sched->policy)
+    {
+    case GKI_SCHED_FIFO:
+        policy = SCHED_FIFO;
+        param.sched_priority = p_sched->priority;
+        break;
+
+    case GKI_SCHED_RR:
+        policy = SCHED_RR;
+        param.sched_priority = p_sched->priority;
+        break;
+
+    case GKI_SCHED_DEFAULT:
+#if defined(PBS_SQL_TASK)
+        if (task_id == PBS_SQL_TASK)
+        {
+            GKI_TRACE_0("PBS SQL lowest priority task");
+            policy = SCHED_NORMAL;
+            break;
+        }
+#endif
+        policy = SCHED_RR;
+        param.sched_priority = 30 - task_id - 2;
+        break;
+
+    default:    /* GKI_SCHED_OTHER, GKI_set_task_sched() rejects anything else */
+        policy = SCHED_OTHER;
+        break;
+    }
+
+    ret = pthread_setschedparam (gki_cb.os.thread_id[task_id], policy, &param);
+    if (ret != 0)
+    {
+        /* the default policy is best effort, as it always has been */
+        if (p_sched->policy != GKI_SCHED_DEFAULT)
+        {
+            GKI_TRACE_ERROR_3 ("gki_set_thread_sched: task %d policy %d failed(%d)", task_id, policy, ret);
+            status = GKI_FAILURE;
+        }
+    }
+
+    if (p_sched->cpu_mask != 0)
+    {
+        cpu_set_t cpus;
+        int       cpu;
+
+        CPU_ZERO (&cpus);
+        for (cpu = 0; cpu < 32; cpu++)
+        {
+            if (p_sched->cpu_mask & (1UL << cpu))
+                CPU_SET (cpu, &cpus);
+        }
+
+        if (sched_setaffinity (gki_cb.os.thread_tid[task_id], sizeof (cpus), &cpus) != 0)
+        {
+            GKI_TRACE_ERROR_3 ("gki_set_thread_sched: task %d affinity 0x%x failed(%d)", task_id, p_sched->cpu_mask, errno);
+            status = GKI_FAILURE;
+        }
+    }
+
+    return (status);
+}
+
 /*******************************************************************************
 **
 ** Function         gki_task_entry
@@ -106,11 +206,17 @@ void gki_task_entry(UINT32 params)
                 p_pthread_info->pCond, p_pthread_info->pMutex);
 
     gki_cb.os.thread_id[p_pthread_info->task_id] = thread_id;
+    gki_cb.os.thread_tid[p_pthread_info->task_id] = (pid_t) syscall (__NR_gettid);
+
+    /* Scheduling is applied from inside the thread so the kernel tid is known */
+    gki_set_thread_sched (p_pthread_info->task_id);
+
     /* Call the actual thread entry point */
     (p_pthread_info->task_entry)(p_pthread_info->params);
 
     GKI_TRACE_1("gki_task task_id=%i terminating", p_pthread_info->task_id);
     gki_cb.os.thread_id[p_pthread_info->task_id] = 0;
+    gki_cb.os.thread_tid[p_pthread_info->task_id] = 0;
 
     pthread_exit(0);    /* GKI tasks have no return value */
 }
@@ -146,6 +252,7 @@ void GKI_init(void)
 {
     pthread_mutexattr_t attr;
     tGKI_OS             *p_os;
+    UINT8               task_id;
 
     memset (&gki_cb, 0, sizeof (gki_cb));
 
@@ -160,6 +267,17 @@ void GKI_init(void)
 #endif
     p_os = &gki_cb.os;
     pthread_mutex_init(&p_os->GKI_mutex, &attr);
+
+    /* Tasks keep the built-in priority scheme until configured otherwise */
+    for (task_id = 0; task_id < GKI_MAX_TASKS; task_id++)
+    {
+        p_os->task_sched[task_id].policy = GKI_SCHED_DEFAULT;
+#if (GKI_WAIT_EVENTFD == TRUE)
+        p_os->thread_evt_fd[task_id] = -1;
+        memset (p_os->task_fd[task_id], 0xFF, sizeof (p_os->task_fd[task_id]));
+#endif
+    }
+
     /* pthread_mutex_init(&GKI_sched_mutex, NULL); */
 #if (GKI_DEBUG == TRUE)
     pthread_mutex_init(&p_os->GKI_trace_mutex, NULL);
@@ -171,7 +289,20 @@ void GKI_init(void)
      * this works too even if GKI_NO_TICK_STOP is defined in btld.txt */
     p_os->no_timer_suspend = GKI_TIMER_TICK_RUN_COND;
     pthread_mutex_init(&p_os->gki_timer_mutex, NULL);
+#if (GKI_TICKLESS_TIMER == TRUE)
+    /* the tickless timer thread waits for absolute CLOCK_MONOTONIC deadlines */
+    {
+        pthread_condattr_t cond_attr;
+
+        pthread_condattr_init(&cond_attr);
+        pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&p_os->gki_timer_cond, &cond_attr);
+        pthread_condattr_destroy(&cond_attr);
+    }
+    p_os->timer_epoch_ns = gki_monotonic_nsec ();
+#else
     pthread_cond_init(&p_os->gki_timer_cond, NULL);
+#endif
 }
 
 
@@ -215,8 +346,7 @@ UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16
 {
     UINT16  i;
     UINT8   *p;
-    struct sched_param param;
-    int policy, ret = 0;
+    int ret = 0;
     pthread_condattr_t attr;
     pthread_attr_t attr1;
 
@@ -242,6 +372,16 @@ UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16
     pthread_mutex_init(&gki_cb.os.thread_timeout_mutex[task_id], NULL);
     pthread_cond_init (&gki_cb.os.thread_timeout_cond[task_id], &attr);
 
+#if (GKI_WAIT_EVENTFD == TRUE)
+    if (gki_cb.os.thread_evt_fd[task_id] < 0)
+        gki_cb.os.thread_evt_fd[task_id] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (gki_cb.os.thread_evt_fd[task_id] < 0)
+    {
+        GKI_TRACE_ERROR_2 ("GKI_create_task: eventfd failed(%d), %s!", errno, taskname);
+        return (GKI_FAILURE);
+    }
+#endif
+
     pthread_attr_init(&attr1);
     /* by default, pthread creates a joinable thread */
 #if ( FALSE == GKI_PTHREAD_JOINABLE )
@@ -271,22 +411,7 @@ UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16
          return GKI_FAILURE;
     }
 
-    if(pthread_getschedparam(gki_cb.os.thread_id[task_id], &policy, &param)==0)
-    {
-#if defined(PBS_SQL_TASK)
-         if (task_id == PBS_SQL_TASK)
-         {
-             GKI_TRACE_0("PBS SQL lowest priority task");
-             policy = SCHED_NORMAL;
-         }
-         else
-#endif
-         {
-             policy = SCHED_RR;
-             param.sched_priority = 30 - task_id - 2;
-         }
-         pthread_setschedparam(gki_cb.os.thread_id[task_id], policy, &param);
-     }
+    /* Scheduling policy and affinity are applied by gki_task_entry() */
 
     GKI_TRACE_6( "Leaving GKI_create_task %x %d %x %s %x %d",
               task_entry,
@@ -299,6 +424,100 @@ UINT8 GKI_create_task (TASKPTR task_entry, UINT8 task_id, INT8 *taskname, UINT16
     return (GKI_SUCCESS);
 }
 
+/*******************************************************************************
+**
+** Function         GKI_set_task_sched
+**
+** Description      This function is called to configure the scheduling policy,
+**                  priority and CPU affinity of a task. Settings made before
+**                  GKI_create_task() are applied when the task starts; a
+**                  running task is updated immediately.
+**
+** Parameters:      task_id  - (input) task to configure
+**                  p_sched  - (input) policy (GKI_SCHED_xxx), priority and
+**                                     CPU mask (bit n = CPU n, 0 = any)
+**
+** Returns          GKI_SUCCESS if all OK, GKI_FAILURE if any problem
+**
+*******************************************************************************/
+UINT8 GKI_set_task_sched (UINT8 task_id, tGKI_TASK_SCHED *p_sched)
+{
+    if ((task_id >= GKI_MAX_TASKS) || (p_sched == NULL))
+        return (GKI_FAILURE);
+
+    GKI_TRACE_4 ("GKI_set_task_sched task %d policy %d prio %d cpus 0x%x",
+                 task_id, p_sched->policy, p_sched->priority, p_sched->cpu_mask);
+
+    if (  (p_sched->policy != GKI_SCHED_OTHER) && (p_sched->policy != GKI_SCHED_FIFO)
+        &&(p_sched->policy != GKI_SCHED_RR) && (p_sched->policy != GKI_SCHED_DEFAULT)  )
+    {
+        GKI_TRACE_ERROR_2 ("GKI_set_task_sched: task %d unknown policy %d", task_id, p_sched->policy);
+        return (GKI_FAILURE);
+    }
+
+    gki_cb.os.task_sched[task_id] = *p_sched;
+
+    if (gki_cb.os.thread_tid[task_id] != 0)
+        return (gki_set_thread_sched (task_id));
+
+    return (GKI_SUCCESS);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_get_task_sched
+**
+** Description      This function is called to read back the scheduling of a
+**                  task. For a running task the values reported by the OS
+**                  are returned, otherwise the configured ones.
+**
+** Parameters:      task_id  - (input) task to query
+**                  p_sched  - (output) policy, priority and CPU mask (first
+**                                      32 CPUs only)
+**
+** Returns          GKI_SUCCESS if all OK, GKI_FAILURE if any problem
+**
+*******************************************************************************/
+UINT8 GKI_get_task_sched (UINT8 task_id, tGKI_TASK_SCHED *p_sched)
+{
+    struct sched_param param;
+    cpu_set_t          cpus;
+    int                policy;
+    int                cpu;
+
+    if ((task_id >= GKI_MAX_TASKS) || (p_sched == NULL))
+        return (GKI_FAILURE);
+
+    *p_sched = gki_cb.os.task_sched[task_id];
+
+    if (gki_cb.os.thread_tid[task_id] == 0)
+        return (GKI_SUCCESS);
+
+    if (pthread_getschedparam (gki_cb.os.thread_id[task_id], &policy, &param) == 0)
+    {
+        if (policy == SCHED_FIFO)
+            p_sched->policy = GKI_SCHED_FIFO;
+        else if (policy == SCHED_RR)
+            p_sched->policy = GKI_SCHED_RR;
+        else
+            p_sched->policy = GKI_SCHED_OTHER;
+        p_sched->priority = (UINT8) param.sched_priority;
+    }
+
+    CPU_ZERO (&cpus);
+    if (sched_getaffinity (gki_cb.os.thread_tid[task_id], sizeof (cpus), &cpus) == 0)
+    {
+        p_sched->cpu_mask = 0;
+        for (cpu = 0; cpu < 32; cpu++)
+        {
+            if (CPU_ISSET (cpu, &cpus))
+                p_sched->cpu_mask |= (1UL << cpu);
+        }
+    }
+
+    return (GKI_SUCCESS);
+}
+
 /*******************************************************************************
 **
 ** Function         GKI_shutdown
@@ -358,6 +577,13 @@ void GKI_shutdown(void)
         }
     }
 
+#if (GKI_ELASTIC_POOLS == TRUE)
+    /* give the grown pool slabs back to the OS */
+    GKI_disable();
+    gki_buffer_free_slabs();
+    GKI_enable();
+#endif
+
     /* Destroy mutex and condition variable objects */
     pthread_mutex_destroy(&gki_cb.os.GKI_mutex);
     /*    pthread_mutex_destroy(&GKI_sched_mutex); */
@@ -381,7 +607,12 @@ void GKI_shutdown(void)
     }
     oldCOnd = *p_run_cond;
     *p_run_cond = GKI_TIMER_TICK_EXIT_COND;
+#if (GKI_TICKLESS_TIMER == TRUE)
+    /* the tickless timer thread also sleeps while timers are running */
+    if (oldCOnd != GKI_TIMER_TICK_EXIT_COND)
+#else
     if (oldCOnd == GKI_TIMER_TICK_STOP_COND)
+#endif
         pthread_cond_signal( &gki_cb.os.gki_timer_cond );
 
 }
@@ -421,6 +652,12 @@ void gki_system_tick_start_stop_cback(BOOLEAN start)
         /* restart GKI_timer_update() loop */
         acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_ID);
         gki_cb.os.gki_timer_wake_lock_on = 1;
+#if (GKI_TICKLESS_TIMER == TRUE)
+        /* ticks are counted from now; OSTicks does not advance while stopped */
+        __sync_add_and_fetch (&gki_cb.os.timer_seq, 1);
+        gki_cb.os.timer_epoch_ns = gki_monotonic_nsec ();
+        __sync_add_and_fetch (&gki_cb.os.timer_seq, 1);
+#endif
         *p_run_cond = GKI_TIMER_TICK_RUN_COND;
         pthread_mutex_lock( &p_os->gki_timer_mutex );
         pthread_cond_signal( &p_os->gki_timer_cond );
@@ -433,6 +670,166 @@ void gki_system_tick_start_stop_cback(BOOLEAN start)
 }
 
 
+#if (GKI_TICKLESS_TIMER == TRUE)
+/*******************************************************************************
+**
+** Function         gki_monotonic_nsec
+**
+** Description      Read CLOCK_MONOTONIC
+**
+** Returns          time in nanoseconds
+**
+*******************************************************************************/
+static UINT64 gki_monotonic_nsec (void)
+{
+    struct timespec now;
+
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return ((UINT64) now.tv_sec * NSEC_PER_SEC + now.tv_nsec);
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_pending_ticks
+**
+** Description      Returns the number of whole ticks elapsed since the last
+**                  GKI_timer_update(), which the timer thread has not credited
+**                  yet. Zero if the system tick is stopped.
+**
+** Returns          number of ticks
+**
+*******************************************************************************/
+UINT32 gki_timer_pending_ticks (void)
+{
+    if (gki_cb.os.no_timer_suspend != GKI_TIMER_TICK_RUN_COND)
+        return (0);
+
+    return ((UINT32) ((gki_monotonic_nsec () - gki_cb.os.timer_epoch_ns) / GKI_TICK_NSEC));
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_tick_count
+**
+** Description      Returns OSTicks plus the ticks the timer thread has not
+**                  credited yet. Takes no lock; it retries if the timer thread
+**                  updated OSTicks meanwhile.
+**
+** Returns          current number of system ticks
+**
+*******************************************************************************/
+UINT32 gki_timer_tick_count (void)
+{
+    UINT32 seq;
+    UINT32 ticks;
+
+    do
+    {
+        seq = gki_cb.os.timer_seq;
+        __sync_synchronize ();
+        ticks = gki_cb.com.OSTicks + gki_timer_pending_ticks ();
+        __sync_synchronize ();
+    } while ((seq & 1) || (seq != gki_cb.os.timer_seq));
+
+    return (ticks);
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_catch_up
+**
+** Description      Calls GKI_timer_update() with the number of whole ticks
+**                  elapsed since the last update, if the system tick is running.
+**                  Only called by the timer thread, with GKI disabled.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_catch_up (void)
+{
+    UINT32 ticks = gki_timer_pending_ticks ();
+
+    if (ticks > 0)
+    {
+        /* let gki_timer_tick_count() see the epoch and OSTicks change together */
+        __sync_add_and_fetch (&gki_cb.os.timer_seq, 1);
+        gki_cb.os.timer_epoch_ns += (UINT64) ticks * GKI_TICK_NSEC;
+        GKI_timer_update ((INT32) ticks);
+        __sync_add_and_fetch (&gki_cb.os.timer_seq, 1);
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_rearm
+**
+** Description      Wakes up the timer thread so it recomputes its deadline.
+**                  Called with GKI disabled when the first expiration moves
+**                  earlier.
+**
+** Returns          void
+**
+*******************************************************************************/
+void gki_timer_rearm (void)
+{
+    pthread_mutex_lock (&gki_cb.os.gki_timer_mutex);
+    pthread_cond_signal (&gki_cb.os.gki_timer_cond);
+    pthread_mutex_unlock (&gki_cb.os.gki_timer_mutex);
+}
+
+/*******************************************************************************
+**
+** Function         gki_timer_run_tickless
+**
+** Description      Timer thread loop. Sleeps until the next GKI timer expiration
+**                  (or the system tick stop delay), then updates the timers with
+**                  the ticks that have elapsed. Returns on GKI shutdown.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_timer_run_tickless (void)
+{
+    volatile int    *p_run_cond = &gki_cb.os.no_timer_suspend;
+    struct timespec deadline;
+    UINT64          deadline_ns;
+    INT32           ticks;
+
+    while (GKI_TIMER_TICK_EXIT_COND != *p_run_cond)
+    {
+        GKI_disable();
+
+        gki_timer_catch_up ();
+
+        /* Ticks from the last update to the next thing that needs the timer thread */
+        ticks = gki_cb.com.OSTicksTilExp;
+#if (defined(GKI_DELAY_STOP_SYS_TICK) && (GKI_DELAY_STOP_SYS_TICK > 0))
+        if ((gki_cb.com.OSTicksTilStop > 0) && ((ticks <= 0) || ((INT32) gki_cb.com.OSTicksTilStop < ticks)))
+            ticks = gki_cb.com.OSTicksTilStop;
+#endif
+        deadline_ns = gki_cb.os.timer_epoch_ns + (UINT64) ticks * GKI_TICK_NSEC;
+
+        /* Take the timer mutex before enabling GKI so a re-arm cannot be missed */
+        pthread_mutex_lock (&gki_cb.os.gki_timer_mutex);
+        GKI_enable();
+
+        if ((GKI_TIMER_TICK_RUN_COND == *p_run_cond) && (ticks > 0))
+        {
+            deadline.tv_sec  = deadline_ns / NSEC_PER_SEC;
+            deadline.tv_nsec = deadline_ns % NSEC_PER_SEC;
+            pthread_cond_timedwait (&gki_cb.os.gki_timer_cond, &gki_cb.os.gki_timer_mutex, &deadline);
+        }
+        else if (GKI_TIMER_TICK_EXIT_COND != *p_run_cond)
+        {
+            /* Nothing to time, wait for a timer to be started */
+            pthread_cond_wait (&gki_cb.os.gki_timer_cond, &gki_cb.os.gki_timer_mutex);
+        }
+
+        pthread_mutex_unlock (&gki_cb.os.gki_timer_mutex);
+    }
+}
+#endif
+
 /*******************************************************************************
 **
 ** Function         timer_thread
@@ -489,9 +886,11 @@ void timer_thread(signed long id)
 void GKI_run (void *p_task_id)
 {
     GKI_TRACE_1("%s enter", __func__);
+#if !defined(NO_GKI_RUN_RETURN) && (GKI_TICKLESS_TIMER == FALSE)
     struct timespec delay;
     int err = 0;
     volatile int * p_run_cond = &gki_cb.os.no_timer_suspend;
+#endif
 
 #ifndef GKI_NO_TICK_STOP
     /* register start stop function which disable timer loop in GKI_run() when no timers are
@@ -516,6 +915,9 @@ void GKI_run (void *p_task_id)
         GKI_TRACE_0("GKI_run: pthread_create failed to create timer_thread!");
         return GKI_FAILURE;
     }
+#elif (GKI_TICKLESS_TIMER == TRUE)
+    GKI_TRACE_2("%s: tickless, run_cond=%d ", __func__, gki_cb.os.no_timer_suspend);
+    gki_timer_run_tickless ();
 #else
     GKI_TRACE_2("GKI_run, run_cond(%x)=%d ", p_run_cond, *p_run_cond);
     for (;GKI_TIMER_TICK_EXIT_COND != *p_run_cond;)
@@ -598,6 +1000,100 @@ void GKI_stop (void)
 }
 
 
+#if (GKI_WAIT_EVENTFD == TRUE)
+/*******************************************************************************
+**
+** Function         gki_wait_fds
+**
+** Description      Block the calling task in poll() on its eventfd and on the
+**                  registered file descriptors whose event is part of 'flag'.
+**                  Called and returns with thread_evt_mutex[rtask] locked.
+**                  Readable descriptors set their event in OSWaitEvt.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_wait_fds (UINT8 rtask, UINT16 flag, UINT32 timeout)
+{
+    tGKI_OS       *p_os = &gki_cb.os;
+    struct pollfd fds[GKI_MAX_TASK_FDS + 1];
+    UINT16        fd_evt[GKI_MAX_TASK_FDS + 1];
+    int           nfds = 1;
+    int           xx;
+    UINT64        count;
+    ssize_t       ret;
+
+    fds[0].fd      = p_os->thread_evt_fd[rtask];
+    fds[0].events  = POLLIN;
+    fds[0].revents = 0;
+
+    for (xx = 0; xx < GKI_MAX_TASK_FDS; xx++)
+    {
+        if ((p_os->task_fd[rtask][xx] >= 0) && (p_os->task_fd_evt[rtask][xx] & flag))
+        {
+            fds[nfds].fd      = p_os->task_fd[rtask][xx];
+            fds[nfds].events  = POLLIN;
+            fds[nfds].revents = 0;
+            fd_evt[nfds++]    = p_os->task_fd_evt[rtask][xx];
+        }
+    }
+
+    /* senders only kick the eventfd while this flag is set */
+    p_os->thread_evt_polling[rtask] = TRUE;
+    pthread_mutex_unlock(&p_os->thread_evt_mutex[rtask]);
+
+    if (poll (fds, nfds, timeout ? (int) timeout : -1) > 0)
+    {
+        if (fds[0].revents & POLLIN)
+        {
+            do
+                ret = read (fds[0].fd, &count, sizeof (count));
+            while ((ret < 0) && (errno == EINTR));
+
+            /* EAGAIN: nothing left to consume, the kick was already taken */
+            if ((ret < 0) && (errno != EAGAIN))
+                GKI_TRACE_ERROR_2 ("gki_wait_fds: task %d eventfd read failed(%d)", rtask, errno);
+        }
+    }
+
+    pthread_mutex_lock(&p_os->thread_evt_mutex[rtask]);
+    p_os->thread_evt_polling[rtask] = FALSE;
+
+    for (xx = 1; xx < nfds; xx++)
+    {
+        if (fds[xx].revents & (POLLIN | POLLERR | POLLHUP))
+            gki_cb.com.OSWaitEvt[rtask] |= fd_evt[xx];
+    }
+}
+
+/*******************************************************************************
+**
+** Function         gki_kick_task
+**
+** Description      Wake a task blocked in gki_wait_fds(). Must be called with
+**                  thread_evt_mutex[task_id] locked.
+**
+** Returns          void
+**
+*******************************************************************************/
+static void gki_kick_task (UINT8 task_id)
+{
+    UINT64  one = 1;
+    ssize_t ret;
+
+    if (gki_cb.os.thread_evt_polling[task_id])
+    {
+        do
+            ret = write (gki_cb.os.thread_evt_fd[task_id], &one, sizeof (one));
+        while ((ret < 0) && (errno == EINTR));
+
+        /* EAGAIN: the counter is already non-zero, so the task wakes up anyway */
+        if ((ret < 0) && (errno != EAGAIN))
+            GKI_TRACE_ERROR_2 ("gki_kick_task: task %d eventfd write failed(%d)", task_id, errno);
+    }
+}
+#endif
+
 /*******************************************************************************
 **
 ** Function         GKI_wait
@@ -618,9 +1114,11 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
 {
     UINT16 evt;
     UINT8 rtask;
+#if (GKI_WAIT_EVENTFD == FALSE)
     struct timespec abstime = { 0, 0 };
     int sec;
     int nano_sec;
+#endif
 
     rtask = GKI_get_taskid();
     GKI_TRACE_3("GKI_wait %d %x %d", rtask, flag, timeout);
@@ -644,22 +1142,22 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
     /* protect OSWaitEvt[rtask] from modification from an other thread */
     pthread_mutex_lock(&gki_cb.os.thread_evt_mutex[rtask]);
 
-#if 0 /* for clean scheduling we probably should always call pthread_cond_wait() */
-    /* Check if anything in any of the mailboxes. There is a potential race condition where OSTaskQFirst[rtask]
-     has been modified. however this should only result in addtional call to  pthread_cond_wait() but as
-     the cond is met, it will exit immediately (depending on schedulling) */
-    if (gki_cb.com.OSTaskQFirst[rtask][0])
-    gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
-    if (gki_cb.com.OSTaskQFirst[rtask][1])
-    gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
-    if (gki_cb.com.OSTaskQFirst[rtask][2])
-    gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
-    if (gki_cb.com.OSTaskQFirst[rtask][3])
-    gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
-#endif
+    /* Check if anything is waiting in any of the mailboxes. Senders only signal when they
+     * find a mailbox empty, so a message left unread by the task must be reported here */
+    if (GKI_MBOX_PENDING(rtask, 0))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 1))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 2))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
+    if (GKI_MBOX_PENDING(rtask, 3))
+        gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
 
     if (!(gki_cb.com.OSWaitEvt[rtask] & flag))
     {
+#if (GKI_WAIT_EVENTFD == TRUE)
+        gki_wait_fds (rtask, flag, timeout);
+#else
         if (timeout)
         {
             //            timeout = GKI_MS_TO_TICKS(timeout);     /* convert from milliseconds to ticks */
@@ -689,19 +1187,20 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
         {
             pthread_cond_wait(&gki_cb.os.thread_evt_cond[rtask], &gki_cb.os.thread_evt_mutex[rtask]);
         }
+#endif
 
         /* TODO: check, this is probably neither not needed depending on phtread_cond_wait() implmentation,
          e.g. it looks like it is implemented as a counter in which case multiple cond_signal
          should NOT be lost! */
         // we are waking up after waiting for some events, so refresh variables
         // no need to call GKI_disable() here as we know that we will have some events as we've been waking up after condition pending or timeout
-        if (gki_cb.com.OSTaskQFirst[rtask][0])
+        if (GKI_MBOX_PENDING(rtask, 0))
             gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_0_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][1])
+        if (GKI_MBOX_PENDING(rtask, 1))
             gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_1_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][2])
+        if (GKI_MBOX_PENDING(rtask, 2))
             gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_2_EVT_MASK;
-        if (gki_cb.com.OSTaskQFirst[rtask][3])
+        if (GKI_MBOX_PENDING(rtask, 3))
             gki_cb.com.OSWaitEvt[rtask] |= TASK_MBOX_3_EVT_MASK;
 
         if (gki_cb.com.OSRdyTbl[rtask] == TASK_DEAD)
@@ -712,6 +1211,7 @@ UINT16 GKI_wait (UINT16 flag, UINT32 timeout)
             BT_TRACE_1( TRACE_LAYER_HCI, TRACE_TYPE_DEBUG, "GKI TASK_DEAD received. exit thread %d...", rtask );
 
             gki_cb.os.thread_id[rtask] = 0;
+            gki_cb.os.thread_tid[rtask] = 0;
             pthread_exit(NULL);
             return (EVENT_MASK(GKI_SHUTDOWN_EVT));
         }
@@ -806,7 +1306,11 @@ UINT8 GKI_send_event (UINT8 task_id, UINT16 event)
         /* Set the event bit */
         gki_cb.com.OSWaitEvt[task_id] |= event;
 
+#if (GKI_WAIT_EVENTFD == TRUE)
+        gki_kick_task (task_id);
+#else
         pthread_cond_signal(&gki_cb.os.thread_evt_cond[task_id]);
+#endif
 
         pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[task_id]);
 
@@ -816,6 +1320,105 @@ UINT8 GKI_send_event (UINT8 task_id, UINT16 event)
     return (GKI_FAILURE);
 }
 
+#if (GKI_WAIT_EVENTFD == TRUE)
+/*******************************************************************************
+**
+** Function         GKI_register_fd
+**
+** Description      This function is called to let a task wait on a file
+**                  descriptor. Whenever the task calls GKI_wait() with 'event'
+**                  in its mask and 'fd' is readable (or in error), 'event' is
+**                  returned. The descriptor is level triggered, so the task
+**                  must drain it before waiting again. Registering an fd
+**                  that is already registered updates its event.
+**
+** Parameters:      task_id -  (input) task that waits on the descriptor
+**                  fd      -  (input) file descriptor to poll for input
+**                  event   -  (input) event mask raised when fd is readable
+**
+** Returns          GKI_SUCCESS if all OK, else GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_register_fd (UINT8 task_id, int fd, UINT16 event)
+{
+    int   xx;
+    int   slot = -1;
+
+    if ((task_id >= GKI_MAX_TASKS) || (fd < 0) || (event == 0))
+        return (GKI_FAILURE);
+
+    pthread_mutex_lock(&gki_cb.os.thread_evt_mutex[task_id]);
+
+    for (xx = 0; xx < GKI_MAX_TASK_FDS; xx++)
+    {
+        if (gki_cb.os.task_fd[task_id][xx] == fd)
+        {
+            slot = xx;
+            break;
+        }
+        if ((slot < 0) && (gki_cb.os.task_fd[task_id][xx] < 0))
+            slot = xx;
+    }
+
+    if (slot >= 0)
+    {
+        gki_cb.os.task_fd[task_id][slot]     = fd;
+        gki_cb.os.task_fd_evt[task_id][slot] = event;
+
+        /* make a blocked task pick up the new descriptor */
+        gki_kick_task (task_id);
+    }
+
+    pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[task_id]);
+
+    GKI_TRACE_3("GKI_register_fd task %d fd %d slot %d", task_id, fd, slot);
+    return ((slot >= 0) ? GKI_SUCCESS : GKI_FAILURE);
+}
+
+/*******************************************************************************
+**
+** Function         GKI_deregister_fd
+**
+** Description      This function is called to stop a task waiting on a file
+**                  descriptor registered with GKI_register_fd(). It must be
+**                  called before the descriptor is closed.
+**
+** Parameters:      task_id -  (input) task that waits on the descriptor
+**                  fd      -  (input) file descriptor to remove
+**
+** Returns          GKI_SUCCESS if all OK, else GKI_FAILURE
+**
+*******************************************************************************/
+UINT8 GKI_deregister_fd (UINT8 task_id, int fd)
+{
+    int   xx;
+    UINT8 status = GKI_FAILURE;
+
+    if ((task_id >= GKI_MAX_TASKS) || (fd < 0))
+        return (GKI_FAILURE);
+
+    pthread_mutex_lock(&gki_cb.os.thread_evt_mutex[task_id]);
+
+    for (xx = 0; xx < GKI_MAX_TASK_FDS; xx++)
+    {
+        if (gki_cb.os.task_fd[task_id][xx] == fd)
+        {
+            gki_cb.os.task_fd[task_id][xx] = -1;
+            status = GKI_SUCCESS;
+        }
+    }
+
+    /* make a blocked task drop the descriptor from its poll set */
+    if (status == GKI_SUCCESS)
+        gki_kick_task (task_id);
+
+    pthread_mutex_unlock(&gki_cb.os.thread_evt_mutex[task_id]);
+
+    GKI_TRACE_2("GKI_deregister_fd task %d fd %d", task_id, fd);
+    return (status);
+}
+#endif
+
 
 /*******************************************************************************
 **
@@ -1200,12 +1803,24 @@ void GKI_exit_task (UINT8 task_id)
     GKI_disable();
     gki_cb.com.OSRdyTbl[task_id] = TASK_DEAD;
 
+    /* Return any free buffers the task still caches */
+    gki_buffer_flush_task_cache(task_id);
+
     /* Destroy mutex and condition variable objects */
     pthread_mutex_destroy(&gki_cb.os.thread_evt_mutex[task_id]);
     pthread_cond_destroy (&gki_cb.os.thread_evt_cond[task_id]);
     pthread_mutex_destroy(&gki_cb.os.thread_timeout_mutex[task_id]);
     pthread_cond_destroy (&gki_cb.os.thread_timeout_cond[task_id]);
 
+#if (GKI_WAIT_EVENTFD == TRUE)
+    if (gki_cb.os.thread_evt_fd[task_id] >= 0)
+    {
+        close (gki_cb.os.thread_evt_fd[task_id]);
+        gki_cb.os.thread_evt_fd[task_id] = -1;
+    }
+    memset (gki_cb.os.task_fd[task_id], 0xFF, sizeof (gki_cb.os.task_fd[task_id]));
+#endif
+
     GKI_enable();
 
 	//GKI_send_event(task_id, EVENT_MASK(GKI_SHUTDOWN_EVT));
@@ -133,6 +133,32 @@
 #define GKI_DELAY_STOP_SYS_TICK     10
 #endif
 
+/* TRUE if the timer thread sleeps until the next timer expiration instead of waking every tick. */
+#ifndef GKI_TICKLESS_TIMER
+#define GKI_TICKLESS_TIMER          TRUE
+#endif
+
+/* TRUE if GKI_wait() blocks in poll() on a per-task eventfd, so tasks can also wait on registered file descriptors. */
+#ifndef GKI_WAIT_EVENTFD
+#define GKI_WAIT_EVENTFD            TRUE
+#endif
+
+/* Maximum number of file descriptors a task can register with GKI_register_fd(). */
+#ifndef GKI_MAX_TASK_FDS
+#define GKI_MAX_TASK_FDS            2
+#endif
+
+/* TRUE to count live and peak buffers per GKI_getbuf()/GKI_getpoolbuf() call site (see GKI_buf_site_dump). */
+#ifndef GKI_BUF_TRACKER
+#define GKI_BUF_TRACKER             FALSE
+#endif
+
+/* Number of call sites the buffer tracker can tell apart (at most 256). Site 0 collects
+ * untracked allocations and the last site collects call sites that did not fit. */
+#ifndef GKI_BUF_TRACKER_MAX_SITES
+#define GKI_BUF_TRACKER_MAX_SITES   128
+#endif
+
 /* Option to guarantee no preemption during timer expiration (most system don't need this) */
 #ifndef GKI_TIMER_LIST_NOPREEMPT
 #define GKI_TIMER_LIST_NOPREEMPT    FALSE
@@ -213,6 +239,32 @@
 #define GKI_DEF_BUFPOOL_PERM_MASK   0xfff0
 #endif
 
+/* TRUE if each task keeps a small lock-free cache of free buffers per fixed pool. */
+#ifndef GKI_TASK_BUF_CACHE
+#define GKI_TASK_BUF_CACHE          TRUE
+#endif
+
+/* Maximum number of free buffers a task caches per pool (refilled and drained in halves). */
+#ifndef GKI_TASK_BUF_CACHE_SIZE
+#define GKI_TASK_BUF_CACHE_SIZE     8
+#endif
+
+/* TRUE if an exhausted fixed pool may grow by slabs of extra buffers, which are
+** returned to the OS once they have been completely free for a while. */
+#ifndef GKI_ELASTIC_POOLS
+#define GKI_ELASTIC_POOLS           TRUE
+#endif
+
+/* Maximum number of slabs a pool may add. Each slab holds a quarter of the pool's GKI_BUFx_MAX. */
+#ifndef GKI_ELASTIC_MAX_SLABS
+#define GKI_ELASTIC_MAX_SLABS       4
+#endif
+
+/* Number of GKI ticks a slab must stay completely free before it is released. */
+#ifndef GKI_ELASTIC_IDLE_TICKS
+#define GKI_ELASTIC_IDLE_TICKS      (5 * TICKS_PER_SEC)
+#endif
+
 /* The buffer corruption check flag. */
 #ifndef GKI_ENABLE_BUF_CORRUPTION_CHECK
 #define GKI_ENABLE_BUF_CORRUPTION_CHECK TRUE
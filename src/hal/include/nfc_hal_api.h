@@ -86,6 +86,7 @@ typedef void (tHAL_API_OPEN) (tHAL_NFC_CBACK *p_hal_cback, tHAL_NFC_DATA_CBACK *
 typedef void (tHAL_API_CLOSE) (void);
 typedef void (tHAL_API_CORE_INITIALIZED) (UINT8 *p_core_init_rsp_params);
 typedef void (tHAL_API_WRITE) (UINT16 data_len, UINT8 *p_data);
+typedef void (tHAL_API_WRITE_BATCH) (UINT8 num_pkts, UINT16 *p_data_len, UINT8 **pp_data);
 typedef BOOLEAN (tHAL_API_PREDISCOVER) (void);
 typedef void (tHAL_API_CONTROL_GRANTED) (void);
 typedef void (tHAL_API_POWER_CYCLE) (void);
@@ -123,6 +124,7 @@ typedef struct
     tHAL_API_CONTROL_GRANTED *control_granted;
     tHAL_API_POWER_CYCLE *power_cycle;
     tHAL_API_GET_MAX_NFCEE *get_max_ee;
+    tHAL_API_WRITE_BATCH *write_batch;      /* optional: NULL if packets can only be written one at a time */
 
 
 } tHAL_NFC_ENTRY;
@@ -221,6 +223,20 @@ EXPORT_HAL_API void HAL_NfcCoreInitialized (UINT8 *p_core_init_rsp_params);
 *******************************************************************************/
 EXPORT_HAL_API void HAL_NfcWrite (UINT16 data_len, UINT8 *p_data);
 
+/*******************************************************************************
+**
+** Function         HAL_NfcWriteBatch
+**
+** Description      Send several NCI control messages or data packets to the
+**                  transport, as HAL_NfcWrite does for each of them. Data
+**                  packets sent together are written to the transport
+**                  together.
+**
+** Returns          void
+**
+*******************************************************************************/
+EXPORT_HAL_API void HAL_NfcWriteBatch (UINT8 num_pkts, UINT16 *p_data_len, UINT8 **pp_data);
+
 /*******************************************************************************
 **
 ** Function         HAL_NfcPreDiscover
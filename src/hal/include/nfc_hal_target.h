@@ -36,6 +36,12 @@
 #define NFC_HAL_NCI_MSG_OFFSET_SIZE             1
 #endif
 
+/* Number of bytes to reserve in front of received NCI messages (with shared NFC/HAL GKI,
+** the buffer goes on to NFC_TASK as it is) */
+#ifndef NFC_HAL_NCI_RECEIVE_OFFSET
+#define NFC_HAL_NCI_RECEIVE_OFFSET              0
+#endif
+
 /* NFC-WAKE */
 #ifndef NFC_HAL_LP_NFC_WAKE_GPIO
 #define NFC_HAL_LP_NFC_WAKE_GPIO                UPIO_GENERAL3
@@ -46,6 +52,21 @@
 #define NFC_HAL_LP_IDLE_TIMEOUT                 100
 #endif
 
+/* TRUE to learn the idle timeout from the gaps between NCI packets, with
+** NFC_HAL_LP_IDLE_TIMEOUT as the initial value */
+#ifndef NFC_HAL_LP_ADAPTIVE
+#define NFC_HAL_LP_ADAPTIVE                     TRUE
+#endif
+
+/* bounds of the learned idle timeout in ms */
+#ifndef NFC_HAL_LP_IDLE_TIMEOUT_MIN
+#define NFC_HAL_LP_IDLE_TIMEOUT_MIN             20
+#endif
+
+#ifndef NFC_HAL_LP_IDLE_TIMEOUT_MAX
+#define NFC_HAL_LP_IDLE_TIMEOUT_MAX             1000
+#endif
+
 /* NFC snooze mode */
 #ifndef NFC_HAL_LP_SNOOZE_MODE
 #define NFC_HAL_LP_SNOOZE_MODE                  NFC_HAL_LP_SNOOZE_MODE_UART
@@ -98,6 +119,13 @@
 #define NFC_HAL_PRM_MIN_NCI_CMD_PAYLOAD_SIZE    (32)
 #endif
 
+/* Number of SPD segments sent ahead of their responses during secure patch download.  */
+/* 1 waits for each response before sending the next segment; only raise it (or call   */
+/* HAL_NfcPrmSetSpdWindow) for NFCCs that queue several SECURE_PATCH_DOWNLOAD commands  */
+#ifndef NFC_HAL_PRM_SPD_WINDOW
+#define NFC_HAL_PRM_SPD_WINDOW                  (1)
+#endif
+
 /* amount of time to wait for authenticating/committing patch to NVM */
 #ifndef NFC_HAL_PRM_COMMIT_DELAY
 #define NFC_HAL_PRM_COMMIT_DELAY                (30000)
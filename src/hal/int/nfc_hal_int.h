@@ -298,6 +298,8 @@ typedef UINT8 tNFC_HAL_PRM_STATE;
 #define NFC_HAL_PRM_MAX_PATCH_COUNT    2
 #define NFC_HAL_PRM_PATCH_MASK_ALL     0xFFFFFFFF
 #define NFC_HAL_PRM_MAX_CHIP_VER_LEN   8
+/* Maximum number of SPD segments in flight (see HAL_NfcPrmSetSpdWindow) */
+#define NFC_HAL_PRM_MAX_SPD_WINDOW     8
 
 /* Structures for PRM Control Block */
 typedef struct
@@ -322,9 +324,16 @@ typedef struct
     UINT32              spd_patch_needed_mask;  /* Mask of patches that need to be downloaded */
     UINT8               spd_patch_count;        /* Number of patches left to download */
     UINT8               spd_cur_patch_idx;      /* Current patch being downloaded */
+    BOOLEAN             spd_up_to_date;         /* TRUE if version check found NVM up to date (nothing downloaded) */
 
     tNFC_HAL_PRM_PATCHDESC spd_patch_desc[NFC_HAL_PRM_MAX_PATCH_COUNT];
 
+    /* Pipelined download */
+    UINT8               spd_window;             /* max segments sent ahead of their responses */
+    UINT8               spd_in_flight;          /* segments sent without a response yet */
+    UINT32              spd_start_ticks;        /* OS tick count when current patch started */
+    UINT32              spd_bytes_sent;         /* bytes of current patch sent to NFCC */
+
     /* I2C-patch */
     UINT8               *p_spd_patch;           /* pointer to spd patch             */
     UINT16              spd_patch_len_remaining;/* patch length                     */
@@ -387,6 +396,13 @@ typedef struct
     UINT8                   new_snooze_mode;        /* next snooze mode after receiving cmpl    */
     UINT8                   nfc_wake_active_mode;   /* NFC_HAL_LP_ACTIVE_LOW/HIGH               */
     TIMER_LIST_ENT          lp_timer;               /* timer for low power mode                 */
+    UINT32                  lp_idle_timeout;        /* idle time before deassert NFC_WAKE in ms */
+    UINT32                  lp_gap_avg;             /* smoothed gap between packets, ms << 3    */
+    UINT32                  lp_gap_dev;             /* smoothed deviation of the gap, ms << 2   */
+    UINT32                  lp_last_activity_ticks; /* OS ticks of the last TX/RX               */
+    UINT32                  lp_wake_ticks;          /* OS ticks when NFC_WAKE was asserted      */
+    BOOLEAN                 lp_wake_asserted;       /* TRUE if NFC_WAKE is asserted             */
+    tHAL_NFC_LP_STATS       lp_stats;               /* low power counters                       */
 
 
     tHAL_NFC_STATUS_CBACK   *p_prop_cback;          /* callback to notify complete of proprietary update */
@@ -464,6 +480,7 @@ void   nfc_hal_send_nci_msg_to_nfc_task (NFC_HDR * p_msg);
 
 /* nfc_hal_nci.c */
 BOOLEAN nfc_hal_nci_receive_msg (UINT8 byte);
+BOOLEAN nfc_hal_nci_receive_buf (NFC_HDR **pp_buf);
 BOOLEAN nfc_hal_nci_preproc_rx_nci_msg (NFC_HDR *p_msg);
 NFC_HDR* nfc_hal_nci_postproc_rx_nci_msg (void);
 void    nfc_hal_nci_assemble_nci_msg (void);
@@ -76,6 +76,15 @@ typedef struct
 #define NFC_HAL_LP_ACTIVE_LOW            NFC_SNOOZE_ACTIVE_LOW      /* high to low voltage is asserting */
 #define NFC_HAL_LP_ACTIVE_HIGH           NFC_SNOOZE_ACTIVE_HIGH     /* low to high voltage is asserting */
 
+/* Low power counters, see HAL_NfcGetLpStats */
+typedef struct
+{
+    UINT32  wake_count;         /* number of times NFC_WAKE was asserted        */
+    UINT32  snooze_count;       /* number of times NFC_WAKE was deasserted      */
+    UINT32  awake_ms;           /* total time NFC_WAKE was asserted in ms       */
+    UINT32  idle_timeout;       /* current idle timeout before snooze in ms     */
+} tHAL_NFC_LP_STATS;
+
 /*****************************************************************************
 **  Patch RAM Constants
 *****************************************************************************/
@@ -167,6 +176,21 @@ tHAL_NFC_STATUS HAL_NfcSetSnoozeMode (UINT8 snooze_mode,
                                       UINT8 dh_wake_active_mode,
                                       tHAL_NFC_STATUS_CBACK *p_snooze_cback);
 
+/*******************************************************************************
+**
+** Function         HAL_NfcGetLpStats
+**
+** Description      Get the low power counters since snooze mode was last set,
+**                  including the time of the current wake period
+**
+**                  p_stats
+**                      Counters are copied here
+**
+** Returns          void
+**
+*******************************************************************************/
+void HAL_NfcGetLpStats (tHAL_NFC_LP_STATS *p_stats);
+
 /*******************************************************************************
 **
 ** Function         HAL_NfcPrmDownloadStart
@@ -266,6 +290,27 @@ void HAL_NfcPrmSetI2cPatch (UINT8 *p_i2c_patchfile_buf,
 *******************************************************************************/
 tHAL_NFC_STATUS HAL_NfcPrmSetSpdNciCmdPayloadSize (UINT8 max_payload_size);
 
+/*******************************************************************************
+**
+** Function         HAL_NfcPrmSetSpdWindow
+**
+** Description      Set the number of patch segments PRM sends ahead of their
+**                  SECURE_PATCH_DOWNLOAD responses during secure patch download.
+**
+**                  This API must be called before calling HAL_NfcPrmDownloadStart.
+**                  If the API is not called, then PRM will use
+**                  NFC_HAL_PRM_SPD_WINDOW. The patch header and signature are
+**                  always sent alone, and only a patch given to
+**                  HAL_NfcPrmDownloadStart in a single buffer is pipelined.
+**
+**                  Valid window range: 1 to NFC_HAL_PRM_MAX_SPD_WINDOW.
+**
+** Returns          HAL_NFC_STATUS_OK if successful
+**                  HAL_NFC_STATUS_FAILED otherwise
+**
+*******************************************************************************/
+tHAL_NFC_STATUS HAL_NfcPrmSetSpdWindow (UINT8 window);
+
 /*******************************************************************************
 **
 ** Function         HAL_NfcSetMaxRfDataCredits
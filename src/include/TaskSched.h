@@ -0,0 +1,45 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#pragma once
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*******************************************************************************
+**
+** Function         taskSchedConfigure
+**
+** Description      Read a task's scheduling policy (0=other, 1=FIFO, 2=RR),
+**                  priority and CPU affinity mask from the config file and
+**                  hand them to GKI. Tasks without any setting keep GKI's
+**                  default. Used by both the NFC stack and the HAL.
+**                  task_id: GKI task to configure.
+**                  policyName, priorityName, cpuName: config file keys.
+**
+** Returns          None.
+**
+*******************************************************************************/
+void taskSchedConfigure (UINT8 task_id, const char* policyName, const char* priorityName, const char* cpuName);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -47,6 +47,7 @@ int GetNumValue(const char* name, void* p_value, unsigned long len);
 #define NAME_UART_PARITY                "UART_PARITY"
 #define NAME_UART_STOPBITS              "UART_STOPBITS"
 #define NAME_UART_DATABITS              "UART_DATABITS"
+#define NAME_UART_READAHEAD             "UART_READAHEAD"
 #define NAME_CLIENT_ADDRESS             "BCMI2CNFC_ADDRESS"
 #define NAME_NFA_DM_START_UP_CFG        "NFA_DM_START_UP_CFG"
 #define NAME_NFA_DM_CFG                 "NFA_DM_CFG"
@@ -54,6 +55,7 @@ int GetNumValue(const char* name, void* p_value, unsigned long len);
 #define NAME_LOW_SPEED_TRANSPORT        "LOW_SPEED_TRANSPORT"
 #define NAME_NFC_WAKE_DELAY             "NFC_WAKE_DELAY"
 #define NAME_NFC_WRITE_DELAY            "NFC_WRITE_DELAY"
+#define NAME_NFC_WRITE_GUARD_TIME       "NFC_WRITE_GUARD_TIME"
 #define NAME_PERF_MEASURE_FREQ          "REPORT_PERFORMANCE_MEASURE"
 #define NAME_READ_MULTI_PACKETS         "READ_MULTIPLE_PACKETS"
 #define NAME_POWER_ON_DELAY             "POWER_ON_DELAY"
@@ -84,10 +86,24 @@ int GetNumValue(const char* name, void* p_value, unsigned long len);
 #define NAME_DBG_NO_UICC_IDLE_TIMEOUT_TOGGLING  "DBG_NO_UICC_IDLE_TIMEOUT_TOGGLING"
 #define NAME_PRESENCE_CHECK_ALGORITHM   "PRESENCE_CHECK_ALGORITHM"
 #define NAME_ALLOW_NO_NVM               "ALLOW_NO_NVM"
+#define NAME_SPD_PIPELINE_WINDOW        "SPD_PIPELINE_WINDOW"
+#define NAME_FW_PATCH_CACHE             "FW_PATCH_CACHE"
 #define NAME_DEVICE_HOST_WHITE_LIST     "DEVICE_HOST_WHITE_LIST"
 #define NAME_POWER_OFF_MODE             "POWER_OFF_MODE"
 #define NAME_GLOBAL_RESET               "DO_GLOBAL_RESET"
 #define NAME_NCI_HAL_MODULE             "NCI_HAL_MODULE"
+#define NAME_NFC_TASK_SCHED_POLICY      "NFC_TASK_SCHED_POLICY"
+#define NAME_NFC_TASK_SCHED_PRIORITY    "NFC_TASK_SCHED_PRIORITY"
+#define NAME_NFC_TASK_CPU_AFFINITY      "NFC_TASK_CPU_AFFINITY"
+#define NAME_NFCA_TASK_SCHED_POLICY     "NFCA_TASK_SCHED_POLICY"
+#define NAME_NFCA_TASK_SCHED_PRIORITY   "NFCA_TASK_SCHED_PRIORITY"
+#define NAME_NFCA_TASK_CPU_AFFINITY     "NFCA_TASK_CPU_AFFINITY"
+#define NAME_NFC_HAL_TASK_SCHED_POLICY  "NFC_HAL_TASK_SCHED_POLICY"
+#define NAME_NFC_HAL_TASK_SCHED_PRIORITY "NFC_HAL_TASK_SCHED_PRIORITY"
+#define NAME_NFC_HAL_TASK_CPU_AFFINITY  "NFC_HAL_TASK_CPU_AFFINITY"
+#define NAME_USERIAL_TASK_SCHED_POLICY  "USERIAL_HAL_TASK_SCHED_POLICY"
+#define NAME_USERIAL_TASK_SCHED_PRIORITY "USERIAL_HAL_TASK_SCHED_PRIORITY"
+#define NAME_USERIAL_TASK_CPU_AFFINITY  "USERIAL_HAL_TASK_CPU_AFFINITY"
 
 #define                     LPTD_PARAM_LEN (40)
 
@@ -138,6 +138,12 @@
 #define NFC_HAL_NCI_POOL_BUF_SIZE   NFC_NCI_POOL_BUF_SIZE
 #endif
 
+/* Room reserved in front of received NCI messages (for shared NFC/HAL GKI, the HAL
+** reserves it too) */
+#ifndef NFC_RECEIVE_MSGS_OFFSET
+#define NFC_RECEIVE_MSGS_OFFSET     (10) /* callback function pointer(8; use 8 to be safe + NFC_SAVED_CMD_SIZE(2) */
+#endif
+
 
 /******************************************************************************
 **
@@ -154,6 +160,11 @@
 #define NFC_RESTORE_BAUD_ON_SHUTDOWN    TRUE
 #endif
 
+/* Maximum number of NCI data packets handed to the HAL write_batch entry at once */
+#ifndef NFC_WRITE_BATCH_SIZE
+#define NFC_WRITE_BATCH_SIZE            8
+#endif
+
 /******************************************************************************
 **
 ** NCI
@@ -685,6 +696,12 @@
 #ifndef HAL_WRITE
 #define HAL_WRITE(p)    {nfc_cb.p_hal->write(p->len, (UINT8 *)(p+1) + p->offset); GKI_freebuf(p);}
 
+/* Write a slice of a buffer that the caller keeps (HAL copies the bytes) */
+#define HAL_WRITE_SEG(p_data, len)  nfc_cb.p_hal->write((UINT16) (len), (UINT8 *) (p_data))
+
+/* Write whole packets together, then free them (HALs without write_batch get them one by one) */
+#define HAL_WRITE_BATCH(pp, num)    nfc_ncif_write_batch ((pp), (num))
+
 #ifdef NFC_HAL_SHARED_GKI
 
 /* NFC HAL Included if NFC_NFCEE_INCLUDED */
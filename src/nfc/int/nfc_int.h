@@ -132,8 +132,6 @@ typedef struct
     UINT8           status;     /* tHAL_NFC_STATUS */
 } tNFC_HAL_EVT_MSG;
 
-#define NFC_RECEIVE_MSGS_OFFSET     (10) /* callback function pointer(8; use 8 to be safe + NFC_SAVED_CMD_SIZE(2) */
-
 /* NFCC power state change pending callback */
 typedef void (tNFC_PWR_ST_CBACK) (void);
 #define NFC_SAVED_HDR_SIZE          (2)
@@ -182,6 +180,7 @@ typedef struct
     UINT8               last_cmd[NFC_SAVED_CMD_SIZE];/* part of last NCI command payload */
     void                *p_vsc_cback;       /* the callback function for last VSC command */
     BUFFER_Q            nci_cmd_xmit_q;     /* NCI command queue */
+    BUFFER_Q            mbox_batch_q;       /* messages read from NFC_MBOX_ID, not yet processed */
     TIMER_LIST_ENT      nci_wait_rsp_timer; /* Timer for waiting for nci command response */
     UINT16              nci_wait_rsp_tout;  /* NCI command timeout (in ms) */
     UINT8               nci_wait_rsp;       /* layer_specific for last NCI message */
@@ -223,6 +222,7 @@ NFC_API extern void nfc_data_event (tNFC_CONN_CB * p_cb);
 
 void nfc_ncif_send (BT_HDR *p_buf, BOOLEAN is_cmd);
 extern UINT8 nfc_ncif_send_data (tNFC_CONN_CB *p_cb, BT_HDR *p_data);
+extern void nfc_ncif_write_batch (BT_HDR **pp_buf, UINT8 num_bufs);
 NFC_API extern void nfc_ncif_cmd_timeout (void);
 NFC_API extern void nfc_wait_2_deactivate_timeout (void);
 
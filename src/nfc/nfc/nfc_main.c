@@ -613,6 +613,12 @@ static void nfc_main_hal_cback(UINT8 event, tHAL_NFC_STATUS status)
 **
 ** Description      HAL data event handler
 **
+**                  The received NCI message is copied into a stack buffer.
+**                  HALs built with NFC_HAL_SHARED_GKI share this GKI and
+**                  send their receive buffers straight to NFC_TASK
+**                  instead (see nfc_hal_send_nci_msg_to_nfc_task), so this
+**                  copy is only made for HALs that cannot share buffers.
+**
 ** Returns          void
 **
 *******************************************************************************/
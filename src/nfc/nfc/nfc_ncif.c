@@ -124,13 +124,51 @@ void nfc_wait_2_deactivate_timeout (void)
 }
 
 
+/*******************************************************************************
+**
+** Function         nfc_ncif_write_batch
+**
+** Description      This function is called to send several NCI packets to the
+**                  HAL in one call, if the HAL has a write_batch entry, and to
+**                  free them. Otherwise the packets are written one by one.
+**
+** Returns          void
+**
+*******************************************************************************/
+void nfc_ncif_write_batch (BT_HDR **pp_buf, UINT8 num_bufs)
+{
+    UINT16  data_len[NFC_WRITE_BATCH_SIZE];
+    UINT8   *p_data[NFC_WRITE_BATCH_SIZE];
+    UINT8   xx;
+
+    if ((num_bufs == 1) || (num_bufs > NFC_WRITE_BATCH_SIZE) || (nfc_cb.p_hal->write_batch == NULL))
+    {
+        for (xx = 0; xx < num_bufs; xx++)
+            HAL_WRITE (pp_buf[xx]);
+        return;
+    }
+
+    for (xx = 0; xx < num_bufs; xx++)
+    {
+        data_len[xx] = pp_buf[xx]->len;
+        p_data[xx]   = (UINT8 *) (pp_buf[xx] + 1) + pp_buf[xx]->offset;
+    }
+
+    /* HAL copies the packets before returning */
+    nfc_cb.p_hal->write_batch (num_bufs, data_len, p_data);
+
+    for (xx = 0; xx < num_bufs; xx++)
+        GKI_freebuf (pp_buf[xx]);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_ncif_send_data
 **
 ** Description      This function is called to add the NCI data header
 **                  and send it to NCIT task for sending it to transport
-**                  as credits are available.
+**                  as credits are available. Whole packets allowed by the
+**                  credits are handed to the HAL together.
 **
 ** Returns          void
 **
@@ -145,6 +183,8 @@ UINT8 nfc_ncif_send_data (tNFC_CONN_CB *p_cb, BT_HDR *p_data)
     UINT8   buffer_size = p_cb->buff_size;
     UINT8   hdr0 = p_cb->conn_id;
     BOOLEAN fragmented = FALSE;
+    BT_HDR *p_batch[NFC_WRITE_BATCH_SIZE];
+    UINT8   num_batch = 0;
 
     NFC_TRACE_DEBUG3 ("nfc_ncif_send_data :%d, num_buff:%d qc:%d", p_cb->conn_id, p_cb->num_buff, p_cb->tx_q.count);
     if (p_cb->id == NFC_RF_CONN_ID)
@@ -190,57 +230,69 @@ UINT8 nfc_ncif_send_data (tNFC_CONN_CB *p_cb, BT_HDR *p_data)
         }
         else
         {
+            pbf         = 1;
             fragmented  = TRUE;
             ulen        = buffer_size;
         }
 
+        if (p_cb->num_buff != NFC_CONN_NO_FC)
+            p_cb->num_buff--;
+
         if (!fragmented)
         {
             /* if data packet is not fragmented, use the original buffer */
             p         = p_data;
             p_data    = (BT_HDR *)GKI_dequeue (&p_cb->tx_q);
+
+            p->event             = BT_EVT_TO_NFC_NCI;
+            p->layer_specific    = pbf;
+            p->len              += NCI_DATA_HDR_SIZE;
+            p->offset           -= NCI_DATA_HDR_SIZE;
+            pp = (UINT8 *)(p + 1) + p->offset;
+            /* build NCI Data packet header */
+            NCI_DATA_PBLD_HDR(pp, pbf, hdr0, ulen);
+
+            /* send to HAL together with the packets that follow */
+            p_batch[num_batch++] = p;
+            if (num_batch == NFC_WRITE_BATCH_SIZE)
+            {
+                HAL_WRITE_BATCH (p_batch, num_batch);
+                num_batch = 0;
+            }
+
+            /* check if there are more data to send */
+            p_data = (BT_HDR *)GKI_getfirst (&p_cb->tx_q);
         }
         else
         {
-            /* the data packet is too big and need to be fragmented
-             * prepare a new GKI buffer
-             * (even the last fragment to avoid issues) */
-            if ((p = NCI_GET_CMD_BUF(ulen)) == NULL)
-                return (NCI_STATUS_BUFFER_FULL);
-            p->len    = ulen;
-            p->offset = NCI_MSG_OFFSET_SIZE + NCI_DATA_HDR_SIZE + 1;
-            if (p->len)
+            /* keep the order on the transport */
+            if (num_batch)
             {
-            pp        = (UINT8 *)(p + 1) + p->offset;
-            ps        = (UINT8 *)(p_data + 1) + p_data->offset;
-            memcpy (pp, ps, ulen);
+                HAL_WRITE_BATCH (p_batch, num_batch);
+                num_batch = 0;
             }
-            /* adjust the BT_HDR on the old fragment */
-            p_data->len     -= ulen;
-            p_data->offset  += ulen;
-        }
 
-        p->event             = BT_EVT_TO_NFC_NCI;
-        p->layer_specific    = pbf;
-        p->len              += NCI_DATA_HDR_SIZE;
-        p->offset           -= NCI_DATA_HDR_SIZE;
-        pp = (UINT8 *)(p + 1) + p->offset;
-        /* build NCI Data packet header */
-        NCI_DATA_PBLD_HDR(pp, pbf, hdr0, ulen);
-
-        if (p_cb->num_buff != NFC_CONN_NO_FC)
-            p_cb->num_buff--;
+            /* the data packet is too big and need to be fragmented.
+             * HAL copies what it is given, so each fragment is sent straight
+             * out of the original buffer: its NCI Data header is built just
+             * before it, over the offset area or the end of the fragment
+             * already sent */
+            pp = (UINT8 *)(p_data + 1) + p_data->offset - NCI_DATA_HDR_SIZE;
+            ps = pp;
+            NCI_DATA_PBLD_HDR(pp, pbf, hdr0, ulen);
 
-        /* send to HAL */
-        HAL_WRITE(p);
+            /* send to HAL */
+            HAL_WRITE_SEG(ps, ulen + NCI_DATA_HDR_SIZE);
 
-        if (!fragmented)
-        {
-            /* check if there are more data to send */
-            p_data = (BT_HDR *)GKI_getfirst (&p_cb->tx_q);
+            /* adjust the BT_HDR on the old fragment */
+            p_data->len     -= ulen;
+            p_data->offset  += ulen;
         }
     }
 
+    if (num_batch)
+        HAL_WRITE_BATCH (p_batch, num_batch);
+
     return (NCI_STATUS_OK);
 }
 
@@ -1392,6 +1444,73 @@ void nfc_ncif_proc_t3t_polling_ntf (UINT8 *p, UINT16 plen)
     rw_t3t_handle_nci_poll_ntf (status, num_responses, (UINT8) plen, p);
 }
 
+/*******************************************************************************
+**
+** Function         nfc_ncif_chain_len
+**
+** Description      Add up the payload of a data packet chained in segments
+**
+** Returns          total length
+**
+*******************************************************************************/
+static UINT16 nfc_ncif_chain_len (BT_HDR *p_buf)
+{
+    UINT16  len = 0;
+
+    for (; p_buf; p_buf = (BT_HDR *) GKI_get_next_seg (p_buf))
+        len += p_buf->len;
+
+    return (len);
+}
+
+/*******************************************************************************
+**
+** Function         nfc_ncif_flatten_data
+**
+** Description      Make a reassembled data packet contiguous. The segments are
+**                  copied after the first buffer if it has room, or else the
+**                  whole packet is copied into a buffer of the right size.
+**
+** Returns          the contiguous packet, or NULL if no buffer is available
+**                  (the chain is then left untouched)
+**
+*******************************************************************************/
+static BT_HDR *nfc_ncif_flatten_data (BT_HDR *p_head)
+{
+    BT_HDR  *p_flat, *p_seg, *p_rest;
+    UINT16  total = nfc_ncif_chain_len (p_head);
+    UINT8   *pd;
+
+    if (GKI_get_buf_size (p_head) >= (BT_HDR_SIZE + p_head->offset + total))
+    {
+        p_flat = p_head;
+        p_rest = (BT_HDR *) GKI_unchain_buf (p_head);
+        p_seg  = p_rest;
+    }
+    else
+    {
+        if ((p_flat = (BT_HDR *) GKI_getbuf ((UINT16) (BT_HDR_SIZE + p_head->offset + total))) == NULL)
+            return (NULL);
+
+        memcpy (p_flat, p_head, BT_HDR_SIZE);
+        memcpy ((UINT8 *) (p_flat + 1) + p_flat->offset, (UINT8 *) (p_head + 1) + p_head->offset, p_head->len);
+        p_rest = p_head;
+        p_seg  = (BT_HDR *) GKI_get_next_seg (p_head);
+    }
+
+    pd = (UINT8 *) (p_flat + 1) + p_flat->offset + p_head->len;
+    for (; p_seg; p_seg = (BT_HDR *) GKI_get_next_seg (p_seg))
+    {
+        memcpy (pd, (UINT8 *) (p_seg + 1) + p_seg->offset, p_seg->len);
+        pd += p_seg->len;
+    }
+
+    p_flat->len = total;
+    GKI_freebuf (p_rest);
+
+    return (p_flat);
+}
+
 /*******************************************************************************
 **
 ** Function         nfc_data_event
@@ -1403,7 +1522,7 @@ void nfc_ncif_proc_t3t_polling_ntf (UINT8 *p, UINT16 plen)
 *******************************************************************************/
 void nfc_data_event (tNFC_CONN_CB * p_cb)
 {
-    BT_HDR      *p_evt;
+    BT_HDR      *p_evt, *p_flat, *p_seg;
     tNFC_DATA_CEVT data_cevt;
     UINT8       *p;
 
@@ -1428,6 +1547,36 @@ void nfc_data_event (tNFC_CONN_CB * p_cb)
             }
 
             p_evt = (BT_HDR *) GKI_dequeue (&p_cb->rx_q);
+
+            if (GKI_get_next_seg (p_evt))
+            {
+                /* a reassembled packet is reported in a single buffer */
+                if ((p_flat = nfc_ncif_flatten_data (p_evt)) != NULL)
+                {
+                    p_evt = p_flat;
+#ifdef DISP_NCI
+                    if (!(p_evt->layer_specific & NFC_RAS_FRAGMENTED))
+                    {
+                        /* this packet was reassembled. display the complete packet */
+                        DISP_NCI ((UINT8 *)(p_evt + 1) + p_evt->offset, p_evt->len, TRUE);
+                    }
+#endif
+                }
+                else
+                {
+                    /* no buffer for the whole packet: report the first segment
+                     * with status Continue and put the others back in front of
+                     * the queue, with their NCI header room restored */
+                    NFC_TRACE_ERROR0 ("nfc_data_event () no buffer to reassemble data");
+                    p_seg = (BT_HDR *) GKI_unchain_buf (p_evt);
+                    p_seg->offset          -= NCI_MSG_HDR_SIZE;
+                    p_seg->len             += NCI_MSG_HDR_SIZE;
+                    p_seg->layer_specific   = p_evt->layer_specific;
+                    p_evt->layer_specific  |= (NFC_RAS_FRAGMENTED | NFC_RAS_TOO_BIG);
+                    GKI_enqueue_head (&p_cb->rx_q, p_seg);
+                }
+            }
+
             /* report data event */
             p_evt->offset   += NCI_MSG_HDR_SIZE;
             p_evt->len      -= NCI_MSG_HDR_SIZE;
@@ -1476,9 +1625,6 @@ void nfc_ncif_proc_data (BT_HDR *p_msg)
     tNFC_CONN_CB * p_cb;
     UINT8   pbf;
     BT_HDR  *p_last;
-    UINT8   *ps, *pd;
-    UINT16  size;
-    BT_HDR  *p_max = NULL;
     UINT16  len;
 
     pp   = (UINT8 *) (p_msg+1) + p_msg->offset;
@@ -1495,67 +1641,29 @@ void nfc_ncif_proc_data (BT_HDR *p_msg)
         p_last = (BT_HDR *)GKI_getlast (&p_cb->rx_q);
         if (p_last && (p_last->layer_specific & NFC_RAS_FRAGMENTED))
         {
-            /* last data buffer is not last fragment, append this new packet to the last */
-            size = GKI_get_buf_size(p_last);
-            if (size < (BT_HDR_SIZE + p_last->len + p_last->offset + len))
-            {
-                /* the current size of p_last is not big enough to hold the new fragment, p_msg */
-                if (size != GKI_MAX_BUF_SIZE)
-                {
-                    /* try the biggest GKI pool */
-                    p_max = (BT_HDR *)GKI_getpoolbuf (GKI_MAX_BUF_SIZE_POOL_ID);
-                    if (p_max)
-                    {
-                        /* copy the content of last buffer to the new buffer */
-                        memcpy(p_max, p_last, BT_HDR_SIZE);
-                        pd  = (UINT8 *)(p_max + 1) + p_max->offset;
-                        ps  = (UINT8 *)(p_last + 1) + p_last->offset;
-                        memcpy(pd, ps, p_last->len);
-
-                        /* place the new buffer in the queue instead */
-                        GKI_remove_from_queue (&p_cb->rx_q, p_last);
-                        GKI_freebuf (p_last);
-                        GKI_enqueue (&p_cb->rx_q, p_max);
-                        p_last  = p_max;
-                    }
-                }
-                if (p_max == NULL)
-                {
-                    /* Biggest GKI Pool not available (or)
-                     * Biggest available GKI Pool is not big enough to hold the new fragment, p_msg */
-                    p_last->layer_specific  |= NFC_RAS_TOO_BIG;
-                }
-            }
+            /* last data buffer is not last fragment, chain this new packet to the last.
+             * The packet is only made contiguous once it is reported */
+            len = p_msg->len - NCI_MSG_HDR_SIZE;
 
-            ps   = (UINT8 *)(p_msg + 1) + p_msg->offset + NCI_MSG_HDR_SIZE;
-            len  = p_msg->len - NCI_MSG_HDR_SIZE;
-
-            if (!(p_last->layer_specific & NFC_RAS_TOO_BIG))
+            if ((BT_HDR_SIZE + p_last->offset + nfc_ncif_chain_len (p_last) + len) > GKI_MAX_BUF_SIZE)
             {
-                pd   = (UINT8 *)(p_last + 1) + p_last->offset + p_last->len;
-                memcpy(pd, ps, len);
-                p_last->len  += len;
-                /* do not need to update pbf and len in NCI header.
-                 * They are stripped off at NFC_DATA_CEVT and len may exceed 255 */
-                NFC_TRACE_DEBUG1 ("nfc_ncif_proc_data len:%d", p_last->len);
-                p_last->layer_specific  = p_msg->layer_specific;
-                GKI_freebuf (p_msg);
-#ifdef DISP_NCI
-                if (!(p_last->layer_specific & NFC_RAS_FRAGMENTED))
-                {
-                    /* this packet was reassembled. display the complete packet */
-                    DISP_NCI ((UINT8 *)(p_last + 1) + p_last->offset, p_last->len, TRUE);
-                }
-#endif
+                /* The biggest GKI Pool is not big enough to hold the reassembled packet
+                 * Send data already in queue first with status Continue */
+                p_last->layer_specific  |= NFC_RAS_TOO_BIG;
                 nfc_data_event (p_cb);
+                /* now enqueue the new buffer to the rx queue */
+                GKI_enqueue (&p_cb->rx_q, p_msg);
             }
             else
             {
-                /* Not enough memory to add new buffer
-                 * Send data already in queue first with status Continue */
+                /* strip the NCI header off the new segment.
+                 * pbf and len in the NCI header of the first one are stripped off at NFC_DATA_CEVT */
+                p_msg->offset  += NCI_MSG_HDR_SIZE;
+                p_msg->len      = len;
+                p_last->layer_specific  = p_msg->layer_specific;
+                GKI_chain_buf (p_last, p_msg);
+                NFC_TRACE_DEBUG1 ("nfc_ncif_proc_data len:%d", nfc_ncif_chain_len (p_last));
                 nfc_data_event (p_cb);
-                /* now enqueue the new buffer to the rx queue */
-                GKI_enqueue (&p_cb->rx_q, p_msg);
             }
         }
         else
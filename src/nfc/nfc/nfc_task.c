@@ -310,6 +310,11 @@ void nfc_task_shutdown_nfcc (void)
     BT_HDR        *p_msg;
 
     /* Free any messages still in the mbox */
+    while ((p_msg = (BT_HDR *) GKI_dequeue_batch (&nfc_cb.mbox_batch_q)) != NULL)
+    {
+        GKI_freebuf (p_msg);
+    }
+
     while ((p_msg = (BT_HDR *) GKI_read_mbox (NFC_MBOX_ID)) != NULL)
     {
         GKI_freebuf (p_msg);
@@ -358,9 +363,15 @@ UINT32 nfc_task (UINT32 param)
     UINT16  event;
     BT_HDR  *p_msg;
     BOOLEAN free_buf;
+#if (defined (NFA_INCLUDED) && NFA_INCLUDED == TRUE)
+    BUFFER_Q nfa_msg_q;
+
+    GKI_init_q (&nfa_msg_q);
+#endif
 
     /* Initialize the nfc control block */
     memset (&nfc_cb, 0, sizeof (tNFC_CB));
+    GKI_init_q (&nfc_cb.mbox_batch_q);
     nfc_cb.trace_level = NFC_INITIAL_TRACE_LEVEL;
 
     NFC_TRACE_DEBUG0 ("NFC_TASK started.");
@@ -382,8 +393,11 @@ UINT32 nfc_task (UINT32 param)
 
         if (event & NFC_MBOX_EVT_MASK)
         {
-            /* Process all incoming NCI messages */
-            while ((p_msg = (BT_HDR *) GKI_read_mbox (NFC_MBOX_ID)) != NULL)
+            /* Process all incoming NCI messages. They are taken from the mbox in one go;
+            ** nfc_task_shutdown_nfcc () frees whatever is left if NFC is shut down meanwhile */
+            GKI_read_mbox_batch (NFC_MBOX_ID, &nfc_cb.mbox_batch_q);
+
+            while ((p_msg = (BT_HDR *) GKI_dequeue_batch (&nfc_cb.mbox_batch_q)) != NULL)
             {
                 free_buf = TRUE;
 
@@ -391,6 +405,11 @@ UINT32 nfc_task (UINT32 param)
                 switch (p_msg->event & BT_EVT_MASK)
                 {
                     case BT_EVT_TO_NFC_NCI:
+#ifdef NFC_HAL_SHARED_GKI
+                        /* HAL sends its buffers here directly; ignore all data while shutting down NFCC */
+                        if (nfc_cb.nfc_state == NFC_STATE_W4_HAL_CLOSE)
+                            break;
+#endif
                         free_buf = nfc_ncif_process_event (p_msg);
                         break;
 
@@ -435,7 +454,9 @@ UINT32 nfc_task (UINT32 param)
 #if (defined (NFA_INCLUDED) && NFA_INCLUDED == TRUE)
         if (event & NFA_MBOX_EVT_MASK)
         {
-            while ((p_msg = (BT_HDR *) GKI_read_mbox (NFA_MBOX_ID)) != NULL)
+            GKI_read_mbox_batch (NFA_MBOX_ID, &nfa_msg_q);
+
+            while ((p_msg = (BT_HDR *) GKI_dequeue_batch (&nfa_msg_q)) != NULL)
             {
                 nfa_sys_event (p_msg);
             }
@@ -0,0 +1,25 @@
+LOCAL_PATH:= $(call my-dir)
+NFC_ROOT := $(LOCAL_PATH)/..
+
+
+######################################
+# Build host executable gki_sim_test: GKI regression tests on the
+# virtual-time backend in src/gki/sim. Run it; it exits non-zero on failure.
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := gki_sim_test
+LOCAL_MODULE_TAGS := tests
+LOCAL_CFLAGS := -DBUILDCFG=1 -DLINUX_NATIVE -DGKI_SIMULATION=TRUE -DGKI_WAIT_EVENTFD=FALSE
+LOCAL_C_INCLUDES := \
+    $(NFC_ROOT)/src/include \
+    $(NFC_ROOT)/src/gki/sim \
+    $(NFC_ROOT)/src/gki/ulinux \
+    $(NFC_ROOT)/src/gki/common
+LOCAL_SRC_FILES := \
+    ../src/gki/common/gki_buffer.c \
+    ../src/gki/common/gki_debug.c \
+    ../src/gki/common/gki_time.c \
+    ../src/gki/sim/gki_sim.c \
+    gki_sim_test.c
+LOCAL_LDLIBS := -lpthread
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,187 @@
+/******************************************************************************
+ *
+ *  Copyright (C) 2026 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/******************************************************************************
+ *
+ *  Regression tests for GKI, run on the virtual-time backend in src/gki/sim.
+ *  Each scenario creates a few GKI tasks and runs them with GKI_run(); the
+ *  tasks record what they saw and main() checks it afterwards.
+ *
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdarg.h>
+#include "gki.h"
+
+#define SIM_TASK_A      1
+#define SIM_TASK_B      2
+#define SIM_TASK_C      3
+#define SIM_TASK_D      4
+
+extern void GKI_shutdown (void);
+
+static int failures;
+
+#define CHECK(cond) \
+    do { if (!(cond)) { fprintf (stderr, "%s:%d: CHECK (%s) failed\n", __FILE__, __LINE__, #cond); failures++; } } while (0)
+
+/* GKI traces go nowhere */
+void LogMsg (UINT32 trace_set_mask, const char *fmt_str, ...)
+{
+    (void) trace_set_mask;
+    (void) fmt_str;
+}
+
+void LogMsg_0 (UINT32 trace_set_mask, const char *p_str)
+{
+    (void) trace_set_mask;
+    (void) p_str;
+}
+
+/*******************************************************************************
+** Tasks and timers: task A starts a 100 ms timer and is woken at 30 ms by an
+** event from task B, which slept with GKI_delay(). A then gets the timer at
+** 100 ms and a GKI_wait() timeout at 350 ms.
+*******************************************************************************/
+static UINT16 timer_evt[3];
+static UINT32 timer_when[3];
+
+static void timer_task_a (UINT32 param)
+{
+    UINT16 flags = TIMER_0_EVT_MASK | EVENT_MASK (APPL_EVT_0);
+    int    i;
+
+    (void) param;
+
+    GKI_start_timer (TIMER_0, GKI_MS_TO_TICKS (100), FALSE);
+
+    for (i = 0; i < 2; i++)
+    {
+        timer_evt[i]  = GKI_wait (flags, 0);
+        timer_when[i] = GKI_sim_get_time ();
+    }
+
+    timer_evt[2]  = GKI_wait (EVENT_MASK (APPL_EVT_1), 250);
+    timer_when[2] = GKI_sim_get_time ();
+}
+
+static void timer_task_b (UINT32 param)
+{
+    (void) param;
+
+    GKI_delay (30);
+    GKI_send_event (SIM_TASK_A, EVENT_MASK (APPL_EVT_0));
+}
+
+static void test_tasks_and_timers (void)
+{
+    GKI_create_task ((TASKPTR) timer_task_a, SIM_TASK_A, (INT8 *) "SIM_A", 0, 0, NULL, NULL);
+    GKI_create_task ((TASKPTR) timer_task_b, SIM_TASK_B, (INT8 *) "SIM_B", 0, 0, NULL, NULL);
+
+    GKI_run (NULL);
+
+    CHECK (timer_evt[0] == EVENT_MASK (APPL_EVT_0));
+    CHECK (timer_when[0] == 30);
+    CHECK (timer_evt[1] == TIMER_0_EVT_MASK);
+    CHECK (timer_when[1] == 100);
+    CHECK (timer_evt[2] == 0);
+    CHECK (timer_when[2] == 350);
+}
+
+/*******************************************************************************
+** GKI_igetpoolbuf() with buffers in a task cache: task C takes every buffer of
+** pool 0 and frees two of them into its cache, leaving the free queue empty.
+** Task D must then get NULL, and task C one of its cached buffers.
+*******************************************************************************/
+static UINT16 pool_total;
+static UINT16 pool_free_after_fill;
+static UINT16 pool_free_after_test;
+static BOOLEAN pool_filled;
+static void *p_igetpool_c;
+static void *p_igetpool_d;
+
+static void buf_task_c (UINT32 param)
+{
+    void   *bufs[GKI_BUF0_MAX];
+    UINT16 i;
+
+    (void) param;
+
+    pool_total  = GKI_poolcount (GKI_POOL_ID_0);
+    pool_filled = (pool_total <= GKI_BUF0_MAX);
+    if (!pool_filled)
+        return;
+
+    for (i = 0; i < pool_total; i++)
+    {
+        if ((bufs[i] = GKI_getpoolbuf (GKI_POOL_ID_0)) == NULL)
+            pool_filled = FALSE;
+    }
+    pool_free_after_fill = GKI_poolfreecount (GKI_POOL_ID_0);
+
+    GKI_freebuf (bufs[--i]);
+    GKI_freebuf (bufs[--i]);
+
+    GKI_send_event (SIM_TASK_D, EVENT_MASK (APPL_EVT_0));
+    GKI_wait (EVENT_MASK (APPL_EVT_0), 0);
+
+    if ((p_igetpool_c = GKI_igetpoolbuf (GKI_POOL_ID_0)) != NULL)
+        GKI_freebuf (p_igetpool_c);
+
+    while (i > 0)
+        GKI_freebuf (bufs[--i]);
+    pool_free_after_test = GKI_poolfreecount (GKI_POOL_ID_0);
+}
+
+static void buf_task_d (UINT32 param)
+{
+    (void) param;
+
+    GKI_wait (EVENT_MASK (APPL_EVT_0), 0);
+
+    if ((p_igetpool_d = GKI_igetpoolbuf (GKI_POOL_ID_0)) != NULL)
+        GKI_freebuf (p_igetpool_d);
+
+    GKI_send_event (SIM_TASK_C, EVENT_MASK (APPL_EVT_0));
+}
+
+static void test_igetpoolbuf_with_cached_buffers (void)
+{
+    GKI_create_task ((TASKPTR) buf_task_c, SIM_TASK_C, (INT8 *) "SIM_C", 0, 0, NULL, NULL);
+    GKI_create_task ((TASKPTR) buf_task_d, SIM_TASK_D, (INT8 *) "SIM_D", 0, 0, NULL, NULL);
+
+    GKI_run (NULL);
+
+    CHECK (pool_filled);
+    CHECK (pool_free_after_fill == 0);
+    CHECK (p_igetpool_d == NULL);
+    CHECK (p_igetpool_c != NULL);
+    CHECK (pool_free_after_test == pool_total);
+}
+
+int main (void)
+{
+    GKI_init ();
+
+    test_tasks_and_timers ();
+    test_igetpoolbuf_with_cached_buffers ();
+
+    GKI_shutdown ();
+
+    printf ("gki_sim_test: %s\n", failures ? "FAILED" : "PASSED");
+    return (failures ? 1 : 0);
+}